@@ -7,10 +7,12 @@
 LoDBDemoModule::LoDBDemoModule() : SinglePortModule("LoDBDemo", meshtastic_PortNum_TEXT_MESSAGE_APP), db(new LoDb("lodb_demo"))
 {
     db->registerTable("messages", &meshtastic_LoDBDemoMessage_msg, sizeof(meshtastic_LoDBDemoMessage));
+    queue = new LoDbAsync(db);
 }
 
 LoDBDemoModule::~LoDBDemoModule()
 {
+    delete queue;
     delete db;
 }
 
@@ -28,9 +30,13 @@ ProcessMessage LoDBDemoModule::handleReceived(const meshtastic_MeshPacket &mp)
     record.text[copy_len] = '\0';
 
     lodb_uuid_t uuid = lodb_new_uuid(nullptr, record.timestamp ^ record.from_node);
-    LoDbError err = db->insert("messages", uuid, &record);
+    LoDbError err = queue->insertAsync("messages", uuid, &record, [](LoDbError result) {
+        if (result != LODB_OK) {
+            LOG_WARN("LoDBDemo: failed to log message err=%d", result);
+        }
+    });
     if (err != LODB_OK) {
-        LOG_WARN("LoDBDemo: failed to log message err=%d", err);
+        LOG_WARN("LoDBDemo: message not queued err=%d", err);
     }
 
     return ProcessMessage::CONTINUE;
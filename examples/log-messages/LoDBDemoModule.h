@@ -2,13 +2,15 @@
 
 #include "SinglePortModule.h"
 #include "lodb/LoDB.h"
+#include "lodb/LoDBAsync.h"
 #include "lodb_demo.pb.h"
 
 /**
  * LoDBDemoModule
  *
  * Example module that listens on TEXT_MESSAGE_APP and logs every message to
- * LoDB using the lodb_demo messages table.
+ * LoDB using the lodb_demo messages table. Inserts are queued through LoDbAsync
+ * so handleReceived() doesn't wait for the write.
  */
 class LoDBDemoModule : public SinglePortModule
 {
@@ -21,4 +23,5 @@ class LoDBDemoModule : public SinglePortModule
 
   private:
     LoDb *db;
+    LoDbAsync *queue;
 };
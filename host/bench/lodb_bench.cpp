@@ -0,0 +1,347 @@
+#include "Arduino.h"
+#include "LoDB.h"
+#include "diagnostics.pb.h"
+#include "lofs/src/LoFS.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * LoDB benchmark
+ *
+ * Measures ops/sec and p50/p99 latency of the main LoDb calls on tables of
+ * LoDBDiagnosticsTest records at several sizes, and prints the results as JSON on
+ * stdout. Record contents, UUIDs and the order of operations are derived from the
+ * seed alone, so runs with the same arguments do the same work on every commit.
+ *
+ * Usage: lodb_bench [--sizes 100,1000,10000,100000] [--seed N] [--ops N] [--scan-ops N]
+ *                   [--storage files|segment|ring] [--layout flat|shard16|shard256] [--cache-bytes N]
+ *                   [--compression none|lz]
+ */
+
+#define BENCH_DB_NAME "lodb_bench"
+#define BENCH_DB_PATH "/internal/lodb/" BENCH_DB_NAME
+#define BENCH_TABLE "rows"
+
+struct BenchOptions {
+    std::vector<uint32_t> sizes = {100, 1000, 10000, 100000};
+    uint64_t seed = 1;
+    uint32_t ops = 1000;    // Samples of each single-record operation
+    uint32_t scan_ops = 10; // Samples of each whole-table operation
+    LoDbTableOptions table;
+    LoDbOptions db;
+};
+
+struct BenchResult {
+    uint32_t rows;
+    const char *op;
+    size_t samples;
+    double ops_per_sec;
+    double p50_us;
+    double p99_us;
+};
+
+// splitmix64: small, fast and identical on every platform
+static uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static meshtastic_LoDBDiagnosticsTest makeRecord(uint32_t id, uint64_t *state)
+{
+    meshtastic_LoDBDiagnosticsTest record = meshtastic_LoDBDiagnosticsTest_init_zero;
+    uint64_t bits = nextRandom(state);
+    record.id = id;
+    snprintf(record.value, sizeof(record.value), "row-%08x-%08x", (uint32_t)bits, id);
+    record.timestamp = (uint32_t)(bits >> 32);
+    record.active = (bits & 0x100) != 0;
+    return record;
+}
+
+class Timer
+{
+  public:
+    void start() { began = std::chrono::steady_clock::now(); }
+    void stop()
+    {
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - began).count());
+    }
+
+    BenchResult result(uint32_t rows, const char *op)
+    {
+        BenchResult result = {rows, op, samples.size(), 0, 0, 0};
+        if (samples.empty()) {
+            return result;
+        }
+        double total_us = 0;
+        for (double sample : samples) {
+            total_us += sample;
+        }
+        std::sort(samples.begin(), samples.end());
+        result.ops_per_sec = total_us > 0 ? samples.size() * 1e6 / total_us : 0;
+        result.p50_us = percentile(50);
+        result.p99_us = percentile(99);
+        return result;
+    }
+
+  private:
+    std::chrono::steady_clock::time_point began;
+    std::vector<double> samples;
+
+    // Nearest-rank percentile of the sorted samples
+    double percentile(uint32_t percent) const
+    {
+        size_t rank = (samples.size() * percent + 99) / 100;
+        return samples[rank == 0 ? 0 : rank - 1];
+    }
+};
+
+static void benchSize(const BenchOptions &options, uint32_t rows, std::vector<BenchResult> &results)
+{
+    LoFS::rmdir(BENCH_DB_PATH, true);
+    LoDb *db = new LoDb(BENCH_DB_NAME, LoFS::FSType::INTERNAL, options.db);
+
+    // A ring sized to the run holds every row, so no workload reads an evicted record
+    LoDbTableOptions table = options.table;
+    if (table.storage == LODB_STORAGE_RING) {
+        table.ring_capacity = rows;
+        table.ring_slot_size = meshtastic_LoDBDiagnosticsTest_size;
+    }
+    db->registerTable(BENCH_TABLE, &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), table);
+
+    uint64_t state = options.seed ^ ((uint64_t)rows << 32);
+    std::vector<lodb_uuid_t> uuids(rows);
+    meshtastic_LoDBDiagnosticsTest record;
+
+    Timer insert;
+    for (uint32_t i = 0; i < rows; i++) {
+        uuids[i] = nextRandom(&state);
+        record = makeRecord(i, &state);
+        insert.start();
+        db->insert(BENCH_TABLE, uuids[i], &record);
+        insert.stop();
+    }
+    results.push_back(insert.result(rows, "insert"));
+
+    Timer get_hit;
+    for (uint32_t i = 0; i < options.ops; i++) {
+        lodb_uuid_t uuid = uuids[nextRandom(&state) % rows];
+        get_hit.start();
+        db->get(BENCH_TABLE, uuid, &record);
+        get_hit.stop();
+    }
+    results.push_back(get_hit.result(rows, "get_hit"));
+
+    Timer get_miss;
+    for (uint32_t i = 0; i < options.ops; i++) {
+        lodb_uuid_t uuid = nextRandom(&state); // Collides with a stored UUID with negligible probability
+        get_miss.start();
+        db->get(BENCH_TABLE, uuid, &record);
+        get_miss.stop();
+    }
+    results.push_back(get_miss.result(rows, "get_miss"));
+
+    Timer update;
+    for (uint32_t i = 0; i < options.ops; i++) {
+        uint32_t row = nextRandom(&state) % rows;
+        record = makeRecord(row, &state);
+        update.start();
+        db->update(BENCH_TABLE, uuids[row], &record);
+        update.stop();
+    }
+    results.push_back(update.result(rows, "update"));
+
+    Timer select_filtered;
+    for (uint32_t i = 0; i < options.scan_ops; i++) {
+        uint32_t threshold = (uint32_t)nextRandom(&state);
+        select_filtered.start();
+        std::vector<void *> selected = db->select(BENCH_TABLE, [threshold](const void *candidate) {
+            const meshtastic_LoDBDiagnosticsTest *row = (const meshtastic_LoDBDiagnosticsTest *)candidate;
+            return row->active && row->timestamp >= threshold;
+        });
+        select_filtered.stop();
+        LoDb::freeRecords(selected);
+    }
+    results.push_back(select_filtered.result(rows, "select_filtered"));
+
+    Timer select_sorted;
+    for (uint32_t i = 0; i < options.scan_ops; i++) {
+        select_sorted.start();
+        std::vector<void *> selected = db->select(BENCH_TABLE, LoDbFilter(), [](const void *a, const void *b) {
+            return ((const meshtastic_LoDBDiagnosticsTest *)a)->timestamp < ((const meshtastic_LoDBDiagnosticsTest *)b)->timestamp;
+        });
+        select_sorted.stop();
+        LoDb::freeRecords(selected);
+    }
+    results.push_back(select_sorted.result(rows, "select_sorted"));
+
+    Timer count;
+    for (uint32_t i = 0; i < options.scan_ops; i++) {
+        count.start();
+        db->count(BENCH_TABLE);
+        count.stop();
+    }
+    results.push_back(count.result(rows, "count"));
+
+    Timer count_filtered;
+    for (uint32_t i = 0; i < options.scan_ops; i++) {
+        count_filtered.start();
+        db->count(BENCH_TABLE, [](const void *candidate) { return ((const meshtastic_LoDBDiagnosticsTest *)candidate)->active; });
+        count_filtered.stop();
+    }
+    results.push_back(count_filtered.result(rows, "count_filtered"));
+
+    // Delete distinct rows, picked by a seeded shuffle
+    Timer remove;
+    uint32_t deletes = std::min(options.ops, rows);
+    for (uint32_t i = 0; i < deletes; i++) {
+        uint32_t pick = i + nextRandom(&state) % (rows - i);
+        std::swap(uuids[i], uuids[pick]);
+        remove.start();
+        db->deleteRecord(BENCH_TABLE, uuids[i]);
+        remove.stop();
+    }
+    results.push_back(remove.result(rows, "delete"));
+
+    delete db;
+    LoFS::rmdir(BENCH_DB_PATH, true);
+}
+
+static bool parseSizes(const char *list, std::vector<uint32_t> &sizes)
+{
+    sizes.clear();
+    const char *cursor = list;
+    while (*cursor) {
+        char *end;
+        unsigned long size = strtoul(cursor, &end, 10);
+        if (end == cursor || size == 0) {
+            return false;
+        }
+        sizes.push_back((uint32_t)size);
+        cursor = *end == ',' ? end + 1 : end;
+    }
+    return !sizes.empty();
+}
+
+static bool parseArguments(int argc, char **argv, BenchOptions &options)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--sizes") == 0) {
+            if (!parseSizes(value, options.sizes)) {
+                return false;
+            }
+        } else if (strcmp(arg, "--seed") == 0) {
+            options.seed = strtoull(value, nullptr, 10);
+        } else if (strcmp(arg, "--ops") == 0) {
+            options.ops = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--scan-ops") == 0) {
+            options.scan_ops = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--storage") == 0) {
+            if (strcmp(value, "files") == 0) {
+                options.table.storage = LODB_STORAGE_FILES;
+            } else if (strcmp(value, "segment") == 0) {
+                options.table.storage = LODB_STORAGE_SEGMENT_LOG;
+            } else if (strcmp(value, "ring") == 0) {
+                options.table.storage = LODB_STORAGE_RING;
+            } else {
+                return false;
+            }
+        } else if (strcmp(arg, "--layout") == 0) {
+            if (strcmp(value, "flat") == 0) {
+                options.table.layout = LODB_LAYOUT_FLAT;
+            } else if (strcmp(value, "shard16") == 0) {
+                options.table.layout = LODB_LAYOUT_SHARD_16;
+            } else if (strcmp(value, "shard256") == 0) {
+                options.table.layout = LODB_LAYOUT_SHARD_256;
+            } else {
+                return false;
+            }
+        } else if (strcmp(arg, "--cache-bytes") == 0) {
+            options.db.record_cache_bytes = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--compression") == 0) {
+            if (strcmp(value, "none") == 0) {
+                options.table.compression = LODB_COMPRESSION_NONE;
+            } else if (strcmp(value, "lz") == 0) {
+                options.table.compression = LODB_COMPRESSION_LZ;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char *storageName(const LoDbTableOptions &table)
+{
+    return table.storage == LODB_STORAGE_SEGMENT_LOG ? "segment" : table.storage == LODB_STORAGE_RING ? "ring" : "files";
+}
+
+static const char *layoutName(const LoDbTableOptions &table)
+{
+    switch (table.layout) {
+    case LODB_LAYOUT_SHARD_16:
+        return "shard16";
+    case LODB_LAYOUT_SHARD_256:
+        return "shard256";
+    default:
+        return "flat";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        fprintf(stderr,
+                "usage: %s [--sizes 100,1000,10000,100000] [--seed N] [--ops N] [--scan-ops N]\n"
+                "          [--storage files|segment|ring] [--layout flat|shard16|shard256] [--cache-bytes N]\n"
+                "          [--compression none|lz]\n",
+                argv[0]);
+        return 2;
+    }
+
+    // Per-operation INFO lines would dominate the measurements
+    setenv("LODB_LOG_LEVEL", "WARN", 0);
+    randomSeed((unsigned long)options.seed);
+
+    std::vector<BenchResult> results;
+    for (uint32_t rows : options.sizes) {
+        fprintf(stderr, "lodb_bench: %u rows\n", rows);
+        benchSize(options, rows, results);
+    }
+
+    printf("{\n");
+    printf("  \"benchmark\": \"lodb\",\n");
+    printf("  \"seed\": %llu,\n", (unsigned long long)options.seed);
+    printf("  \"ops\": %u,\n", options.ops);
+    printf("  \"scan_ops\": %u,\n", options.scan_ops);
+    printf("  \"storage\": \"%s\",\n", storageName(options.table));
+    printf("  \"layout\": \"%s\",\n", layoutName(options.table));
+    printf("  \"record_cache_bytes\": %zu,\n", options.db.record_cache_bytes);
+    printf("  \"compression\": \"%s\",\n", options.table.compression == LODB_COMPRESSION_LZ ? "lz" : "none");
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &result = results[i];
+        printf("    {\"rows\": %u, \"op\": \"%s\", \"samples\": %zu, \"ops_per_sec\": %.1f, \"p50_us\": %.2f, \"p99_us\": %.2f}%s\n",
+               result.rows, result.op, result.samples, result.ops_per_sec, result.p50_us, result.p99_us,
+               i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+    return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+/**
+ * Host stand-in for the Arduino core functions LoDB uses
+ */
+
+#include <cstdint>
+
+/**
+ * Pseudo-random number in [0, howbig)
+ */
+long random(long howbig);
+
+/**
+ * Pseudo-random number in [howsmall, howbig)
+ */
+long random(long howsmall, long howbig);
+
+/**
+ * Reseed random(), for reproducible runs
+ */
+void randomSeed(unsigned long seed);
+
+/**
+ * Milliseconds since the program started
+ */
+uint32_t millis();
+
+/**
+ * Microseconds since the program started
+ */
+uint32_t micros();
+
+/**
+ * Sleep for a number of milliseconds
+ */
+void delay(uint32_t ms);
@@ -0,0 +1,21 @@
+#pragma once
+
+/**
+ * Host stand-in for the firmware logging macros
+ *
+ * Messages go to stderr with the firmware's level prefixes, leaving stdout to the
+ * program. LODB_LOG_LEVEL selects the lowest level printed: DEBUG, INFO (default),
+ * WARN or ERROR.
+ */
+
+typedef enum { LODB_HOST_LOG_DEBUG = 0, LODB_HOST_LOG_INFO, LODB_HOST_LOG_WARN, LODB_HOST_LOG_ERROR } LoDbHostLogLevel;
+
+/**
+ * Print one log line if the level is enabled
+ */
+void lodb_host_log(LoDbHostLogLevel level, const char *format, ...);
+
+#define LOG_DEBUG(...) lodb_host_log(LODB_HOST_LOG_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) lodb_host_log(LODB_HOST_LOG_INFO, __VA_ARGS__)
+#define LOG_WARN(...) lodb_host_log(LODB_HOST_LOG_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) lodb_host_log(LODB_HOST_LOG_ERROR, __VA_ARGS__)
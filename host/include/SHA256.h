@@ -0,0 +1,33 @@
+#pragma once
+
+/**
+ * Host stand-in for the SHA256 class of the Arduino Crypto library
+ *
+ * Same interface and output as the firmware's, so UUIDs derived on the host match
+ * the ones a device derives from the same strings.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+class SHA256
+{
+  public:
+    SHA256();
+
+    size_t hashSize() const { return 32; }
+    size_t blockSize() const { return 64; }
+
+    void reset();
+    void update(const void *data, size_t len);
+    void finalize(void *hash, size_t len);
+    void clear();
+
+  private:
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t block_used;
+    uint64_t length; // Bytes hashed so far
+
+    void processBlock();
+};
@@ -0,0 +1,7 @@
+#pragma once
+
+/**
+ * Host stand-in for the firmware configuration header
+ */
+
+#include "DebugConfiguration.h"
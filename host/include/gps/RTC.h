@@ -0,0 +1,13 @@
+#pragma once
+
+/**
+ * Host stand-in for the firmware RTC
+ */
+
+#include <cstdint>
+
+/**
+ * Seconds since the Unix epoch from the system clock
+ * @param local Ignored, the host clock has no timezone offset applied
+ */
+uint32_t getTime(bool local = false);
@@ -0,0 +1,84 @@
+#pragma once
+
+/**
+ * Host stand-in for LoFS
+ *
+ * Implements the subset of LoFS and File that LoDB uses on top of POSIX files and
+ * directories. LoFS paths ("/internal/...", "/sd/...") are mapped below a host root
+ * directory, taken from LODB_HOST_ROOT (default "lodb_host" in the working directory).
+ * The SD card is reported available when {root}/sd exists.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#define FILE_O_READ "r"
+#define FILE_O_WRITE "w"
+
+/**
+ * Open file or directory handle
+ *
+ * Copies share the underlying handle, as with Arduino's fs::File.
+ */
+class File
+{
+  public:
+    File() {}
+
+    explicit operator bool() const { return handle != nullptr; }
+
+    size_t read(uint8_t *buffer, size_t size);
+    size_t write(const uint8_t *buffer, size_t size);
+    bool seek(uint32_t position);
+    size_t position() const;
+    size_t size() const;
+    void flush();
+    void close();
+
+    bool isDirectory() const;
+
+    /**
+     * Open the next entry of a directory (opened for reading)
+     * @return The entry, or a closed File after the last one
+     */
+    File openNextFile();
+
+    /**
+     * LoFS path the file was opened with
+     */
+    const char *name() const;
+
+  private:
+    friend class LoFS;
+    struct Handle;
+
+    std::shared_ptr<Handle> handle;
+};
+
+class LoFS
+{
+  public:
+    enum class FSType { INTERNAL, SD, AUTO };
+
+    /**
+     * Open a file or directory
+     * @param mode FILE_O_READ, FILE_O_WRITE (truncates), "a" (appends) or "r+" (updates in place)
+     */
+    static File open(const char *path, const char *mode = FILE_O_READ);
+
+    static bool exists(const char *path);
+
+    /**
+     * Create a directory and any missing parents
+     * @return false if it already existed or could not be created
+     */
+    static bool mkdir(const char *path);
+
+    static bool remove(const char *path);
+    static bool rename(const char *path_from, const char *path_to);
+    static bool rmdir(const char *path, bool recursive = false);
+
+    static bool isSDCardAvailable();
+};
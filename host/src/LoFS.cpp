@@ -0,0 +1,208 @@
+#include "lofs/src/LoFS.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct File::Handle {
+    std::string path; // LoFS path
+    std::string host_path;
+    FILE *file = nullptr;
+    DIR *dir = nullptr;
+
+    ~Handle()
+    {
+        if (file) {
+            fclose(file);
+        }
+        if (dir) {
+            closedir(dir);
+        }
+    }
+};
+
+// Map a LoFS path to a path below the host root
+static std::string hostPath(const char *path)
+{
+    const char *root = getenv("LODB_HOST_ROOT");
+    std::string host_path = root && root[0] ? root : "lodb_host";
+    if (path[0] != '/') {
+        host_path += '/';
+    }
+    return host_path + path;
+}
+
+static bool isHostDirectory(const std::string &host_path)
+{
+    struct stat info;
+    return stat(host_path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+static bool removeTree(const std::string &host_path)
+{
+    DIR *dir = opendir(host_path.c_str());
+    if (!dir) {
+        return false;
+    }
+    bool ok = true;
+    while (struct dirent *entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        std::string child = host_path + "/" + entry->d_name;
+        if (isHostDirectory(child)) {
+            ok = removeTree(child) && ok;
+        } else {
+            ok = unlink(child.c_str()) == 0 && ok;
+        }
+    }
+    closedir(dir);
+    return ::rmdir(host_path.c_str()) == 0 && ok;
+}
+
+size_t File::read(uint8_t *buffer, size_t size)
+{
+    return handle && handle->file ? fread(buffer, 1, size, handle->file) : 0;
+}
+
+size_t File::write(const uint8_t *buffer, size_t size)
+{
+    return handle && handle->file ? fwrite(buffer, 1, size, handle->file) : 0;
+}
+
+bool File::seek(uint32_t position)
+{
+    return handle && handle->file && fseek(handle->file, position, SEEK_SET) == 0;
+}
+
+size_t File::position() const
+{
+    if (!handle || !handle->file) {
+        return 0;
+    }
+    long position = ftell(handle->file);
+    return position < 0 ? 0 : (size_t)position;
+}
+
+size_t File::size() const
+{
+    if (!handle || !handle->file) {
+        return 0;
+    }
+    // Buffered writes count towards the size, as they do on the device
+    fflush(handle->file);
+    struct stat info;
+    return fstat(fileno(handle->file), &info) == 0 ? (size_t)info.st_size : 0;
+}
+
+void File::flush()
+{
+    if (handle && handle->file) {
+        fflush(handle->file);
+    }
+}
+
+void File::close()
+{
+    handle.reset();
+}
+
+bool File::isDirectory() const
+{
+    return handle && handle->dir;
+}
+
+File File::openNextFile()
+{
+    if (!handle || !handle->dir) {
+        return File();
+    }
+    while (struct dirent *entry = readdir(handle->dir)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        std::string child = handle->path + "/" + entry->d_name;
+        File file = LoFS::open(child.c_str(), FILE_O_READ);
+        if (file) {
+            return file;
+        }
+    }
+    return File();
+}
+
+const char *File::name() const
+{
+    return handle ? handle->path.c_str() : "";
+}
+
+File LoFS::open(const char *path, const char *mode)
+{
+    std::string host_path = hostPath(path);
+    File file;
+
+    if (isHostDirectory(host_path)) {
+        DIR *dir = opendir(host_path.c_str());
+        if (!dir) {
+            return file;
+        }
+        file.handle = std::make_shared<File::Handle>();
+        file.handle->dir = dir;
+    } else {
+        const char *host_mode = mode[0] == 'w'                    ? "w+b"
+                                : mode[0] == 'a'                  ? "a+b"
+                                : mode[0] == 'r' && mode[1] == '+' ? "r+b"
+                                                                   : "rb";
+        FILE *handle = fopen(host_path.c_str(), host_mode);
+        if (!handle) {
+            return file;
+        }
+        file.handle = std::make_shared<File::Handle>();
+        file.handle->file = handle;
+    }
+
+    file.handle->path = path;
+    file.handle->host_path = host_path;
+    return file;
+}
+
+bool LoFS::exists(const char *path)
+{
+    struct stat info;
+    return stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool LoFS::mkdir(const char *path)
+{
+    std::string host_path = hostPath(path);
+    for (size_t i = 1; i < host_path.size(); i++) {
+        if (host_path[i] == '/') {
+            host_path[i] = '\0';
+            ::mkdir(host_path.c_str(), 0755);
+            host_path[i] = '/';
+        }
+    }
+    return ::mkdir(host_path.c_str(), 0755) == 0;
+}
+
+bool LoFS::remove(const char *path)
+{
+    return unlink(hostPath(path).c_str()) == 0;
+}
+
+bool LoFS::rename(const char *path_from, const char *path_to)
+{
+    return ::rename(hostPath(path_from).c_str(), hostPath(path_to).c_str()) == 0;
+}
+
+bool LoFS::rmdir(const char *path, bool recursive)
+{
+    std::string host_path = hostPath(path);
+    return recursive ? removeTree(host_path) : ::rmdir(host_path.c_str()) == 0;
+}
+
+bool LoFS::isSDCardAvailable()
+{
+    return isHostDirectory(hostPath("/sd"));
+}
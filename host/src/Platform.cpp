@@ -0,0 +1,98 @@
+#include "Arduino.h"
+#include "DebugConfiguration.h"
+#include "gps/RTC.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <thread>
+
+static std::mt19937 &generator()
+{
+    static std::mt19937 instance(std::random_device{}());
+    return instance;
+}
+
+static std::chrono::steady_clock::time_point startTime()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return start;
+}
+
+long random(long howbig)
+{
+    return random(0, howbig);
+}
+
+long random(long howsmall, long howbig)
+{
+    if (howsmall >= howbig) {
+        return howsmall;
+    }
+    std::uniform_int_distribution<long> distribution(howsmall, howbig - 1);
+    return distribution(generator());
+}
+
+void randomSeed(unsigned long seed)
+{
+    generator().seed((std::mt19937::result_type)seed);
+}
+
+uint32_t millis()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime()).count();
+}
+
+uint32_t micros()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime()).count();
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+uint32_t getTime(bool local)
+{
+    return (uint32_t)time(nullptr);
+}
+
+static LoDbHostLogLevel minimumLogLevel()
+{
+    static const LoDbHostLogLevel minimum = [] {
+        const char *level = getenv("LODB_LOG_LEVEL");
+        if (!level) {
+            return LODB_HOST_LOG_INFO;
+        }
+        if (strcasecmp(level, "DEBUG") == 0) {
+            return LODB_HOST_LOG_DEBUG;
+        }
+        if (strcasecmp(level, "WARN") == 0) {
+            return LODB_HOST_LOG_WARN;
+        }
+        if (strcasecmp(level, "ERROR") == 0) {
+            return LODB_HOST_LOG_ERROR;
+        }
+        return LODB_HOST_LOG_INFO;
+    }();
+    return minimum;
+}
+
+void lodb_host_log(LoDbHostLogLevel level, const char *format, ...)
+{
+    static const char *const prefixes[] = {"DEBUG | ", "INFO  | ", "WARN  | ", "ERROR | "};
+    if (level < minimumLogLevel()) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    fputs(prefixes[level], stderr);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
@@ -0,0 +1,10 @@
+#include "diagnostics.h"
+
+/**
+ * Host entry point of the LoDB diagnostics suite
+ */
+int main()
+{
+    lodb_diagnostics();
+    return 0;
+}
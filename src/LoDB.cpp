@@ -1,14 +1,33 @@
 #include "LoDB.h"
+#include "LoDBBloom.h"
+#include "LoDBBytes.h"
+#include "LoDBCache.h"
+#include "LoDBCompress.h"
+#include "LoDBExpiry.h"
+#include "LoDBIndex.h"
+#include "LoDBRing.h"
+#include "LoDBSegmentLog.h"
+#include "LoDBWal.h"
 #include "lofs/src/LoFS.h"
 #include "configuration.h"
 #include "gps/RTC.h"
 #include <Arduino.h>
 #include <SHA256.h>
 #include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <pb_common.h>
 #include <pb_decode.h>
 #include <pb_encode.h>
 
+#if LODB_STATS
+#define LODB_STATS_NOW() micros()
+// The error histogram has a slot per LoDbError
+static_assert(LODB_ERR_BUSY < LODB_STATS_ERROR_CODES, "LODB_STATS_ERROR_CODES is too small");
+#else
+#define LODB_STATS_NOW() 0
+#endif
+
 /**
  * LoDB Implementation - Synchronous Design
  *
@@ -58,9 +77,351 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt)
     return uuid;
 }
 
+// Sortable UUID fields below the 32-bit timestamp: [sequence][salt byte][random]
+#define LODB_SORTABLE_SEQUENCE_BITS 12
+#define LODB_SORTABLE_RANDOM_BITS 12
+
+// Generate a time-ordered UUID
+lodb_uuid_t lodb_new_sortable_uuid(uint64_t salt)
+{
+    // Second and sequence of the last UUID, so UUIDs never go backwards
+    static uint32_t last_time = 0;
+    static uint32_t sequence = 0;
+
+    uint32_t now = getTime();
+    if (now > last_time) {
+        last_time = now;
+        sequence = 0;
+    } else if (++sequence >> LODB_SORTABLE_SEQUENCE_BITS) {
+        // Out of sequence numbers for this second, borrow the next one
+        last_time++;
+        sequence = 0;
+    }
+
+    uint32_t low = sequence << (8 + LODB_SORTABLE_RANDOM_BITS) | (uint32_t)(salt & 0xFF) << LODB_SORTABLE_RANDOM_BITS |
+                   (uint32_t)random(1 << LODB_SORTABLE_RANDOM_BITS);
+    return (lodb_uuid_t)last_time << 32 | low;
+}
+
+// Table metadata file: [4 bytes magic][4 bytes row count][4 bytes complement of the row count]
+#define LODB_META_MAGIC "LMT1"
+#define LODB_META_SIZE 12
+
+// Layout marker file: one byte holding the LoDbLayout the record files are in
+#define LODB_LAYOUT_MIXED 0xFF // A migration was interrupted, files may be in any layout
+
+// Records stream between nanopb and storage through a stack buffer of this many bytes
+#define LODB_STREAM_CHUNK_SIZE 128
+
+// Expired records a sweep collects from the expiry index at a time
+#define LODB_SWEEP_BATCH 16
+
+// State of a nanopb stream over a File
+struct LoDbFileStream {
+    File *file;
+    LoDbIoCounters *io;
+    size_t remaining; // Reading: record bytes not yet pulled from the file
+    size_t start;     // Reading: first unconsumed byte of chunk
+    size_t end;       // Bytes held in chunk
+    bool failed;      // The file returned fewer bytes than asked for
+    uint8_t chunk[LODB_STREAM_CHUNK_SIZE];
+};
+
+static bool fileStreamRead(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    LoDbFileStream *state = (LoDbFileStream *)stream->state;
+    while (count > 0) {
+        if (state->start == state->end) {
+            // Large fields (strings, bytes) bypass the chunk
+            if (count >= sizeof(state->chunk)) {
+                size_t got = lodb_read(*state->file, buf, count, state->io);
+                state->remaining -= got < state->remaining ? got : state->remaining;
+                state->failed = got != count;
+                return !state->failed;
+            }
+            size_t want = state->remaining < sizeof(state->chunk) ? state->remaining : sizeof(state->chunk);
+            state->start = 0;
+            state->end = lodb_read(*state->file, state->chunk, want, state->io);
+            state->remaining -= state->end;
+            if (state->end == 0) {
+                state->failed = true;
+                return false;
+            }
+        }
+
+        size_t n = state->end - state->start < count ? state->end - state->start : count;
+        memcpy(buf, state->chunk + state->start, n);
+        buf += n;
+        state->start += n;
+        count -= n;
+    }
+    return true;
+}
+
+// Decompress a stored record, with the table's codec or (once compression is turned off) a dictionary-less one
+static LoDbError expandRecord(const LoDbCodec *codec, const uint8_t *stored, size_t size, std::vector<uint8_t> &data_out)
+{
+    if (codec) {
+        return codec->decompress(stored, size, data_out);
+    }
+    LoDbCodec plain(nullptr, 0);
+    return plain.decompress(stored, size, data_out);
+}
+
+static bool flushFileStream(LoDbFileStream *state)
+{
+    if (state->end > 0) {
+        state->failed = lodb_write(*state->file, state->chunk, state->end, state->io) != state->end;
+        state->end = 0;
+    }
+    return !state->failed;
+}
+
+static bool fileStreamWrite(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    LoDbFileStream *state = (LoDbFileStream *)stream->state;
+    if (state->end + count > sizeof(state->chunk)) {
+        if (!flushFileStream(state)) {
+            return false;
+        }
+        if (count >= sizeof(state->chunk)) {
+            state->failed = lodb_write(*state->file, buf, count, state->io) != count;
+            return !state->failed;
+        }
+    }
+    memcpy(state->chunk + state->end, buf, count);
+    state->end += count;
+    return true;
+}
+
+// Final component of a path (File::name() returns the full path on some platforms)
+static const char *baseName(const char *path)
+{
+    const char *name = strrchr(path, '/');
+    return name ? name + 1 : path;
+}
+
+// Parse a shard directory name (one or two lowercase hex digits) into its width in digits
+static bool parseShardName(const char *path, uint8_t *width_out)
+{
+    const char *name = baseName(path);
+    size_t length = strlen(name);
+    if (length < 1 || length > 2) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f'))) {
+            return false;
+        }
+    }
+    *width_out = (uint8_t)length;
+    return true;
+}
+
+// Parse a "{16 hex digits}.pr" record file name (optionally preceded by a path) into a UUID,
+// or a file name with another extension, such as the ".tmp" of a replacement
+static bool parseRecordFileName(const char *path, lodb_uuid_t *uuid_out, const char *extension = ".pr")
+{
+    const char *name = baseName(path);
+
+    if (strlen(name) != 16 + strlen(extension) || strcmp(name + 16, extension) != 0) {
+        return false;
+    }
+
+    lodb_uuid_t uuid = 0;
+    for (int i = 0; i < 16; i++) {
+        char c = name[i];
+        uint8_t nibble;
+        if (c >= '0' && c <= '9') {
+            nibble = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            nibble = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            nibble = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        uuid = (uuid << 4) | nibble;
+    }
+
+    *uuid_out = uuid;
+    return true;
+}
+
+// Declared type of a fixed-width field; a field the table doesn't list may be float or double
+static LoDbFixedType fixedFieldType(const LoDbFixedField *fields, size_t count, pb_size_t field_tag)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (fields[i].tag == field_tag) {
+            return fields[i].type;
+        }
+    }
+    return LODB_FIXED_FLOAT;
+}
+
+// Locate a field that can back a secondary index: a static, non-repeated bool, enum or integer
+static bool findIndexField(const pb_msgdesc_t *descriptor, LoDbFixedType fixed_type, void *record, pb_size_t field_tag,
+                           pb_field_iter_t *iter)
+{
+    if (!pb_field_iter_begin(iter, descriptor, record) || !pb_field_iter_find(iter, field_tag)) {
+        return false;
+    }
+
+    if (PB_ATYPE(iter->type) != PB_ATYPE_STATIC || PB_HTYPE(iter->type) == PB_HTYPE_REPEATED ||
+        PB_HTYPE(iter->type) == PB_HTYPE_ONEOF) {
+        return false;
+    }
+
+    switch (PB_LTYPE(iter->type)) {
+    case PB_LTYPE_FIXED32:
+    case PB_LTYPE_FIXED64:
+        // Also float and double, which don't order like their bits
+        if (fixed_type == LODB_FIXED_FLOAT) {
+            return false;
+        }
+        return iter->data_size == 4 || iter->data_size == 8;
+    case PB_LTYPE_BOOL:
+    case PB_LTYPE_VARINT:
+    case PB_LTYPE_UVARINT:
+    case PB_LTYPE_SVARINT:
+        return iter->data_size == 1 || iter->data_size == 2 || iter->data_size == 4 || iter->data_size == 8;
+    default:
+        return false;
+    }
+}
+
+// Read an indexed field from a decoded record as an index key
+static bool readIndexKey(const pb_msgdesc_t *descriptor, LoDbFixedType fixed_type, const void *record, pb_size_t field_tag,
+                         int64_t *key_out)
+{
+    pb_field_iter_t iter;
+    if (!findIndexField(descriptor, fixed_type, (void *)record, field_tag, &iter)) {
+        return false;
+    }
+
+    bool is_fixed = PB_LTYPE(iter.type) == PB_LTYPE_FIXED32 || PB_LTYPE(iter.type) == PB_LTYPE_FIXED64;
+    bool is_signed = PB_LTYPE(iter.type) == PB_LTYPE_VARINT || PB_LTYPE(iter.type) == PB_LTYPE_SVARINT ||
+                     (is_fixed && fixed_type == LODB_FIXED_SIGNED);
+    switch (iter.data_size) {
+    case 1:
+        *key_out = is_signed ? (int64_t) * (const int8_t *)iter.pData : (int64_t) * (const uint8_t *)iter.pData;
+        break;
+    case 2:
+        *key_out = is_signed ? (int64_t) * (const int16_t *)iter.pData : (int64_t) * (const uint16_t *)iter.pData;
+        break;
+    case 4:
+        *key_out = is_signed ? (int64_t) * (const int32_t *)iter.pData : (int64_t) * (const uint32_t *)iter.pData;
+        break;
+    default:
+        *key_out = is_signed ? *(const int64_t *)iter.pData : (int64_t) * (const uint64_t *)iter.pData;
+        break;
+    }
+    return true;
+}
+
+// Collect the field tags of the indexes stored in an _idx directory ({tag}.idx, .ixj or .tmp), in ascending order
+static void listIndexTags(const char *index_dir, std::vector<pb_size_t> &tags_out, LoDbIoCounters *io)
+{
+    tags_out.clear();
+
+    File dir = lodb_open(index_dir, FILE_O_READ, io);
+    if (!dir) {
+        return; // No indexes yet
+    }
+
+    while (true) {
+        File file = lodb_open_next(dir, io);
+        if (!file) {
+            break; // No more files
+        }
+
+        const char *name = baseName(file.name());
+        bool is_directory = file.isDirectory();
+        char *end = nullptr;
+        unsigned long tag = strtoul(name, &end, 10);
+        bool is_index = !is_directory && end != name && tag > 0 && tag <= 0xFFFF &&
+                        (strcmp(end, ".idx") == 0 || strcmp(end, ".ixj") == 0 || strcmp(end, ".tmp") == 0);
+        file.close();
+
+        if (is_index) {
+            tags_out.push_back((pb_size_t)tag);
+        }
+    }
+    dir.close();
+
+    std::sort(tags_out.begin(), tags_out.end());
+    tags_out.erase(std::unique(tags_out.begin(), tags_out.end()), tags_out.end());
+}
+
+// Whether every field of a message, including those of its submessages, is stored inside the struct
+static bool hasOnlyStaticFields(const pb_msgdesc_t *descriptor, void *record)
+{
+    pb_field_iter_t iter;
+    if (!pb_field_iter_begin(&iter, descriptor, record)) {
+        return true; // No fields
+    }
+
+    do {
+        if (PB_ATYPE(iter.type) != PB_ATYPE_STATIC || PB_LTYPE(iter.type) == PB_LTYPE_SUBMSG_W_CB ||
+            PB_LTYPE(iter.type) == PB_LTYPE_EXTENSION) {
+            return false;
+        }
+        if (PB_LTYPE(iter.type) == PB_LTYPE_SUBMESSAGE && !hasOnlyStaticFields(iter.submsg_desc, iter.pData)) {
+            return false;
+        }
+    } while (pb_field_iter_next(&iter));
+    return true;
+}
+
+// Delete the files of a directory, except the layout marker that describes where records live.
+// Only .pr files count as records; _meta, _bloom and temp files go too. Subdirectories are
+// left alone, and shard directories among them are listed in shards_out when it is given.
+static void removeDirectoryFiles(const char *dir_path, int *deleted_out, int *failed_out, std::vector<std::string> *shards_out,
+                                 LoDbIoCounters *io)
+{
+    File dir = lodb_open(dir_path, FILE_O_READ, io);
+    if (!dir) {
+        return;
+    }
+
+    while (true) {
+        File file = lodb_open_next(dir, io);
+        if (!file) {
+            break; // No more files
+        }
+
+        // Build full file path (File::name() may or may not include the directory)
+        char file_path[192];
+        snprintf(file_path, sizeof(file_path), "%s/%s", dir_path, baseName(file.name()));
+        bool is_directory = file.isDirectory();
+        file.close();
+
+        uint8_t width;
+        if (is_directory) {
+            if (shards_out && parseShardName(file_path, &width)) {
+                shards_out->push_back(baseName(file_path));
+            }
+            continue;
+        }
+        if (strcmp(baseName(file_path), "_layout") == 0) {
+            continue;
+        }
+
+        lodb_uuid_t uuid;
+        if (LoFS::remove(file_path)) {
+            *deleted_out += parseRecordFileName(file_path, &uuid) ? 1 : 0;
+        } else {
+            LOG_WARN("Failed to delete file during truncate: %s", file_path);
+            (*failed_out)++;
+        }
+    }
+    dir.close();
+}
+
 // LoDb Class Implementation
 
-LoDb::LoDb(const char *db_name, LoFS::FSType filesystem) : db_name(db_name)
+LoDb::LoDb(const char *db_name, LoFS::FSType filesystem, const LoDbOptions &options)
+    : db_name(db_name), options(options), wal(nullptr), wal_checkpointed(0), record_cache(nullptr)
 {
     // Determine filesystem prefix
     if (filesystem == LoFS::FSType::SD) {
@@ -99,24 +460,92 @@ LoDb::LoDb(const char *db_name, LoFS::FSType filesystem) : db_name(db_name)
         LOG_DEBUG("Database directory may already exist or created: %s", db_path);
     }
 
+    // Replay writes that were logged but not yet applied before the last shutdown
+    if (options.write_ahead_log) {
+        wal = new LoDbWal(db_path, options.wal_group_commit_bytes, options.wal_group_commit_ms);
+#if LODB_STATS
+        wal->setIoCounters(&wal_io);
+#endif
+        if (wal->open() != LODB_OK) {
+            LOG_ERROR("Failed to recover write-ahead log for %s", db_path);
+        }
+        wal_checkpointed = wal->size();
+    }
+
+    if (options.record_cache_bytes > 0) {
+        record_cache = new LoDbRecordCache(options.record_cache_bytes);
+    }
+
     LOG_INFO("Initialized LoDB database: %s", db_path);
 }
 
 LoDb::~LoDb()
 {
-    // Nothing to clean up for now
+    if (wal) {
+        checkpoint();
+        delete wal;
+    }
+    for (auto &entry : tables) {
+        releaseTable(&entry.second);
+    }
+    delete record_cache;
 }
 
-LoDbError LoDb::registerTable(const char *table_name, const pb_msgdesc_t *pb_descriptor, size_t record_size)
+LoDbError LoDb::registerTable(const char *table_name, const pb_msgdesc_t *pb_descriptor, size_t record_size,
+                              const LoDbTableOptions &options)
 {
     if (!table_name || !pb_descriptor || record_size == 0) {
         return LODB_ERR_INVALID;
     }
 
+    if (options.storage == LODB_STORAGE_SEGMENT_LOG && options.segment_size == 0) {
+        return LODB_ERR_INVALID;
+    }
+    if (options.fixed_field_count > 0 && !options.fixed_fields) {
+        return LODB_ERR_INVALID;
+    }
+
+    // Expiry is tracked through an index on the TTL field, so it must be indexable
+    if (options.ttl_seconds > 0 && options.ttl_field == 0) {
+        LOG_ERROR("Table %s sets ttl_seconds without a ttl_field to count them from", table_name);
+        return LODB_ERR_INVALID;
+    }
+    if (options.ttl_field != 0) {
+        LoDbFixedType fixed_type = fixedFieldType(options.fixed_fields, options.fixed_field_count, options.ttl_field);
+        uint8_t *probe = new uint8_t[record_size]();
+        pb_field_iter_t iter;
+        bool indexable = findIndexField(pb_descriptor, fixed_type, probe, options.ttl_field, &iter);
+        delete[] probe;
+        if (!indexable) {
+            LOG_ERROR("TTL field %d of table %s is not an integer field (or an undeclared fixed-width one)", options.ttl_field,
+                      table_name);
+            return LODB_ERR_INVALID;
+        }
+    }
+
     TableMetadata metadata;
     metadata.table_name = table_name;
     metadata.pb_descriptor = pb_descriptor;
     metadata.record_size = record_size;
+    metadata.options = options;
+    metadata.segment_log = nullptr;
+    metadata.ring = nullptr;
+    metadata.keys_loaded = false;
+    metadata.row_count = 0;
+    metadata.row_count_known = false;
+    metadata.row_count_saved = false;
+    metadata.bloom = nullptr;
+    metadata.bloom_ready = false;
+    memset(metadata.shards_made, 0, sizeof(metadata.shards_made));
+    metadata.codec = nullptr;
+    metadata.expiry = nullptr;
+    metadata.fixed_fields.assign(options.fixed_fields, options.fixed_fields + options.fixed_field_count);
+
+    // The record cache keeps copies of decoded structs, which must not point outside themselves
+    uint8_t *probe = new uint8_t[record_size]();
+    metadata.cacheable = hasOnlyStaticFields(pb_descriptor, probe);
+    delete[] probe;
+    metadata.rename_replaces = -1;
 
     // Build table path: {prefix}/lodb/{db_name}/{table_name}/
     snprintf(metadata.table_path, sizeof(metadata.table_path), "%s/%s", db_path, table_name);
@@ -126,528 +555,3378 @@ LoDbError LoDb::registerTable(const char *table_name, const pb_msgdesc_t *pb_des
         LOG_DEBUG("Table directory may already exist or created: %s", metadata.table_path);
     }
 
+    // Segment log tables replay their segments to rebuild the UUID map
+    if (options.storage == LODB_STORAGE_SEGMENT_LOG) {
+        metadata.segment_log = new LoDbSegmentLog(metadata.table_path, options.segment_size);
+        LoDbError err = metadata.segment_log->open();
+        if (err != LODB_OK) {
+            LOG_ERROR("Failed to open segment log: %s", metadata.table_path);
+            delete metadata.segment_log;
+            return err;
+        }
+    }
+
+    // Ring tables load their slot headers; the slot count is the tighter of the two capacities
+    if (options.storage == LODB_STORAGE_RING) {
+        // Encodings can outgrow their struct (a negative int32 is a 10-byte varint), so no default is safe
+        if (options.ring_slot_size == 0) {
+            LOG_ERROR("Ring table %s needs a ring_slot_size, e.g. the message's generated _size constant", table_name);
+            return LODB_ERR_INVALID;
+        }
+        uint32_t slot_size = options.ring_slot_size;
+        size_t slot_count = options.ring_capacity;
+        if (options.ring_capacity_bytes > 0) {
+            size_t by_bytes = options.ring_capacity_bytes / (slot_size + LODB_RING_SLOT_OVERHEAD);
+            slot_count = slot_count ? std::min(slot_count, by_bytes) : by_bytes;
+        }
+        if (slot_count == 0 || slot_count * (slot_size + LODB_RING_SLOT_OVERHEAD) > LODB_RING_FILE_MAX) {
+            LOG_ERROR("Invalid ring capacity for %s: %d slots of %d bytes", table_name, slot_count, slot_size);
+            return LODB_ERR_INVALID;
+        }
+
+        metadata.ring = new LoDbRing(metadata.table_path, (uint32_t)slot_count, slot_size);
+        LoDbError err = metadata.ring->open();
+        if (err != LODB_OK) {
+            LOG_ERROR("Failed to open ring: %s", metadata.table_path);
+            delete metadata.ring;
+            return err;
+        }
+    }
+
+    // Re-registering replaces the previous metadata and its engine state, but keeps the stats
+    auto existing = tables.find(table_name);
+    if (existing != tables.end()) {
+#if LODB_STATS
+        metadata.stats = existing->second.stats;
+#endif
+        releaseTable(&existing->second);
+    }
+
     tables[table_name] = metadata;
+    TableMetadata *table = &tables[table_name];
+    if (options.compression == LODB_COMPRESSION_LZ) {
+        table->codec = new LoDbCodec(options.compression_dictionary, options.compression_dictionary_size);
+    }
+    // The caller's dictionary and field type buffers aren't needed past registration
+    table->options.compression_dictionary = nullptr;
+    table->options.fixed_fields = nullptr;
+    if (table->segment_log) {
+        table->segment_log->setIoCounters(tableIo(table));
+    } else if (table->ring) {
+        table->ring->setIoCounters(tableIo(table));
+    } else {
+        if (migrateLayout(table) != LODB_OK) {
+            LOG_WARN("Some records of %s are still in another layout", table_name);
+        }
+        if (options.update_mode == LODB_UPDATE_RENAME) {
+            recoverReplacements(table);
+        }
+        loadRowCount(table);
+
+        // Segment logs already know their UUIDs, so only files tables get a Bloom filter
+        if (options.bloom_capacity > 0) {
+            table->bloom = new LoDbBloom(table->table_path, options.bloom_capacity, options.bloom_false_positive_rate);
+            table->bloom->setIoCounters(tableIo(table));
+            table->bloom_ready = table->bloom->load();
+        } else {
+            // A filter saved by an earlier registration would miss records inserted without it
+            char bloom_path[192];
+            snprintf(bloom_path, sizeof(bloom_path), "%s/_bloom", table->table_path);
+            LoFS::remove(bloom_path);
+        }
+    }
+
+    // Indexes created by earlier registrations are reopened before anything can modify the table
+    char index_dir[192];
+    std::vector<pb_size_t> index_tags;
+    snprintf(index_dir, sizeof(index_dir), "%s/_idx", table->table_path);
+    listIndexTags(index_dir, index_tags, tableIo(table));
+    for (pb_size_t tag : index_tags) {
+        if (createIndex(table_name, tag) != LODB_OK) {
+            LOG_WARN("Failed to reopen index on field %d of table %s", tag, table_name);
+        }
+    }
+
+    // The TTL field's index orders records by expiry; it is opened, or built on first registration
+    if (options.ttl_field != 0) {
+        LoDbError err = createIndex(table_name, options.ttl_field);
+        if (err != LODB_OK) {
+            // A TTL table without its expiry tracker would never expire anything, so it isn't registered
+            LOG_ERROR("Failed to open expiry index of table %s", table_name);
+            releaseTable(table);
+            tables.erase(table_name);
+            return err;
+        }
+        table->expiry = new LoDbExpiry(getIndex(table, options.ttl_field), options.ttl_seconds);
+    }
     LOG_INFO("Registered table: %s at %s", table_name, metadata.table_path);
     return LODB_OK;
 }
 
-LoDb::TableMetadata *LoDb::getTable(const char *table_name)
+void LoDb::releaseTable(TableMetadata *table)
 {
-    auto it = tables.find(table_name);
-    if (it == tables.end()) {
-        LOG_ERROR("Table not registered: %s", table_name);
-        return nullptr;
+    saveRowCount(table);
+    if (table->bloom && table->bloom_ready) {
+        table->bloom->save();
     }
-    return &it->second;
+    delete table->bloom;
+    table->bloom = nullptr;
+    table->bloom_ready = false;
+    if (record_cache) {
+        record_cache->eraseTable(table);
+    }
+    delete table->segment_log;
+    table->segment_log = nullptr;
+    delete table->ring;
+    table->ring = nullptr;
+    delete table->expiry;
+    table->expiry = nullptr;
+    delete table->codec;
+    table->codec = nullptr;
+    for (auto &entry : table->indexes) {
+        delete entry.second;
+    }
+    table->indexes.clear();
+    std::vector<lodb_uuid_t>().swap(table->keys);
+    table->keys_loaded = false;
 }
 
-// Insert a record with a UUID
-LoDbError LoDb::insert(const char *table_name, lodb_uuid_t uuid, const void *record)
+bool LoDb::lookupKey(TableMetadata *table, lodb_uuid_t uuid, bool *exists_out)
 {
-    if (!table_name || !record) {
-        return LODB_ERR_INVALID;
+    // Logged writes are newer than anything in table storage
+    if (wal) {
+        const LoDbWal::Entry *logged = wal->find(table->table_name, uuid);
+        if (logged) {
+            *exists_out = !logged->deleted;
+            return true;
+        }
     }
 
-    TableMetadata *table = getTable(table_name);
-    if (!table) {
-        return LODB_ERR_INVALID;
+    if (table->segment_log) {
+        *exists_out = table->segment_log->contains(uuid);
+        return true;
+    }
+    if (table->ring) {
+        *exists_out = table->ring->contains(uuid);
+        return true;
     }
 
-    // Convert UUID to hex for filename
-    char uuid_hex[17];
-    lodb_uuid_to_hex(uuid, uuid_hex);
+    // The Bloom filter rules out UUIDs that were never stored (built lazily on first use)
+    if (table->bloom && (table->bloom_ready || buildBloom(table)) && !table->bloom->mightContain(uuid)) {
+        *exists_out = false;
+        return true;
+    }
 
-    // Build file path
-    char file_path[192];
-    snprintf(file_path, sizeof(file_path), "%s/%s.pr", table->table_path, uuid_hex);
+    if (!table->options.key_directory) {
+        return false;
+    }
 
-    // Check if file already exists
-    auto existing = LoFS::open(file_path, FILE_O_READ);
-    if (existing) {
-        existing.close();
-        LOG_ERROR("UUID already exists: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
-        return LODB_ERR_INVALID;
+    // Built lazily on first use
+    if (!table->keys_loaded && loadKeyDirectory(table) != LODB_OK) {
+        return false;
     }
 
-    // Encode to buffer
-    uint8_t buffer[2048];
-    pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+    *exists_out = std::binary_search(table->keys.begin(), table->keys.end(), uuid);
+    return true;
+}
 
-    if (!pb_encode(&stream, table->pb_descriptor, record)) {
-        LOG_ERROR("Failed to encode protobuf for insert");
-        return LODB_ERR_ENCODE;
+LoDbError LoDb::loadKeyDirectory(TableMetadata *table)
+{
+    LoDbError err = listRecordKeys(table, table->keys);
+    if (err != LODB_OK) {
+        return err;
     }
 
-    size_t encoded_size = stream.bytes_written;
-    LOG_DEBUG("Encoded record: %d bytes", encoded_size);
+    table->keys_loaded = true;
+    LOG_DEBUG("Loaded key directory for %s: %d keys", table->table_name.c_str(), table->keys.size());
+    return LODB_OK;
+}
 
-    // Write to file
-    auto file = LoFS::open(file_path, FILE_O_WRITE);
-    if (!file) {
-        LOG_ERROR("Failed to open file for writing: %s", file_path);
-        return LODB_ERR_IO;
-    }
+LoDbError LoDb::listRecordKeys(TableMetadata *table, std::vector<lodb_uuid_t> &keys_out)
+{
+    keys_out.clear();
 
-    size_t written = file.write(buffer, encoded_size);
-    if (written != encoded_size) {
-        LOG_ERROR("Failed to write file, wrote %d of %d bytes", written, encoded_size);
-        file.close();
+    LoDbRecordWalk walk;
+    if (walk.open(table->table_path, table->options.layout, tableIo(table)) != LODB_OK) {
+        LOG_ERROR("Table path is not a directory: %s", table->table_path);
         return LODB_ERR_IO;
     }
 
-    file.flush();
-    file.close();
-    LOG_DEBUG("Wrote record to: %s (%d bytes)", file_path, encoded_size);
+    lodb_uuid_t uuid;
+    while (walk.next(nullptr, &uuid)) {
+        keys_out.push_back(uuid);
+    }
 
-    LOG_INFO("Inserted record with custom UUID: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+    std::sort(keys_out.begin(), keys_out.end());
     return LODB_OK;
 }
 
-// Get a record by UUID
-LoDbError LoDb::get(const char *table_name, lodb_uuid_t uuid, void *record_out)
+LoDbError LoDb::sortedKeys(TableMetadata *table, std::vector<lodb_uuid_t> &keys_out)
 {
-    if (!table_name || !record_out) {
-        return LODB_ERR_INVALID;
+    if (table->segment_log) {
+        table->segment_log->keys(keys_out);
+        return LODB_OK;
     }
-
-    TableMetadata *table = getTable(table_name);
-    if (!table) {
-        return LODB_ERR_INVALID;
+    if (table->ring) {
+        table->ring->keys(keys_out);
+        return LODB_OK;
     }
+    if (table->options.key_directory) {
+        if (!table->keys_loaded) {
+            LoDbError err = loadKeyDirectory(table);
+            if (err != LODB_OK) {
+                return err;
+            }
+        }
+        keys_out = table->keys;
+        return LODB_OK;
+    }
+    return listRecordKeys(table, keys_out);
+}
 
-    // Convert UUID to hex for filename
-    char uuid_hex[17];
-    lodb_uuid_to_hex(uuid, uuid_hex);
-
-    // Build file path
-    char file_path[192];
-    snprintf(file_path, sizeof(file_path), "%s/%s.pr", table->table_path, uuid_hex);
-    LOG_DEBUG("file_path: %s", file_path);
+void LoDb::loadRowCount(TableMetadata *table)
+{
+    char meta_path[192];
+    snprintf(meta_path, sizeof(meta_path), "%s/_meta", table->table_path);
 
-    // Read file into buffer
-    uint8_t buffer[2048];
-    size_t file_size = 0;
+    table->row_count_known = false;
+    table->row_count_saved = false;
 
-    auto file = LoFS::open(file_path, FILE_O_READ);
+    auto file = lodb_open(meta_path, FILE_O_READ, tableIo(table));
     if (!file) {
-        LOG_DEBUG("Record not found: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
-        return LODB_ERR_NOT_FOUND;
+        return;
     }
 
-    file_size = file.read(buffer, sizeof(buffer));
+    uint8_t buffer[LODB_META_SIZE];
+    bool valid = lodb_read(file, buffer, sizeof(buffer), tableIo(table)) == sizeof(buffer) && file.size() == sizeof(buffer) &&
+                 memcmp(buffer, LODB_META_MAGIC, 4) == 0 && lodb_get_le32(buffer + 8) == ~lodb_get_le32(buffer + 4);
     file.close();
 
-    if (file_size == 0) {
-        LOG_ERROR("Record file is empty: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
-        return LODB_ERR_IO;
+    if (!valid) {
+        LOG_WARN("Ignoring invalid table metadata: %s", meta_path);
+        return;
     }
 
-    LOG_DEBUG("Read record file: %s (%d bytes)", file_path, file_size);
+    table->row_count = lodb_get_le32(buffer + 4);
+    table->row_count_known = true;
+    table->row_count_saved = true;
+    LOG_DEBUG("Loaded row count for %s: %d", table->table_name.c_str(), table->row_count);
+}
 
-    // Decode from buffer
-    pb_istream_t stream = pb_istream_from_buffer(buffer, file_size);
-    memset(record_out, 0, table->record_size);
+void LoDb::saveRowCount(TableMetadata *table)
+{
+    if (!table->row_count_known || table->row_count_saved) {
+        return;
+    }
 
-    if (!pb_decode(&stream, table->pb_descriptor, record_out)) {
-        LOG_ERROR("Failed to decode protobuf from " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
-        return LODB_ERR_DECODE;
+    char meta_path[192];
+    snprintf(meta_path, sizeof(meta_path), "%s/_meta", table->table_path);
+
+    // Magic, count, and the count's complement so a torn write is caught at load
+    uint8_t buffer[LODB_META_SIZE];
+    memcpy(buffer, LODB_META_MAGIC, 4);
+    lodb_put_le32(buffer + 4, table->row_count);
+    lodb_put_le32(buffer + 8, ~table->row_count);
+
+    LoFS::remove(meta_path);
+    auto file = lodb_open(meta_path, FILE_O_WRITE, tableIo(table));
+    if (!file) {
+        LOG_WARN("Failed to save table metadata: %s", meta_path);
+        return;
     }
+    size_t written = lodb_write(file, buffer, sizeof(buffer), tableIo(table));
+    file.close();
 
-    LOG_DEBUG("Retrieved record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
-    return LODB_OK;
+    table->row_count_saved = written == sizeof(buffer);
 }
 
-// Update a single record by UUID
-LoDbError LoDb::update(const char *table_name, lodb_uuid_t uuid, const void *record)
+void LoDb::invalidateRowCount(TableMetadata *table)
 {
-    if (!table_name || !record) {
-        return LODB_ERR_INVALID;
+    if (!table->row_count_saved) {
+        return;
     }
 
-    TableMetadata *table = getTable(table_name);
-    if (!table) {
-        return LODB_ERR_INVALID;
+    char meta_path[192];
+    snprintf(meta_path, sizeof(meta_path), "%s/_meta", table->table_path);
+    if (!LoFS::remove(meta_path) && LoFS::exists(meta_path)) {
+        LOG_WARN("Failed to invalidate table metadata, recounting on next use: %s", meta_path);
+        table->row_count_known = false; // Never trust a count that could be stale after a restart
     }
+    table->row_count_saved = false;
+}
 
-    // Convert UUID to hex for filename
-    char uuid_hex[17];
-    lodb_uuid_to_hex(uuid, uuid_hex);
-
-    // Build file path
-    char file_path[192];
-    snprintf(file_path, sizeof(file_path), "%s/%s.pr", table->table_path, uuid_hex);
+void LoDb::adjustRowCount(TableMetadata *table, int delta)
+{
+    if (table->row_count_known) {
+        table->row_count += delta;
+    }
+}
 
-    // Check if record exists first
-    auto file = LoFS::open(file_path, FILE_O_READ);
-    if (!file) {
-        LOG_DEBUG("Record not found for update: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
-        return LODB_ERR_NOT_FOUND;
+bool LoDb::buildBloom(TableMetadata *table)
+{
+    std::vector<lodb_uuid_t> listed_keys;
+    const std::vector<lodb_uuid_t> *keys = &table->keys;
+    if (!table->keys_loaded) {
+        if (listRecordKeys(table, listed_keys) != LODB_OK) {
+            return false;
+        }
+        keys = &listed_keys;
     }
-    file.close();
 
-    // Encode to buffer
-    uint8_t buffer[2048];
-    pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+    table->bloom->clear();
+    for (lodb_uuid_t uuid : *keys) {
+        table->bloom->add(uuid);
+    }
+    table->bloom_ready = true;
 
-    if (!pb_encode(&stream, table->pb_descriptor, record)) {
-        LOG_ERROR("Failed to encode updated record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
-        return LODB_ERR_ENCODE;
+    // The scan counted the rows as well
+    if (!table->row_count_known) {
+        table->row_count = (uint32_t)keys->size();
+        table->row_count_known = true;
     }
 
-    size_t encoded_size = stream.bytes_written;
+    LOG_DEBUG("Built Bloom filter for %s: %d keys, %d bits", table->table_name.c_str(), keys->size(),
+              table->bloom->bitCount());
+    return true;
+}
 
-    // Write to file
-    LoFS::remove(file_path); // Remove old file
-    file = LoFS::open(file_path, FILE_O_WRITE);
-    if (!file) {
-        LOG_ERROR("Failed to open file for update: %s", file_path);
-        return LODB_ERR_IO;
+void LoDb::invalidateBloom(TableMetadata *table)
+{
+    if (table->bloom && table->bloom_ready && !table->bloom->invalidate()) {
+        table->bloom_ready = false; // Stop trusting it, the next lookup rebuilds and rewrites it
     }
+}
 
-    size_t written = file.write(buffer, encoded_size);
-    if (written != encoded_size) {
-        LOG_ERROR("Failed to write updated file");
-        file.close();
-        return LODB_ERR_IO;
+void LoDb::addKey(TableMetadata *table, lodb_uuid_t uuid)
+{
+    if (table->bloom && table->bloom_ready) {
+        table->bloom->add(uuid);
     }
 
-    file.flush();
-    file.close();
+    if (!table->keys_loaded) {
+        return;
+    }
 
-    LOG_INFO("Updated record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
-    return LODB_OK;
+    auto it = std::lower_bound(table->keys.begin(), table->keys.end(), uuid);
+    if (it == table->keys.end() || *it != uuid) {
+        table->keys.insert(it, uuid);
+    }
 }
 
-// Delete a single record by UUID
-LoDbError LoDb::deleteRecord(const char *table_name, lodb_uuid_t uuid)
+void LoDb::removeKey(TableMetadata *table, lodb_uuid_t uuid)
 {
-    if (!table_name) {
-        return LODB_ERR_INVALID;
+    if (!table->keys_loaded) {
+        return;
     }
 
-    TableMetadata *table = getTable(table_name);
-    if (!table) {
-        return LODB_ERR_INVALID;
+    auto it = std::lower_bound(table->keys.begin(), table->keys.end(), uuid);
+    if (it != table->keys.end() && *it == uuid) {
+        table->keys.erase(it);
     }
+}
 
-    // Convert UUID to hex for filename
+void LoDb::recordPath(TableMetadata *table, lodb_uuid_t uuid, char *path_out, size_t size)
+{
     char uuid_hex[17];
     lodb_uuid_to_hex(uuid, uuid_hex);
 
-    char file_path[192];
-    snprintf(file_path, sizeof(file_path), "%s/%s.pr", table->table_path, uuid_hex);
-
-    if (LoFS::remove(file_path)) {
-        LOG_DEBUG("Deleted record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
-        return LODB_OK;
+    int shard_width = table->options.layout;
+    if (shard_width == LODB_LAYOUT_FLAT) {
+        snprintf(path_out, size, "%s/%s.pr", table->table_path, uuid_hex);
     } else {
-        LOG_WARN("Failed to delete record (may not exist): " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
-        return LODB_ERR_NOT_FOUND;
+        snprintf(path_out, size, "%s/%.*s/%s.pr", table->table_path, shard_width, uuid_hex, uuid_hex);
     }
 }
 
-// Select records with optional filtering, sorting, and limiting
-std::vector<void *> LoDb::select(const char *table_name, LoDbFilter filter, LoDbComparator comparator, size_t limit)
+void LoDb::ensureShard(TableMetadata *table, lodb_uuid_t uuid)
 {
-    std::vector<void *> results;
-
-    if (!table_name) {
-        LOG_ERROR("Invalid table_name");
-        return results;
+    int shard_width = table->options.layout;
+    if (shard_width == LODB_LAYOUT_FLAT) {
+        return;
     }
 
-    TableMetadata *table = getTable(table_name);
-    if (!table) {
-        LOG_ERROR("Table not found: %s", table_name);
-        return results;
+    uint32_t shard = (uint32_t)(uuid >> (64 - 4 * shard_width));
+    if (table->shards_made[shard / 32] & (1u << (shard % 32))) {
+        return;
     }
 
-    // PHASE 1: FILTER - iterate directory and collect matching records
-    File dir = LoFS::open(table->table_path, FILE_O_READ);
-    if (!dir) {
-        LOG_DEBUG("Table directory not found: %s", table->table_path);
-        return results; // Empty result set
+    char uuid_hex[17];
+    lodb_uuid_to_hex(uuid, uuid_hex);
+    char shard_path[192];
+    snprintf(shard_path, sizeof(shard_path), "%s/%.*s", table->table_path, shard_width, uuid_hex);
+    LoFS::mkdir(shard_path); // Fails harmlessly when the shard already exists
+    table->shards_made[shard / 32] |= 1u << (shard % 32);
+}
+
+LoDbError LoDb::migrateLayout(TableMetadata *table)
+{
+    char marker_path[192];
+    snprintf(marker_path, sizeof(marker_path), "%s/_layout", table->table_path);
+
+    // A missing marker means the flat layout every table had before sharding existed
+    uint8_t current = LODB_LAYOUT_FLAT;
+    auto marker = lodb_open(marker_path, FILE_O_READ, tableIo(table));
+    if (marker) {
+        if (marker.size() != 1 || lodb_read(marker, &current, 1, tableIo(table)) != 1) {
+            current = LODB_LAYOUT_MIXED;
+        }
+        marker.close();
     }
 
-    if (!dir.isDirectory()) {
-        LOG_ERROR("Table path is not a directory: %s", table->table_path);
-        dir.close();
-        return results;
+    uint8_t target = table->options.layout;
+    if (current == target) {
+        return LODB_OK;
     }
 
-    // Iterate through all files in directory
-    while (true) {
-        File file = dir.openNextFile();
-        if (!file) {
-            break; // No more files
+    // Record files in the table directory and in shard directories of another width are out of place
+    std::vector<lodb_uuid_t> flat_keys;
+    std::vector<std::string> other_shards;
+    File dir = lodb_open(table->table_path, FILE_O_READ, tableIo(table));
+    if (dir) {
+        while (true) {
+            File file = lodb_open_next(dir, tableIo(table));
+            if (!file) {
+                break;
+            }
+            lodb_uuid_t uuid;
+            uint8_t width;
+            if (!file.isDirectory() && parseRecordFileName(file.name(), &uuid)) {
+                if (target != LODB_LAYOUT_FLAT) {
+                    flat_keys.push_back(uuid);
+                }
+            } else if (file.isDirectory() && parseShardName(file.name(), &width) && width != target) {
+                other_shards.push_back(baseName(file.name()));
+            }
+            file.close();
         }
+        dir.close();
+    }
 
-        // Skip directories
-        if (file.isDirectory()) {
+    // Files move one rename at a time, so any registration after an interruption must look everywhere
+    if (!flat_keys.empty() || !other_shards.empty()) {
+        LoFS::remove(marker_path);
+        auto file = lodb_open(marker_path, FILE_O_WRITE, tableIo(table));
+        uint8_t mixed = LODB_LAYOUT_MIXED;
+        bool marked = file && lodb_write(file, &mixed, 1, tableIo(table)) == 1;
+        if (file) {
             file.close();
-            continue;
         }
-
-        // Get filename
-        std::string pathStr = file.name();
-        file.close();
-
-        // Extract just the filename (after last /)
-        size_t lastSlash = pathStr.rfind('/');
-        std::string filename = (lastSlash != std::string::npos) ? pathStr.substr(lastSlash + 1) : pathStr;
-
-        // Extract UUID (remove .pr extension)
-        size_t prPos = filename.find(".pr");
-        if (prPos == std::string::npos) {
-            LOG_DEBUG("Skipped non-.pr file: %s", filename.c_str());
-            continue;
+        if (!marked) {
+            LOG_ERROR("Failed to mark layout migration of %s", table->table_path);
+            return LODB_ERR_IO;
         }
+    }
 
-        std::string uuid_hex_str = filename.substr(0, prPos);
-
-        // Parse hex string to uint64_t UUID
-        lodb_uuid_t uuid;
-        uint32_t high, low;
-        if (sscanf(uuid_hex_str.c_str(), "%08x%08x", &high, &low) != 2) {
-            LOG_WARN("Failed to parse UUID from filename: %s", uuid_hex_str.c_str());
-            continue;
+    size_t moved = 0;
+    size_t failed = 0;
+    char from_path[192];
+    char to_path[192];
+    for (lodb_uuid_t uuid : flat_keys) {
+        char uuid_hex[17];
+        lodb_uuid_to_hex(uuid, uuid_hex);
+        snprintf(from_path, sizeof(from_path), "%s/%s.pr", table->table_path, uuid_hex);
+        recordPath(table, uuid, to_path, sizeof(to_path));
+        ensureShard(table, uuid);
+        if (LoFS::rename(from_path, to_path)) {
+            moved++;
+        } else {
+            failed++;
         }
-        uuid = ((uint64_t)high << 32) | (uint64_t)low;
+    }
 
-        // Allocate buffer for record
-        uint8_t *record_buffer = new uint8_t[table->record_size];
-        if (!record_buffer) {
-            LOG_ERROR("Failed to allocate record buffer");
-            continue;
+    for (const std::string &name : other_shards) {
+        char shard_path[192];
+        snprintf(shard_path, sizeof(shard_path), "%s/%s", table->table_path, name.c_str());
+
+        std::vector<lodb_uuid_t> shard_keys;
+        File shard = lodb_open(shard_path, FILE_O_READ, tableIo(table));
+        if (shard) {
+            while (true) {
+                File file = lodb_open_next(shard, tableIo(table));
+                if (!file) {
+                    break;
+                }
+                lodb_uuid_t uuid;
+                if (!file.isDirectory() && parseRecordFileName(file.name(), &uuid)) {
+                    shard_keys.push_back(uuid);
+                }
+                file.close();
+            }
+            shard.close();
         }
 
-        // Read and decode the record
-        memset(record_buffer, 0, table->record_size);
-        LoDbError err = get(table_name, uuid, record_buffer);
-
-        if (err != LODB_OK) {
-            LOG_WARN("Failed to read record " LODB_UUID_FMT " during select", LODB_UUID_ARGS(uuid));
-            delete[] record_buffer;
-            continue;
+        size_t shard_failed = 0;
+        for (lodb_uuid_t uuid : shard_keys) {
+            char uuid_hex[17];
+            lodb_uuid_to_hex(uuid, uuid_hex);
+            snprintf(from_path, sizeof(from_path), "%s/%s.pr", shard_path, uuid_hex);
+            recordPath(table, uuid, to_path, sizeof(to_path));
+            ensureShard(table, uuid);
+            if (LoFS::rename(from_path, to_path)) {
+                moved++;
+            } else {
+                shard_failed++;
+            }
         }
+        failed += shard_failed;
 
-        // Apply filter if provided
-        if (filter && !filter(record_buffer)) {
-            LOG_DEBUG("Record " LODB_UUID_FMT " filtered out", LODB_UUID_ARGS(uuid));
-            delete[] record_buffer;
-            continue;
+        // Leftover temp files of interrupted updates go with the old shard
+        if (shard_failed == 0 && !LoFS::rmdir(shard_path, true)) {
+            LOG_WARN("Failed to remove old shard directory: %s", shard_path);
         }
-
-        // Record passed filter, add to results
-        results.push_back(record_buffer);
-        LOG_DEBUG("Added record " LODB_UUID_FMT " to results", LODB_UUID_ARGS(uuid));
     }
 
-    dir.close();
-
-    LOG_INFO("Select from %s: %d records after filtering", table_name, results.size());
-
-    // PHASE 2: SORT - sort results if comparator provided
-    if (comparator && !results.empty()) {
-        std::sort(results.begin(), results.end(), [comparator](const void *a, const void *b) { return comparator(a, b) < 0; });
-        LOG_DEBUG("Sorted %d records", results.size());
+    if (failed > 0) {
+        LOG_ERROR("Failed to move %d record files of %s into the new layout", failed, table->table_path);
+        return LODB_ERR_IO;
     }
 
-    // PHASE 3: LIMIT - apply limit if specified
-    if (limit > 0 && results.size() > limit) {
-        // Free records beyond limit
-        for (size_t i = limit; i < results.size(); i++) {
-            delete[] (uint8_t *)results[i];
+    // Record the layout the files are now in (no marker for flat)
+    LoFS::remove(marker_path);
+    if (target != LODB_LAYOUT_FLAT) {
+        auto file = lodb_open(marker_path, FILE_O_WRITE, tableIo(table));
+        bool marked = file && lodb_write(file, &target, 1, tableIo(table)) == 1;
+        if (file) {
+            file.close();
+        }
+        if (!marked) {
+            LOG_WARN("Failed to record layout of %s", table->table_path);
         }
-        results.resize(limit);
-        LOG_DEBUG("Limited results to %d records", limit);
     }
 
-    LOG_INFO("Select from %s complete: %d records returned", table_name, results.size());
-
-    return results;
-}
-
-// Free a vector of records returned by select()
-void LoDb::freeRecords(std::vector<void *> &records)
-{
-    for (auto *recordPtr : records) {
-        delete[] (uint8_t *)recordPtr;
-    }
-    records.clear();
+    LOG_INFO("Migrated %d records of %s to layout %d", moved, table->table_path, target);
+    return LODB_OK;
 }
 
-// Count records in a table with optional filtering
-int LoDb::count(const char *table_name, LoDbFilter filter)
+void LoDb::recoverReplacements(TableMetadata *table)
 {
-    if (!table_name) {
-        LOG_ERROR("Invalid table_name");
-        return -1;
-    }
-
-    TableMetadata *table = getTable(table_name);
-    if (!table) {
-        LOG_ERROR("Table not found: %s", table_name);
-        return -1;
+    // Temp files sit next to their record files, in the table directory or its shards
+    std::vector<std::string> dirs(1, table->table_path);
+    File root = lodb_open(table->table_path, FILE_O_READ, tableIo(table));
+    if (root) {
+        while (true) {
+            File file = lodb_open_next(root, tableIo(table));
+            if (!file) {
+                break;
+            }
+            uint8_t width;
+            if (file.isDirectory() && parseShardName(file.name(), &width)) {
+                dirs.push_back(std::string(table->table_path) + "/" + baseName(file.name()));
+            }
+            file.close();
+        }
+        root.close();
     }
 
-    int count = 0;
-
-    // If no filter, efficiently count files without loading records
-    if (!filter) {
-        File dir = LoFS::open(table->table_path, FILE_O_READ);
+    size_t promoted = 0;
+    for (const std::string &dir_path : dirs) {
+        std::vector<lodb_uuid_t> temp_keys;
+        File dir = lodb_open(dir_path.c_str(), FILE_O_READ, tableIo(table));
         if (!dir) {
-            LOG_DEBUG("Table directory not found: %s", table->table_path);
-            return 0; // Empty table
-        }
-
-        if (!dir.isDirectory()) {
-            LOG_ERROR("Table path is not a directory: %s", table->table_path);
-            dir.close();
-            return -1;
+            continue;
         }
-
-        // Count .pr files
         while (true) {
-            File file = dir.openNextFile();
+            File file = lodb_open_next(dir, tableIo(table));
             if (!file) {
-                break; // No more files
+                break;
             }
-
-            // Skip directories
-            if (file.isDirectory()) {
-                file.close();
-                continue;
+            lodb_uuid_t uuid;
+            if (!file.isDirectory() && parseRecordFileName(file.name(), &uuid, ".tmp")) {
+                temp_keys.push_back(uuid);
             }
-
-            // Get filename
-            std::string pathStr = file.name();
             file.close();
+        }
+        dir.close();
 
-            // Extract just the filename (after last /)
-            size_t lastSlash = pathStr.rfind('/');
-            std::string filename = (lastSlash != std::string::npos) ? pathStr.substr(lastSlash + 1) : pathStr;
-
-            // Check if it's a .pr file
-            if (filename.find(".pr") != std::string::npos) {
-                count++;
+        for (lodb_uuid_t uuid : temp_keys) {
+            char uuid_hex[17];
+            char temp_path[192];
+            char file_path[192];
+            lodb_uuid_to_hex(uuid, uuid_hex);
+            snprintf(temp_path, sizeof(temp_path), "%s/%s.tmp", dir_path.c_str(), uuid_hex);
+            snprintf(file_path, sizeof(file_path), "%s/%s.pr", dir_path.c_str(), uuid_hex);
+
+            // With the record file gone, a non-atomic replacement got as far as removing the old
+            // version, so the temp file holds the only (and complete) copy of the record
+            if (LoFS::exists(file_path)) {
+                LoFS::remove(temp_path);
+            } else if (LoFS::rename(temp_path, file_path)) {
+                promoted++;
+            } else {
+                LOG_ERROR("Failed to promote %s", temp_path);
             }
         }
-
-        dir.close();
-        LOG_DEBUG("Counted %d records in %s (no filter)", count, table_name);
-        return count;
     }
 
-    // Filter provided - need to load records to check them
-    // Use select() but don't keep the records, just count
-    auto results = select(table_name, filter, LoDbComparator(), 0);
-    count = results.size();
-    freeRecords(results);
-
-    LOG_DEBUG("Counted %d records in %s (with filter)", count, table_name);
-    return count;
+    if (promoted > 0) {
+        LOG_WARN("Promoted %d interrupted updates of %s", promoted, table->table_path);
+    }
 }
 
-// Truncate a table - delete all records but keep the table registered
-LoDbError LoDb::truncate(const char *table_name)
+LoDbError LoDb::replaceRecordFile(TableMetadata *table, const char *file_path, const uint8_t *data, const void *record,
+                                   size_t length)
 {
-    if (!table_name) {
-        LOG_ERROR("Invalid table_name");
-        return LODB_ERR_INVALID;
-    }
+    LoDbIoCounters *io = tableIo(table);
 
-    TableMetadata *table = getTable(table_name);
-    if (!table) {
-        LOG_ERROR("Table not registered: %s", table_name);
-        return LODB_ERR_INVALID;
-    }
+    // {uuid}.pr -> {uuid}.tmp, which scans and counts ignore
+    char temp_path[192];
+    snprintf(temp_path, sizeof(temp_path), "%.*s.tmp", (int)(strlen(file_path) - 3), file_path);
 
-    // Open table directory
-    File dir = LoFS::open(table->table_path, FILE_O_READ);
-    if (!dir) {
-        LOG_DEBUG("Table directory not found: %s (already empty)", table->table_path);
-        return LODB_OK; // Table is already empty
+    auto file = lodb_open(temp_path, FILE_O_WRITE, io);
+    if (file && file.size() > 0) {
+        // Left over from an interrupted update (older than the version being written even if the
+        // record file has since gone), and FILE_O_WRITE may append to it
+        file.close();
+        LoFS::remove(temp_path);
+        file = lodb_open(temp_path, FILE_O_WRITE, io);
+    }
+    if (!file) {
+        LOG_ERROR("Failed to open file for writing: %s", temp_path);
+        return LODB_ERR_IO;
     }
 
-    if (!dir.isDirectory()) {
-        LOG_ERROR("Table path is not a directory: %s", table->table_path);
-        dir.close();
-        return LODB_ERR_INVALID;
+    LoDbError err = writeRecord(table, file, data, record, length);
+    file.close();
+    if (err != LODB_OK) {
+        LoFS::remove(temp_path);
+        return err;
     }
 
-    // Iterate through all files and delete them
-    int deletedCount = 0;
-    while (true) {
-        File file = dir.openNextFile();
-        if (!file) {
-            break; // No more files
+    // The rename is the commit point: before it the old version is intact, after it the new one is
+    if (table->rename_replaces != 0) {
+        if (LoFS::rename(temp_path, file_path)) {
+            table->rename_replaces = 1;
+            return LODB_OK;
         }
 
-        // Skip directories
-        if (file.isDirectory()) {
-            file.close();
-            continue;
+        // Both files still in place means the filesystem refused to rename over the record, which
+        // it will keep doing; anything else is an I/O failure
+        if (table->rename_replaces == 1 || !LoFS::exists(temp_path) || !LoFS::exists(file_path)) {
+            LOG_ERROR("Failed to rename %s", temp_path);
+            LoFS::remove(temp_path);
+            return LODB_ERR_IO;
         }
+        LOG_WARN("Renames don't replace files on this filesystem, updates of %s are not atomic", table->table_path);
+        table->rename_replaces = 0;
+    }
 
-        // Get filename
-        std::string pathStr = file.name();
-        file.close();
+    // Filesystems that refuse to rename over an existing file need the old one out of the way.
+    // A reboot in between leaves only the temp file, which the next registration promotes.
+    if (!LoFS::remove(file_path)) {
+        LOG_ERROR("Failed to replace %s", file_path);
+        LoFS::remove(temp_path);
+        return LODB_ERR_IO;
+    }
+    if (!LoFS::rename(temp_path, file_path)) {
+        LOG_ERROR("Failed to rename %s, the new version is left in it", temp_path);
+        return LODB_ERR_IO;
+    }
+    return LODB_OK;
+}
 
-        // Extract just the filename (after last /)
-        size_t lastSlash = pathStr.rfind('/');
-        std::string filename = (lastSlash != std::string::npos) ? pathStr.substr(lastSlash + 1) : pathStr;
+LoDbError LoDb::appendRing(TableMetadata *table, lodb_uuid_t uuid, const uint8_t *data, size_t length)
+{
+    // A new record overwrites the oldest one once the ring is full, whose index entries must go with it
+    lodb_uuid_t evicted;
+    bool evicting = !table->ring->contains(uuid) && table->ring->nextEvicted(&evicted);
+    uint8_t *evicted_record = evicting ? readIndexedRecord(table, evicted) : nullptr;
+
+    // A failed write tears the slot, which loses the old record all the same
+    LoDbError err = table->ring->append(uuid, data, length);
+    if (evicting && !table->ring->contains(evicted)) {
+        updateIndexes(table, evicted, evicted_record, nullptr);
+        if (record_cache) {
+            record_cache->erase(table, evicted);
+        }
+        LOG_DEBUG("Evicted ring record: " LODB_UUID_FMT, LODB_UUID_ARGS(evicted));
+    }
+    delete[] evicted_record;
+    return err;
+}
 
-        // Build full file path
-        char file_path[192];
-        snprintf(file_path, sizeof(file_path), "%s/%s", table->table_path, filename.c_str());
+LoDbError LoDb::encodeRecord(TableMetadata *table, const void *record, std::vector<uint8_t> &buffer_out)
+{
+    size_t encoded_size;
+    if (!pb_get_encoded_size(&encoded_size, table->pb_descriptor, record)) {
+        return LODB_ERR_ENCODE;
+    }
 
-        // Delete the file
-        if (LoFS::remove(file_path)) {
-            deletedCount++;
-        } else {
-            LOG_WARN("Failed to delete file during truncate: %s", file_path);
-        }
+    buffer_out.resize(encoded_size);
+    pb_ostream_t stream = pb_ostream_from_buffer(buffer_out.data(), encoded_size);
+    if (!pb_encode(&stream, table->pb_descriptor, record)) {
+        return LODB_ERR_ENCODE;
     }
 
-    dir.close();
+    if (table->codec) {
+        std::vector<uint8_t> stored;
+        table->codec->compress(buffer_out.data(), buffer_out.size(), stored);
+        LODB_STATS_ADD(tableIo(table), compression_input_bytes, buffer_out.size());
+        LODB_STATS_ADD(tableIo(table), compression_output_bytes, stored.size());
+        buffer_out.swap(stored);
+    }
 
-    LOG_INFO("Truncated table %s: deleted %d records", table_name, deletedCount);
+    // Checked here so the write-ahead log never accepts a record its checkpoint can't store
+    if (table->ring && buffer_out.size() > table->ring->slotSize()) {
+        LOG_ERROR("Record of %d bytes exceeds ring slot size %d", buffer_out.size(), table->ring->slotSize());
+        return LODB_ERR_ENCODE;
+    }
     return LODB_OK;
 }
 
-// Drop a table - delete all records and unregister the table
-LoDbError LoDb::drop(const char *table_name)
+LoDbError LoDb::prepareRecord(TableMetadata *table, const void *record, std::vector<uint8_t> &buffer_out, size_t *length_out)
 {
-    if (!table_name) {
-        LOG_ERROR("Invalid table_name");
-        return LODB_ERR_INVALID;
+    buffer_out.clear();
+    if (table->codec) {
+        LoDbError err = encodeRecord(table, record, buffer_out);
+        *length_out = buffer_out.size();
+        return err;
     }
+    return pb_get_encoded_size(length_out, table->pb_descriptor, record) ? LODB_OK : LODB_ERR_ENCODE;
+}
 
-    // Check if table exists
-    TableMetadata *table = getTable(table_name);
-    if (!table) {
+LoDbError LoDb::writeRecord(TableMetadata *table, File &file, const uint8_t *data, const void *record, size_t length)
+{
+    if (data) {
+        size_t written = lodb_write(file, data, length, tableIo(table));
+        if (written != length) {
+            LOG_ERROR("Failed to write file, wrote %d of %d bytes", written, length);
+            return LODB_ERR_IO;
+        }
+        return LODB_OK;
+    }
+
+    LoDbFileStream state;
+    state.file = &file;
+    state.io = tableIo(table);
+    state.remaining = 0;
+    state.start = 0;
+    state.end = 0;
+    state.failed = false;
+
+    pb_ostream_t stream = {};
+    stream.callback = &fileStreamWrite;
+    stream.state = &state;
+    stream.max_size = length;
+    bool encoded = pb_encode(&stream, table->pb_descriptor, record);
+    if (!flushFileStream(&state) || (!encoded && state.failed)) {
+        LOG_ERROR("Failed to write file, wrote %d of %d bytes", stream.bytes_written, length);
+        return LODB_ERR_IO;
+    }
+    if (!encoded || stream.bytes_written != length) {
+        LOG_ERROR("Failed to encode protobuf: %s", PB_GET_ERROR(&stream));
+        return LODB_ERR_ENCODE;
+    }
+    return LODB_OK;
+}
+
+LoDbError LoDb::decodeRecord(TableMetadata *table, File &file, size_t size, void *record_out)
+{
+    LoDbFileStream state;
+    state.file = &file;
+    state.io = tableIo(table);
+    state.remaining = size;
+    state.start = 0;
+    state.end = 0;
+    state.failed = false;
+
+    // The first chunk tells plain records from compressed ones, which are decompressed whole
+    size_t want = size < sizeof(state.chunk) ? size : sizeof(state.chunk);
+    state.end = lodb_read(file, state.chunk, want, state.io);
+    state.remaining = size - state.end;
+    if (state.end != want) {
+        return LODB_ERR_IO;
+    }
+    if (LoDbCodec::isCompressed(state.chunk, state.end)) {
+        std::vector<uint8_t> buffer(size);
+        memcpy(buffer.data(), state.chunk, state.end);
+        if (state.remaining > 0 && lodb_read(file, buffer.data() + state.end, state.remaining, state.io) != state.remaining) {
+            return LODB_ERR_IO;
+        }
+        return decodeRecord(table, buffer.data(), size, record_out);
+    }
+
+    pb_istream_t stream = {};
+    stream.callback = &fileStreamRead;
+    stream.state = &state;
+    stream.bytes_left = size;
+    memset(record_out, 0, table->record_size);
+
+    if (!pb_decode(&stream, table->pb_descriptor, record_out)) {
+        return state.failed ? LODB_ERR_IO : LODB_ERR_DECODE;
+    }
+    LODB_STATS_ADD(tableIo(table), records_decoded, 1);
+    return LODB_OK;
+}
+
+LoDbError LoDb::decodeRecord(TableMetadata *table, const uint8_t *buffer, size_t size, void *record_out)
+{
+    std::vector<uint8_t> expanded;
+    if (LoDbCodec::isCompressed(buffer, size)) {
+        if (expandRecord(table->codec, buffer, size, expanded) != LODB_OK) {
+            return LODB_ERR_DECODE;
+        }
+        buffer = expanded.data();
+        size = expanded.size();
+    }
+
+    pb_istream_t stream = pb_istream_from_buffer(buffer, size);
+    memset(record_out, 0, table->record_size);
+
+    if (!pb_decode(&stream, table->pb_descriptor, record_out)) {
+        return LODB_ERR_DECODE;
+    }
+    LODB_STATS_ADD(tableIo(table), records_decoded, 1);
+    return LODB_OK;
+}
+
+LoDbError LoDb::unpackRecord(TableMetadata *table, std::vector<uint8_t> &buffer)
+{
+    if (!LoDbCodec::isCompressed(buffer.data(), buffer.size())) {
+        return LODB_OK;
+    }
+    std::vector<uint8_t> expanded;
+    LoDbError err = expandRecord(table->codec, buffer.data(), buffer.size(), expanded);
+    buffer.swap(expanded);
+    return err;
+}
+
+LoDb::TableMetadata *LoDb::getTable(const char *table_name)
+{
+    auto it = tables.find(table_name);
+    if (it == tables.end()) {
         LOG_ERROR("Table not registered: %s", table_name);
+        return nullptr;
+    }
+    return &it->second;
+}
+
+// Insert a record with a UUID
+LoDbError LoDb::insert(const char *table_name, lodb_uuid_t uuid, const void *record)
+{
+    uint32_t started = LODB_STATS_NOW();
+    LoDbError err = insertRecord(table_name, uuid, record);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_INSERT, started, err);
+    return err;
+}
+
+LoDbError LoDb::insertRecord(const char *table_name, lodb_uuid_t uuid, const void *record)
+{
+    if (!table_name || !record) {
         return LODB_ERR_INVALID;
     }
 
-    // Truncate first (delete all records)
-    LoDbError err = truncate(table_name);
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        return LODB_ERR_INVALID;
+    }
+
+    // Build file path
+    char file_path[192];
+    recordPath(table, uuid, file_path, sizeof(file_path));
+
+    // Check if record already exists, probing the filesystem only when the key isn't known
+    bool exists;
+    if (!lookupKey(table, uuid, &exists)) {
+        auto existing = lodb_open(file_path, FILE_O_READ, tableIo(table));
+        exists = (bool)existing;
+        if (existing) {
+            existing.close();
+        }
+    }
+
+    // An expired record that wasn't swept yet gives way to the new one
+    if (exists && isExpired(table, uuid)) {
+        LoDbError err = removeRecord(table_name, uuid);
+        if (err != LODB_OK) {
+            return err;
+        }
+        exists = false;
+    }
+    if (exists) {
+        LOG_ERROR("UUID already exists: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        return LODB_ERR_INVALID;
+    }
+
+    // The log, segment and ring engines take the encoded bytes in one piece
+    if (wal || table->segment_log || table->ring) {
+        std::vector<uint8_t> buffer;
+        if (encodeRecord(table, record, buffer) != LODB_OK) {
+            LOG_ERROR("Failed to encode protobuf for insert");
+            return LODB_ERR_ENCODE;
+        }
+        LOG_DEBUG("Encoded record: %d bytes", buffer.size());
+
+        // With a write-ahead log the record reaches table storage at the next checkpoint,
+        // segment log tables append to the active segment and ring tables take the next slot
+        LoDbError err = wal               ? logWrite(table, uuid, buffer.data(), buffer.size())
+                        : table->ring     ? appendRing(table, uuid, buffer.data(), buffer.size())
+                                          : table->segment_log->append(uuid, buffer.data(), buffer.size());
+        if (err != LODB_OK) {
+            return err;
+        }
+        updateIndexes(table, uuid, nullptr, record, true);
+        LOG_INFO("Inserted record with custom UUID: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        return LODB_OK;
+    }
+
+    // Size the record up front, then encode it straight into the file (compressed tables encode it here)
+    std::vector<uint8_t> buffer;
+    size_t encoded_size;
+    if (prepareRecord(table, record, buffer, &encoded_size) != LODB_OK) {
+        LOG_ERROR("Failed to encode protobuf for insert");
+        return LODB_ERR_ENCODE;
+    }
+    LOG_DEBUG("Encoded record: %d bytes", encoded_size);
+
+    // Write to file
+    invalidateRowCount(table);
+    invalidateBloom(table);
+    ensureShard(table, uuid);
+    auto file = lodb_open(file_path, FILE_O_WRITE, tableIo(table));
+    if (!file) {
+        LOG_ERROR("Failed to open file for writing: %s", file_path);
+        return LODB_ERR_IO;
+    }
+
+    LoDbError err = writeRecord(table, file, buffer.empty() ? nullptr : buffer.data(), record, encoded_size);
     if (err != LODB_OK) {
-        LOG_WARN("Failed to truncate table before drop: %s", table_name);
-        // Continue anyway to try to remove directory and unregister
+        file.close();
+        LoFS::remove(file_path); // Don't leave a truncated record behind
+        return err;
     }
 
-    // Remove table directory (recursively to ensure cleanup even if truncate didn't remove everything)
-    if (LoFS::rmdir(table->table_path, true)) {
-        LOG_DEBUG("Removed table directory: %s", table->table_path);
+    file.flush();
+    file.close();
+    addKey(table, uuid);
+    adjustRowCount(table, 1);
+    updateIndexes(table, uuid, nullptr, record, true);
+    LOG_DEBUG("Wrote record to: %s (%d bytes)", file_path, encoded_size);
+
+    LOG_INFO("Inserted record with custom UUID: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+    return LODB_OK;
+}
+
+// Insert a batch of records with UUIDs
+LoDbError LoDb::insertMany(const char *table_name, const lodb_uuid_t *uuids, const void *const *records, size_t count,
+                           LoDbError *statuses_out)
+{
+    uint32_t started = LODB_STATS_NOW();
+    LoDbError err = insertRecords(table_name, uuids, records, count, statuses_out);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_INSERT_MANY, started, err);
+    return err;
+}
+
+LoDbError LoDb::insertRecords(const char *table_name, const lodb_uuid_t *uuids, const void *const *records, size_t count,
+                              LoDbError *statuses_out)
+{
+    if (!table_name || (count > 0 && (!uuids || !records))) {
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        return LODB_ERR_INVALID;
+    }
+
+    std::vector<LoDbError> local_statuses;
+    if (!statuses_out) {
+        local_statuses.resize(count);
+        statuses_out = local_statuses.data();
+    }
+    for (size_t i = 0; i < count; i++) {
+        statuses_out[i] = records[i] ? LODB_OK : LODB_ERR_INVALID;
+    }
+
+    // Reject UUIDs repeated within the batch, keeping the first occurrence
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [uuids](size_t a, size_t b) { return uuids[a] < uuids[b]; });
+    for (size_t i = 1; i < count; i++) {
+        if (uuids[order[i]] == uuids[order[i - 1]]) {
+            LOG_ERROR("UUID repeated in batch: " LODB_UUID_FMT, LODB_UUID_ARGS(uuids[order[i]]));
+            statuses_out[order[i]] = LODB_ERR_INVALID;
+        }
+    }
+
+    // Reject UUIDs that already exist, listing the table directory once when the keys aren't known
+    std::vector<lodb_uuid_t> listed_keys;
+    LoDbError list_err = LODB_OK;
+    bool listed = false;
+    for (size_t i = 0; i < count; i++) {
+        if (statuses_out[i] != LODB_OK) {
+            continue;
+        }
+
+        bool exists;
+        if (!lookupKey(table, uuids[i], &exists)) {
+            if (!listed) {
+                list_err = listRecordKeys(table, listed_keys);
+                listed = true;
+            }
+            if (list_err != LODB_OK) {
+                statuses_out[i] = list_err;
+                continue;
+            }
+            exists = std::binary_search(listed_keys.begin(), listed_keys.end(), uuids[i]);
+        }
+        if (exists && isExpired(table, uuids[i])) {
+            LoDbError err = removeRecord(table_name, uuids[i]);
+            if (err != LODB_OK) {
+                statuses_out[i] = err;
+                continue;
+            }
+            exists = false;
+        }
+        if (exists) {
+            LOG_ERROR("UUID already exists: " LODB_UUID_FMT, LODB_UUID_ARGS(uuids[i]));
+            statuses_out[i] = LODB_ERR_INVALID;
+        }
+    }
+
+    // One encode buffer shared by every row of log, segment and ring tables
+    std::vector<uint8_t> buffer;
+    char file_path[192];
+    std::vector<lodb_uuid_t> inserted_keys;
+
+    if (table->segment_log && !wal) {
+        table->segment_log->beginBatch();
+    } else if (table->ring && !wal) {
+        table->ring->beginBatch();
+    } else if (!wal) {
+        invalidateRowCount(table);
+        invalidateBloom(table);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (statuses_out[i] != LODB_OK) {
+            continue;
+        }
+
+        if (wal || table->segment_log || table->ring) {
+            if (encodeRecord(table, records[i], buffer) != LODB_OK) {
+                LOG_ERROR("Failed to encode protobuf for batch row %d", i);
+                statuses_out[i] = LODB_ERR_ENCODE;
+                continue;
+            }
+            LoDbError err = wal           ? logWrite(table, uuids[i], buffer.data(), buffer.size())
+                            : table->ring ? appendRing(table, uuids[i], buffer.data(), buffer.size())
+                                          : table->segment_log->append(uuids[i], buffer.data(), buffer.size());
+            if (err != LODB_OK) {
+                statuses_out[i] = err;
+                continue;
+            }
+        } else {
+            size_t encoded_size;
+            if (prepareRecord(table, records[i], buffer, &encoded_size) != LODB_OK) {
+                LOG_ERROR("Failed to encode protobuf for batch row %d", i);
+                statuses_out[i] = LODB_ERR_ENCODE;
+                continue;
+            }
+
+            recordPath(table, uuids[i], file_path, sizeof(file_path));
+            ensureShard(table, uuids[i]);
+
+            // Closing the file commits it, the explicit flush of insert() is skipped
+            auto file = lodb_open(file_path, FILE_O_WRITE, tableIo(table));
+            if (!file) {
+                LOG_ERROR("Failed to open file for writing: %s", file_path);
+                statuses_out[i] = LODB_ERR_IO;
+                continue;
+            }
+            LoDbError err = writeRecord(table, file, buffer.empty() ? nullptr : buffer.data(), records[i], encoded_size);
+            file.close();
+            if (err != LODB_OK) {
+                LoFS::remove(file_path);
+                statuses_out[i] = err;
+                continue;
+            }
+            inserted_keys.push_back(uuids[i]);
+        }
+
+        updateIndexes(table, uuids[i], nullptr, records[i], true);
+    }
+
+    // Single flush point for the whole batch
+    if (wal) {
+        wal->sync(true);
+    } else if (table->segment_log) {
+        table->segment_log->endBatch();
+    } else if (table->ring) {
+        table->ring->endBatch();
+    }
+
+    adjustRowCount(table, (int)inserted_keys.size());
+    if (table->bloom && table->bloom_ready) {
+        for (lodb_uuid_t uuid : inserted_keys) {
+            table->bloom->add(uuid);
+        }
+    }
+
+    // Merge new keys into the key directory in one pass
+    if (table->keys_loaded && !inserted_keys.empty()) {
+        std::sort(inserted_keys.begin(), inserted_keys.end());
+        size_t middle = table->keys.size();
+        table->keys.insert(table->keys.end(), inserted_keys.begin(), inserted_keys.end());
+        std::inplace_merge(table->keys.begin(), table->keys.begin() + middle, table->keys.end());
+    }
+
+    LoDbError result = LODB_OK;
+    size_t inserted = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (statuses_out[i] == LODB_OK) {
+            inserted++;
+        } else if (result == LODB_OK) {
+            result = statuses_out[i];
+        }
+    }
+
+    LOG_INFO("Inserted %d of %d records into %s", inserted, count, table_name);
+    return result;
+}
+
+// Get a record by UUID
+LoDbError LoDb::get(const char *table_name, lodb_uuid_t uuid, void *record_out)
+{
+    uint32_t started = LODB_STATS_NOW();
+    LoDbError err = readRecord(table_name, uuid, record_out);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_GET, started, err);
+    return err;
+}
+
+LoDbError LoDb::readRecord(const char *table_name, lodb_uuid_t uuid, void *record_out)
+{
+    if (!table_name || !record_out) {
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        return LODB_ERR_INVALID;
+    }
+
+    // Expired records read as absent until the sweeper deletes them
+    if (isExpired(table, uuid)) {
+        LOG_DEBUG("Record expired: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        return LODB_ERR_NOT_FOUND;
+    }
+    return fetchRecord(table, uuid, record_out);
+}
+
+LoDbError LoDb::fetchRecord(TableMetadata *table, lodb_uuid_t uuid, void *record_out)
+{
+    // Hot records are copied out of the cache before anything else, storage and paths included
+    if (record_cache && table->cacheable && record_cache->get(table, uuid, record_out, table->record_size)) {
+        LOG_DEBUG("Retrieved cached record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        return LODB_OK;
+    }
+
+    // Build file path
+    char file_path[192];
+    recordPath(table, uuid, file_path, sizeof(file_path));
+    LOG_DEBUG("file_path: %s", file_path);
+
+    // Answer NOT_FOUND from memory when the key is known to be absent
+    bool exists;
+    if (lookupKey(table, uuid, &exists) && !exists) {
+        LOG_DEBUG("Record not found: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        return LODB_ERR_NOT_FOUND;
+    }
+
+    // Open the record where it is stored, positioned at its encoded bytes
+    File file;
+    size_t file_size = 0;
+    const LoDbWal::Entry *logged = wal ? wal->find(table->table_name, uuid) : nullptr;
+
+    if (logged) {
+        // Logged but not yet checkpointed
+        LoDbError err = wal->openRecord(*logged, &file);
+        if (err != LODB_OK) {
+            return err;
+        }
+        file_size = logged->length;
+    } else if (table->segment_log) {
+        LoDbError err = table->segment_log->openRecord(uuid, &file, &file_size);
+        if (err == LODB_ERR_NOT_FOUND) {
+            LOG_DEBUG("Record not found: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        }
+        if (err != LODB_OK) {
+            return err;
+        }
+    } else if (table->ring) {
+        LoDbError err = table->ring->openRecord(uuid, &file, &file_size);
+        if (err == LODB_ERR_NOT_FOUND) {
+            LOG_DEBUG("Record not found: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        }
+        if (err != LODB_OK) {
+            return err;
+        }
     } else {
-        LOG_WARN("Failed to remove table directory: %s", table->table_path);
+        file = lodb_open(file_path, FILE_O_READ, tableIo(table));
+        if (!file) {
+            LOG_DEBUG("Record not found: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+            removeKey(table, uuid); // Stale entry, the file was removed behind our back
+            return LODB_ERR_NOT_FOUND;
+        }
+        file_size = file.size();
     }
 
-    // Remove from tables map
-    tables.erase(table_name);
+    if (file_size == 0) {
+        file.close();
+        LOG_ERROR("Record file is empty: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        return LODB_ERR_IO;
+    }
 
-    LOG_INFO("Dropped table: %s", table_name);
+    LOG_DEBUG("Read record file: %s (%d bytes)", file_path, file_size);
+
+    // Decode straight from the file
+    LoDbError err = decodeRecord(table, file, file_size, record_out);
+    file.close();
+    if (err != LODB_OK) {
+        LOG_ERROR("Failed to decode protobuf from " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        return err;
+    }
+
+    // Only freshly decoded records are cached, never a caller's struct
+    if (record_cache && table->cacheable) {
+        uint8_t *slot = record_cache->put(table, uuid, table->record_size);
+        if (slot) {
+            memcpy(slot, record_out, table->record_size);
+        }
+    }
+
+    LOG_DEBUG("Retrieved record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
     return LODB_OK;
 }
+
+// Check whether a record exists
+bool LoDb::exists(const char *table_name, lodb_uuid_t uuid)
+{
+    uint32_t started = LODB_STATS_NOW();
+    LoDbError err;
+    bool found = recordExists(table_name, uuid, &err);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_EXISTS, started, err);
+    return found;
+}
+
+bool LoDb::recordExists(const char *table_name, lodb_uuid_t uuid, LoDbError *error_out)
+{
+    *error_out = LODB_OK;
+    if (!table_name) {
+        *error_out = LODB_ERR_INVALID;
+        return false;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        *error_out = LODB_ERR_INVALID;
+        return false;
+    }
+
+    if (isExpired(table, uuid)) {
+        return false;
+    }
+
+    bool exists;
+    if (lookupKey(table, uuid, &exists)) {
+        return exists;
+    }
+
+    // Without an answer from memory, a key directory that is configured failed to load
+    if (table->options.key_directory && !table->keys_loaded) {
+        *error_out = LODB_ERR_IO;
+    }
+
+    char file_path[192];
+    recordPath(table, uuid, file_path, sizeof(file_path));
+    return LoFS::exists(file_path);
+}
+
+// Update a single record by UUID
+LoDbError LoDb::update(const char *table_name, lodb_uuid_t uuid, const void *record)
+{
+    uint32_t started = LODB_STATS_NOW();
+    LoDbError err = updateRecord(table_name, uuid, record);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_UPDATE, started, err);
+    return err;
+}
+
+LoDbError LoDb::updateRecord(const char *table_name, lodb_uuid_t uuid, const void *record)
+{
+    if (!table_name || !record) {
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        return LODB_ERR_INVALID;
+    }
+
+    // Build file path
+    char file_path[192];
+    recordPath(table, uuid, file_path, sizeof(file_path));
+
+    // Check if record exists first, probing the filesystem only when the key isn't known.
+    // Rename mode keeps the probe open so an indexed table reads the old version from it.
+    bool rename_mode = table->options.update_mode == LODB_UPDATE_RENAME && !table->segment_log && !table->ring && !wal;
+    File existing;
+    bool exists;
+    if (!lookupKey(table, uuid, &exists)) {
+        existing = lodb_open(file_path, FILE_O_READ, tableIo(table));
+        exists = (bool)existing;
+        if (existing && (!rename_mode || table->indexes.empty())) {
+            existing.close();
+            existing = File();
+        }
+    }
+    if (exists && isExpired(table, uuid)) {
+        if (existing) {
+            existing.close();
+        }
+        exists = false;
+    }
+    if (!exists) {
+        LOG_DEBUG("Record not found for update: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        return LODB_ERR_NOT_FOUND;
+    }
+
+    // Indexed fields may change, so the old version is needed to move its index entries
+    uint8_t *old_record = nullptr;
+    if (existing) {
+        size_t old_size = existing.size();
+        old_record = new uint8_t[table->record_size];
+        bool decoded = old_size > 0 && decodeRecord(table, existing, old_size, old_record) == LODB_OK;
+        existing.close();
+        if (!decoded) {
+            LOG_WARN("Failed to read indexed record " LODB_UUID_FMT ", its old index entries are kept", LODB_UUID_ARGS(uuid));
+            delete[] old_record;
+            old_record = nullptr;
+        }
+    } else {
+        old_record = readIndexedRecord(table, uuid);
+    }
+
+    // Drop the cached version now, so a failed write can't leave it behind
+    if (record_cache) {
+        record_cache->erase(table, uuid);
+    }
+
+    // The log takes the encoded bytes in one piece, segment log tables append a new copy
+    // that supersedes the old one and ring tables rewrite the record's slot
+    if (wal || table->segment_log || table->ring) {
+        std::vector<uint8_t> buffer;
+        if (encodeRecord(table, record, buffer) != LODB_OK) {
+            LOG_ERROR("Failed to encode updated record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+            delete[] old_record;
+            return LODB_ERR_ENCODE;
+        }
+
+        LoDbError err = wal               ? logWrite(table, uuid, buffer.data(), buffer.size())
+                        : table->ring     ? table->ring->append(uuid, buffer.data(), buffer.size())
+                                          : table->segment_log->append(uuid, buffer.data(), buffer.size());
+        if (err == LODB_OK) {
+            updateIndexes(table, uuid, old_record, record);
+            LOG_INFO("Updated record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        }
+        delete[] old_record;
+        return err;
+    }
+
+    // Size the new version up front, it is encoded straight into the file (compressed tables encode it here)
+    std::vector<uint8_t> buffer;
+    size_t encoded_size;
+    if (prepareRecord(table, record, buffer, &encoded_size) != LODB_OK) {
+        LOG_ERROR("Failed to encode updated record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        delete[] old_record;
+        return LODB_ERR_ENCODE;
+    }
+
+    // Rename mode swaps the new version in, so readers never see the record missing
+    if (rename_mode) {
+        LoDbError err = replaceRecordFile(table, file_path, buffer.empty() ? nullptr : buffer.data(), record, encoded_size);
+        if (err == LODB_OK) {
+            updateIndexes(table, uuid, old_record, record);
+            LOG_INFO("Updated record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        }
+        delete[] old_record;
+        return err;
+    }
+
+    // Write to file
+    invalidateRowCount(table); // The record is missing between the remove and the write
+    LoFS::remove(file_path); // Remove old file
+    auto file = lodb_open(file_path, FILE_O_WRITE, tableIo(table));
+    if (!file) {
+        LOG_ERROR("Failed to open file for update: %s", file_path);
+        removeKey(table, uuid); // Old file is already gone
+        adjustRowCount(table, -1);
+        updateIndexes(table, uuid, old_record, nullptr);
+        delete[] old_record;
+        return LODB_ERR_IO;
+    }
+
+    LoDbError err = writeRecord(table, file, buffer.empty() ? nullptr : buffer.data(), record, encoded_size);
+    if (err != LODB_OK) {
+        LOG_ERROR("Failed to write updated file");
+        file.close();
+        delete[] old_record;
+        return err;
+    }
+
+    file.flush();
+    file.close();
+    updateIndexes(table, uuid, old_record, record);
+    delete[] old_record;
+
+    LOG_INFO("Updated record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+    return LODB_OK;
+}
+
+// Delete a single record by UUID
+LoDbError LoDb::deleteRecord(const char *table_name, lodb_uuid_t uuid)
+{
+    uint32_t started = LODB_STATS_NOW();
+    LoDbError err = removeRecord(table_name, uuid);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_DELETE, started, err);
+    return err;
+}
+
+LoDbError LoDb::removeRecord(const char *table_name, lodb_uuid_t uuid)
+{
+    if (!table_name) {
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        return LODB_ERR_INVALID;
+    }
+
+    char file_path[192];
+    recordPath(table, uuid, file_path, sizeof(file_path));
+
+    bool exists;
+    bool known = lookupKey(table, uuid, &exists);
+    if (!known && wal) {
+        // The log acknowledges the delete before storage is touched, so it must know the answer now
+        exists = LoFS::exists(file_path);
+        known = true;
+    }
+    if (known && !exists) {
+        LOG_WARN("Failed to delete record (may not exist): " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+        return LODB_ERR_NOT_FOUND;
+    }
+
+    // The deleted version's field values are needed to find its index entries
+    uint8_t *old_record = readIndexedRecord(table, uuid);
+    if (record_cache) {
+        record_cache->erase(table, uuid);
+    }
+    LoDbError err;
+
+    if (wal) {
+        err = logWrite(table, uuid, nullptr, 0);
+    } else if (table->segment_log) {
+        err = table->segment_log->remove(uuid);
+    } else if (table->ring) {
+        err = table->ring->remove(uuid);
+    } else {
+        invalidateRowCount(table);
+        if (LoFS::remove(file_path)) {
+            removeKey(table, uuid);
+            adjustRowCount(table, -1);
+            err = LODB_OK;
+        } else {
+            err = LODB_ERR_NOT_FOUND;
+        }
+    }
+
+    if (err == LODB_OK) {
+        updateIndexes(table, uuid, old_record, nullptr);
+        LOG_DEBUG("Deleted record: " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+    } else {
+        LOG_WARN("Failed to delete record (may not exist): " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+    }
+    delete[] old_record;
+    return err;
+}
+
+// Delete every record below a UUID bound
+LoDbError LoDb::deleteBefore(const char *table_name, lodb_uuid_t before, size_t *deleted_out)
+{
+    uint32_t started = LODB_STATS_NOW();
+    size_t deleted = 0;
+    LoDbError err = removeRecordsBefore(table_name, before, &deleted);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_DELETE, started, err);
+    if (deleted_out) {
+        *deleted_out = deleted;
+    }
+    return err;
+}
+
+LoDbError LoDb::removeRecordsBefore(const char *table_name, lodb_uuid_t before, size_t *deleted_out)
+{
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not found: %s", table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    LoDbError err = applyLog(table);
+    if (err != LODB_OK) {
+        LOG_ERROR("Failed to apply write-ahead log before deleting from %s", table_name);
+        return err;
+    }
+
+    // The keys are sorted, so the records to delete are a prefix and none is read
+    std::vector<lodb_uuid_t> keys;
+    err = sortedKeys(table, keys);
+    if (err != LODB_OK) {
+        return err;
+    }
+    auto end = std::lower_bound(keys.begin(), keys.end(), before);
+    for (auto it = keys.begin(); it != end; ++it) {
+        err = removeRecord(table_name, *it);
+        if (err != LODB_OK) {
+            break;
+        }
+        (*deleted_out)++;
+    }
+
+    LOG_INFO("Deleted %d records before " LODB_UUID_FMT " from %s", *deleted_out, LODB_UUID_ARGS(before), table_name);
+    return err;
+}
+
+// Select records with optional filtering, sorting, and limiting
+std::vector<void *> LoDb::select(const char *table_name, LoDbFilter filter, LoDbComparator comparator, size_t limit, size_t offset)
+{
+    return select(table_name, LoDbWhere(), filter, comparator, limit, offset);
+}
+
+// Select records matching a declarative predicate
+std::vector<void *> LoDb::select(const char *table_name, const LoDbWhere &where, LoDbFilter filter, LoDbComparator comparator,
+                                 size_t limit, size_t offset)
+{
+    uint32_t started = LODB_STATS_NOW();
+    LoDbError err;
+    std::vector<void *> results = selectRecords(table_name, where, filter, comparator, limit, offset, &err);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_SELECT, started, err);
+    return results;
+}
+
+std::vector<void *> LoDb::selectRecords(const char *table_name, const LoDbWhere &where, LoDbFilter filter,
+                                        LoDbComparator comparator, size_t limit, size_t offset, LoDbError *error_out)
+{
+    std::vector<void *> results;
+    *error_out = LODB_OK;
+
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        *error_out = LODB_ERR_INVALID;
+        return results;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not found: %s", table_name);
+        *error_out = LODB_ERR_INVALID;
+        return results;
+    }
+
+    auto less = [&comparator](const void *a, const void *b) { return comparator(a, b) < 0; };
+
+    // Free the records ahead of the requested page
+    auto dropOffset = [&results, offset]() {
+        size_t dropped = std::min(offset, results.size());
+        for (size_t i = 0; i < dropped; i++) {
+            delete[] (uint8_t *)results[i];
+        }
+        results.erase(results.begin(), results.begin() + dropped);
+    };
+
+    // TOP-K: with both a comparator and a limit, keep only the best `offset + limit` records
+    // in a bounded max-heap (worst record on top) - O(offset + limit) memory, O(n log limit) compares
+    if (comparator && limit > 0) {
+        size_t keep = offset + limit;
+        LoDbCursor cursor = scan(table_name, where, filter);
+        *error_out = scanError(cursor);
+        uint8_t *record_buffer = new uint8_t[table->record_size];
+        size_t matched = 0;
+        while (cursor.next(record_buffer)) {
+            matched++;
+            if (results.size() < keep) {
+                results.push_back(record_buffer);
+                std::push_heap(results.begin(), results.end(), less);
+                record_buffer = new uint8_t[table->record_size];
+            } else if (less(record_buffer, results.front())) {
+                // Evict the current worst and reuse its buffer for the next record
+                std::pop_heap(results.begin(), results.end(), less);
+                uint8_t *evicted = (uint8_t *)results.back();
+                results.back() = record_buffer;
+                record_buffer = evicted;
+                std::push_heap(results.begin(), results.end(), less);
+            }
+        }
+        delete[] record_buffer;
+
+        std::sort_heap(results.begin(), results.end(), less);
+        dropOffset();
+        LOG_INFO("Select from %s complete: %d of %d matching records returned (top-k)", table_name, results.size(), matched);
+        return results;
+    }
+
+    LoDbCursor cursor = scan(table_name, where, filter);
+    *error_out = scanError(cursor);
+
+    // Unsorted results are taken in scan order, so skipped rows never need to be kept
+    if (!comparator && offset > 0) {
+        cursor.skip(offset);
+    }
+
+    // PHASE 1: FILTER - stream matching records through a cursor, keeping each one
+    // Without a comparator the scan stops as soon as `limit` records are collected
+    uint8_t *record_buffer = new uint8_t[table->record_size];
+    while ((comparator || limit == 0 || results.size() < limit) && cursor.next(record_buffer)) {
+        results.push_back(record_buffer);
+        record_buffer = new uint8_t[table->record_size];
+    }
+    delete[] record_buffer;
+    cursor.close();
+
+    LOG_INFO("Select from %s: %d records after filtering", table_name, results.size());
+
+    // PHASE 2: SORT - sort results if comparator provided
+    if (comparator && !results.empty()) {
+        std::sort(results.begin(), results.end(), less);
+        LOG_DEBUG("Sorted %d records", results.size());
+    }
+
+    // PHASE 3: OFFSET - sorted results can only be paged once they are in order
+    if (comparator && offset > 0) {
+        dropOffset();
+        LOG_DEBUG("Skipped %d sorted records", offset);
+    }
+
+    LOG_INFO("Select from %s complete: %d records returned", table_name, results.size());
+
+    return results;
+}
+
+// Select records into a single-arena result set
+LoDbError LoDb::select(const char *table_name, LoDbResultSet &results, LoDbFilter filter, LoDbComparator comparator, size_t limit,
+                       size_t offset)
+{
+    return select(table_name, results, LoDbWhere(), filter, comparator, limit, offset);
+}
+
+// Select records matching a declarative predicate into a single-arena result set
+LoDbError LoDb::select(const char *table_name, LoDbResultSet &results, const LoDbWhere &where, LoDbFilter filter,
+                       LoDbComparator comparator, size_t limit, size_t offset)
+{
+    uint32_t started = LODB_STATS_NOW();
+    LoDbError err = selectRecords(table_name, results, where, filter, comparator, limit, offset);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_SELECT, started, err);
+    return err;
+}
+
+LoDbError LoDb::selectRecords(const char *table_name, LoDbResultSet &results, const LoDbWhere &where, LoDbFilter filter,
+                              LoDbComparator comparator, size_t limit, size_t offset)
+{
+    results.clear();
+
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not found: %s", table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    results.reset(table->record_size);
+    LoDbCursor cursor = scan(table_name, where, filter);
+    LoDbError err = scanError(cursor);
+    if (err != LODB_OK) {
+        return err;
+    }
+
+    // Unsorted: decode straight into the arena, stopping once the page is full
+    if (!comparator) {
+        if (offset > 0) {
+            cursor.skip(offset);
+        }
+        while (limit == 0 || results.size() < limit) {
+            void *slot = results.append();
+            if (!slot) {
+                LOG_ERROR("Out of memory selecting from %s after %d records", table_name, results.size());
+                results.clear();
+                return LODB_ERR_NO_MEMORY;
+            }
+            if (!cursor.next(slot)) {
+                results.count--;
+                break;
+            }
+        }
+        LOG_INFO("Select from %s complete: %d records returned (arena)", table_name, results.size());
+        return LODB_OK;
+    }
+
+    // Sorted: order slot indices rather than records, then rearrange the arena once
+    auto less = [&results, &comparator](size_t a, size_t b) { return comparator(results[a], results[b]) < 0; };
+    size_t keep = limit > 0 ? offset + limit : 0;
+    std::vector<size_t> order;
+    bool has_scratch = false; // Whether scratch names a free slot to decode into
+    size_t scratch = 0;
+
+    while (true) {
+        size_t index = scratch;
+        if (!has_scratch) {
+            if (!results.append()) {
+                LOG_ERROR("Out of memory selecting from %s after %d records", table_name, order.size());
+                results.clear();
+                return LODB_ERR_NO_MEMORY;
+            }
+            index = results.size() - 1;
+        }
+        if (!cursor.next(results[index])) {
+            break;
+        }
+
+        // TOP-K: once keep records are held, the loser of each comparison becomes the scratch slot
+        has_scratch = false;
+        if (keep == 0 || order.size() < keep) {
+            order.push_back(index);
+            std::push_heap(order.begin(), order.end(), less);
+        } else if (less(index, order.front())) {
+            std::pop_heap(order.begin(), order.end(), less);
+            scratch = order.back();
+            order.back() = index;
+            std::push_heap(order.begin(), order.end(), less);
+            has_scratch = true;
+        } else {
+            scratch = index;
+            has_scratch = true;
+        }
+    }
+
+    std::sort_heap(order.begin(), order.end(), less);
+    results.arrange(order);
+    results.dropFront(offset);
+    LOG_INFO("Select from %s complete: %d records returned (arena)", table_name, results.size());
+    return LODB_OK;
+}
+
+// Open a streaming cursor over a table
+LoDbCursor LoDb::scan(const char *table_name, LoDbFilter filter)
+{
+    return scan(table_name, LoDbWhere(), filter);
+}
+
+// Open a streaming cursor over records matching a declarative predicate
+LoDbCursor LoDb::scan(const char *table_name, const LoDbWhere &where, LoDbFilter filter)
+{
+    LoDbCursor cursor;
+
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return cursor;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not found: %s", table_name);
+        return cursor;
+    }
+
+    // Storage must hold every logged record before it can be scanned
+    if (applyLog(table) != LODB_OK) {
+        LOG_ERROR("Failed to apply write-ahead log before scanning %s", table_name);
+        return cursor;
+    }
+
+    // Resolve the predicate's field types once for the whole scan
+    cursor.where = where;
+    if (!where.empty() && !cursor.where.bind(table->pb_descriptor, table->record_size, table->fixed_fields)) {
+        LOG_ERROR("Invalid where clause for table %s", table_name);
+        return cursor;
+    }
+
+    if (table->segment_log) {
+        // Segment log tables are read sequentially, segment by segment
+        cursor.segment_scan = new LoDbSegmentScan();
+        table->segment_log->beginScan(*cursor.segment_scan);
+    } else if (table->ring) {
+        // Ring tables are read in slot order, oldest record first
+        cursor.ring_scan = new LoDbRingScan();
+        table->ring->beginScan(*cursor.ring_scan);
+    } else {
+        // A missing table directory walks no records
+        if (cursor.walk.open(table->table_path, table->options.layout, tableIo(table)) != LODB_OK) {
+            LOG_ERROR("Table path is not a directory: %s", table->table_path);
+            return cursor;
+        }
+    }
+
+    cursor.db = this;
+    cursor.table = table;
+    cursor.filter = filter;
+    return cursor;
+}
+
+LoDbError LoDb::scanError(const LoDbCursor &cursor)
+{
+    if (cursor.table) {
+        return LODB_OK;
+    }
+    // The predicate is only copied in once the log is applied, and stays unbound if it doesn't fit the table
+    return !cursor.where.empty() && !cursor.where.bound ? LODB_ERR_INVALID : LODB_ERR_IO;
+}
+
+// Select the newest records of a table
+std::vector<void *> LoDb::selectLatest(const char *table_name, size_t count, LoDbFilter filter)
+{
+    uint32_t started = LODB_STATS_NOW();
+    LoDbError err;
+    std::vector<void *> results = selectLatestRecords(table_name, count, filter, &err);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_SELECT, started, err);
+    return results;
+}
+
+std::vector<void *> LoDb::selectLatestRecords(const char *table_name, size_t count, LoDbFilter filter, LoDbError *error_out)
+{
+    std::vector<void *> results;
+    *error_out = LODB_OK;
+
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        *error_out = LODB_ERR_INVALID;
+        return results;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not found: %s", table_name);
+        *error_out = LODB_ERR_INVALID;
+        return results;
+    }
+
+    *error_out = applyLog(table);
+    if (*error_out != LODB_OK) {
+        LOG_ERROR("Failed to apply write-ahead log before selecting from %s", table_name);
+        return results;
+    }
+
+    if (!table->ring) {
+        // Without a record of insertion order, newest first means the highest UUIDs first
+        std::vector<lodb_uuid_t> keys;
+        *error_out = sortedKeys(table, keys);
+        if (*error_out != LODB_OK) {
+            LOG_ERROR("Failed to list records of %s", table_name);
+            return results;
+        }
+        uint8_t *record = nullptr;
+        for (auto it = keys.rbegin(); it != keys.rend() && results.size() < count; ++it) {
+            if (isExpired(table, *it)) {
+                continue;
+            }
+            if (!record) {
+                record = new uint8_t[table->record_size];
+            }
+            LoDbError err = fetchRecord(table, *it, record);
+            if (err != LODB_OK) {
+                // The other records are still returned, the failure is reported alongside them
+                LOG_WARN("Failed to read record " LODB_UUID_FMT, LODB_UUID_ARGS(*it));
+                *error_out = err;
+                continue;
+            }
+            if (filter && !filter(record)) {
+                continue;
+            }
+            results.push_back(record);
+            record = nullptr;
+        }
+        delete[] record;
+
+        LOG_DEBUG("Selected %d latest records from %s", results.size(), table_name);
+        return results;
+    }
+
+    // Walk back from the newest slot, stopping as soon as enough records match
+    LoDbRingScan scan;
+    table->ring->beginScan(scan, true);
+    lodb_uuid_t uuid;
+    uint32_t length;
+    uint8_t *record = nullptr;
+    while (results.size() < count && table->ring->nextScan(scan, &uuid, &length)) {
+        if (isExpired(table, uuid)) {
+            continue;
+        }
+        if (!record) {
+            record = new uint8_t[table->record_size];
+        }
+        LoDbError err = decodeRecord(table, scan.file, length, record);
+        if (err != LODB_OK) {
+            LOG_WARN("Failed to decode ring record " LODB_UUID_FMT, LODB_UUID_ARGS(uuid));
+            *error_out = err;
+            continue;
+        }
+        if (filter && !filter(record)) {
+            continue;
+        }
+        results.push_back(record);
+        record = nullptr;
+    }
+    table->ring->endScan(scan);
+    delete[] record;
+
+    LOG_DEBUG("Selected %d latest records from %s", results.size(), table_name);
+    return results;
+}
+
+// Free a vector of records returned by select()
+void LoDb::freeRecords(std::vector<void *> &records)
+{
+    for (auto *recordPtr : records) {
+        delete[] (uint8_t *)recordPtr;
+    }
+    records.clear();
+}
+
+// Count records in a table with optional filtering
+int LoDb::count(const char *table_name, LoDbFilter filter)
+{
+    uint32_t started = LODB_STATS_NOW();
+    int count = countRecords(table_name, filter);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_COUNT, started, count < 0 ? -1 : LODB_OK);
+    return count;
+}
+
+int LoDb::countRecords(const char *table_name, LoDbFilter filter)
+{
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return -1;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not found: %s", table_name);
+        return -1;
+    }
+
+    if (applyLog(table) != LODB_OK) {
+        LOG_ERROR("Failed to apply write-ahead log before counting %s", table_name);
+        return -1;
+    }
+
+    int count = 0;
+
+    // Expired records that weren't swept yet don't count
+    int expired = !filter && table->expiry ? (int)table->expiry->expiredCount(getTime()) : 0;
+
+    // Segment log and ring tables keep every live UUID in memory
+    if (!filter && (table->segment_log || table->ring)) {
+        count = (int)(table->segment_log ? table->segment_log->size() : table->ring->size());
+        LOG_DEBUG("Counted %d records in %s (no filter)", count, table_name);
+        return count - expired;
+    }
+
+    // Files tables maintain their row count, so the directory is only walked when it is unknown
+    if (!filter) {
+        if (table->keys_loaded) {
+            count = (int)table->keys.size();
+            LOG_DEBUG("Counted %d records in %s (key directory)", count, table_name);
+            return count - expired;
+        }
+        if (table->row_count_known) {
+            count = (int)table->row_count;
+            LOG_DEBUG("Counted %d records in %s (row count)", count, table_name);
+            return count - expired;
+        }
+
+        // Count .pr files
+        LoDbRecordWalk walk;
+        if (walk.open(table->table_path, table->options.layout, tableIo(table)) != LODB_OK) {
+            LOG_ERROR("Table path is not a directory: %s", table->table_path);
+            return -1;
+        }
+        lodb_uuid_t uuid;
+        while (walk.next(nullptr, &uuid)) {
+            count++;
+        }
+
+        table->row_count = count;
+        table->row_count_known = true;
+        saveRowCount(table);
+        LOG_DEBUG("Counted %d records in %s (no filter)", count, table_name);
+        return count - expired;
+    }
+
+    // Filter provided - need to load records to check them
+    // Stream them through a cursor, reusing one record buffer
+    uint8_t *record_buffer = new uint8_t[table->record_size];
+    LoDbCursor cursor = scan(table_name, filter);
+    while (cursor.next(record_buffer)) {
+        count++;
+    }
+    delete[] record_buffer;
+
+    LOG_DEBUG("Counted %d records in %s (with filter)", count, table_name);
+    return count;
+}
+
+// Count records matching a declarative predicate
+int LoDb::count(const char *table_name, const LoDbWhere &where, LoDbFilter filter)
+{
+    uint32_t started = LODB_STATS_NOW();
+    int count = countRecords(table_name, where, filter);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_COUNT, started, count < 0 ? -1 : LODB_OK);
+    return count;
+}
+
+int LoDb::countRecords(const char *table_name, const LoDbWhere &where, LoDbFilter filter)
+{
+    if (where.empty()) {
+        return countRecords(table_name, filter);
+    }
+
+    if (!table_name || !getTable(table_name)) {
+        LOG_ERROR("Table not found: %s", table_name ? table_name : "(null)");
+        return -1;
+    }
+
+    // Skipping through the cursor only decodes rows when a filter needs them
+    LoDbCursor cursor = scan(table_name, where, filter);
+    if (!cursor.where.bound) {
+        return -1;
+    }
+    int count = (int)cursor.skip(SIZE_MAX);
+    LOG_DEBUG("Counted %d records in %s (where)", count, table_name);
+    return count;
+}
+
+// Truncate a table - delete all records but keep the table registered
+LoDbError LoDb::truncate(const char *table_name)
+{
+    uint32_t started = LODB_STATS_NOW();
+    LoDbError err = truncateTable(table_name);
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_TRUNCATE, started, err);
+    return err;
+}
+
+LoDbError LoDb::truncateTable(const char *table_name)
+{
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not registered: %s", table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    // Logged records are going away too, durably before storage is touched
+    if (wal) {
+        LoDbError err = wal->discard(table_name);
+        if (err != LODB_OK) {
+            LOG_WARN("Failed to discard logged records during truncate: %s", table_name);
+            return err;
+        }
+    }
+
+    if (record_cache) {
+        record_cache->eraseTable(table);
+    }
+
+    // Every record is going away, so every index entry goes with it; the empty snapshot
+    // keeps the index on disk for registerTable() to reopen
+    std::vector<LoDbIndex::Entry> no_entries;
+    for (auto &entry : table->indexes) {
+        if (entry.second->clear() != LODB_OK || entry.second->rebuild(no_entries) != LODB_OK) {
+            LOG_WARN("Failed to clear index on field %d during truncate", entry.first);
+        }
+    }
+    if (table->expiry) {
+        table->expiry->reset();
+    }
+
+    // Segment log tables drop all of their segments
+    if (table->segment_log) {
+        size_t deletedCount = table->segment_log->size();
+        LoDbError err = table->segment_log->clear();
+        if (err != LODB_OK) {
+            LOG_WARN("Failed to remove all segments during truncate: %s", table->table_path);
+            return err;
+        }
+        LOG_INFO("Truncated table %s: deleted %d records", table_name, deletedCount);
+        return LODB_OK;
+    }
+
+    // Ring tables clear their slots and keep the preallocated file
+    if (table->ring) {
+        size_t deletedCount = table->ring->size();
+        LoDbError err = table->ring->clear();
+        if (err != LODB_OK) {
+            LOG_WARN("Failed to clear ring during truncate: %s", table->table_path);
+            return err;
+        }
+        LOG_INFO("Truncated table %s: deleted %d records", table_name, deletedCount);
+        return LODB_OK;
+    }
+
+    // Open table directory
+    File dir = lodb_open(table->table_path, FILE_O_READ, tableIo(table));
+    if (!dir) {
+        LOG_DEBUG("Table directory not found: %s (already empty)", table->table_path);
+        return LODB_OK; // Table is already empty
+    }
+
+    if (!dir.isDirectory()) {
+        LOG_ERROR("Table path is not a directory: %s", table->table_path);
+        dir.close();
+        return LODB_ERR_INVALID;
+    }
+    dir.close();
+
+    // Delete all files of the table directory, then those of its shard directories (which are kept)
+    int deletedCount = 0;
+    int failedCount = 0;
+    std::vector<std::string> shards;
+    removeDirectoryFiles(table->table_path, &deletedCount, &failedCount, &shards, tableIo(table));
+    for (const std::string &shard : shards) {
+        char shard_path[192];
+        snprintf(shard_path, sizeof(shard_path), "%s/%s", table->table_path, shard.c_str());
+        removeDirectoryFiles(shard_path, &deletedCount, &failedCount, nullptr, tableIo(table));
+    }
+
+    // Every record file is gone, so the key directory is trivially up to date (rebuilt lazily if some remain)
+    table->keys.clear();
+    table->keys_loaded = table->options.key_directory && failedCount == 0;
+    table->row_count = 0;
+    table->row_count_known = failedCount == 0;
+    table->row_count_saved = false; // _meta went with the record files
+    if (table->bloom) {
+        table->bloom->clear();
+        table->bloom_ready = failedCount == 0;
+    }
+
+    LOG_INFO("Truncated table %s: deleted %d records", table_name, deletedCount);
+    return LODB_OK;
+}
+
+// Drop a table - delete all records and unregister the table
+LoDbError LoDb::drop(const char *table_name)
+{
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return LODB_ERR_INVALID;
+    }
+
+    // Check if table exists
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not registered: %s", table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    // Truncate first (delete all records)
+    LoDbError err = truncateTable(table_name);
+    if (err != LODB_OK) {
+        LOG_WARN("Failed to truncate table before drop: %s", table_name);
+        // Continue anyway to try to remove directory and unregister
+    }
+
+    // Remove table directory (recursively to ensure cleanup even if truncate didn't remove everything)
+    if (LoFS::rmdir(table->table_path, true)) {
+        LOG_DEBUG("Removed table directory: %s", table->table_path);
+    } else {
+        LOG_WARN("Failed to remove table directory: %s", table->table_path);
+    }
+
+    // Remove from tables map (nothing left to save the row count or Bloom filter into)
+    table->row_count_known = false;
+    table->bloom_ready = false;
+    releaseTable(table);
+    tables.erase(table_name);
+
+    LOG_INFO("Dropped table: %s", table_name);
+    return LODB_OK;
+}
+
+// Compact a segment log table
+LoDbError LoDb::compact(const char *table_name)
+{
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not registered: %s", table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    if (!table->segment_log) {
+        LOG_DEBUG("Table %s does not use a segment log, nothing to compact", table_name);
+        return LODB_OK;
+    }
+
+    LoDbError err = applyLog(table);
+    if (err != LODB_OK) {
+        return err;
+    }
+    return table->segment_log->compact();
+}
+
+// Delete the expired records of a TTL table
+LoDbError LoDb::sweepExpired(const char *table_name, uint32_t budget_ms, size_t *swept_out)
+{
+    if (swept_out) {
+        *swept_out = 0;
+    }
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not registered: %s", table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    size_t swept = 0;
+    LoDbError err = sweepTable(table, millis(), budget_ms, &swept);
+    if (swept_out) {
+        *swept_out = swept;
+    }
+    return err;
+}
+
+// Delete the expired records of every TTL table
+LoDbError LoDb::sweepAllExpired(uint32_t budget_ms, size_t *swept_out)
+{
+    uint32_t started = millis();
+    size_t swept = 0;
+    LoDbError err = LODB_OK;
+    for (auto &entry : tables) {
+        err = sweepTable(&entry.second, started, budget_ms, &swept);
+        if (err != LODB_OK) {
+            break;
+        }
+    }
+    if (swept_out) {
+        *swept_out = swept;
+    }
+    return err;
+}
+
+LoDbError LoDb::sweepTable(TableMetadata *table, uint32_t started, uint32_t budget_ms, size_t *swept)
+{
+    if (!table->expiry) {
+        return LODB_OK;
+    }
+
+    LoDbIndex *index = getIndex(table, table->options.ttl_field);
+    std::vector<LoDbIndex::Entry> expired;
+    size_t deleted = 0;
+    LoDbError result = LODB_OK;
+
+    while (result == LODB_OK) {
+        uint32_t now = getTime();
+        if (budget_ms > 0 && millis() - started >= budget_ms) {
+            result = table->expiry->expiredCount(now) > 0 ? LODB_ERR_BUSY : LODB_OK;
+            break;
+        }
+
+        // Earliest expiries first, re-read each round so records deleted by others aren't retried
+        result = table->expiry->findExpired(now, LODB_SWEEP_BATCH, expired);
+        if (result != LODB_OK || expired.empty()) {
+            break;
+        }
+
+        for (const LoDbIndex::Entry &entry : expired) {
+            // Deleting the record drops its index and expiry entries along with it
+            LoDbError err = removeRecord(table->table_name.c_str(), entry.uuid);
+            if (err == LODB_OK) {
+                deleted++;
+            } else if (err == LODB_ERR_NOT_FOUND) {
+                // The record was already gone: drop the stale entry, so it isn't found again
+                if (index->remove(entry.key, entry.uuid, true) == LODB_OK) { // Just found in the index
+                    table->expiry->removed(entry.key, entry.uuid);
+                }
+            } else {
+                result = err;
+                break;
+            }
+            if (budget_ms > 0 && millis() - started >= budget_ms) {
+                break;
+            }
+        }
+    }
+
+    if (deleted > 0) {
+        LOG_INFO("Swept %d expired records from %s", deleted, table->table_name.c_str());
+    }
+    *swept += deleted;
+    return result;
+}
+
+// Flush write-ahead log appends waiting for a group commit
+void LoDb::sync()
+{
+    if (wal) {
+        wal->sync(true);
+    }
+}
+
+// Apply the write-ahead log to table storage
+LoDbError LoDb::checkpoint()
+{
+    if (!wal) {
+        return LODB_OK;
+    }
+
+    // Logged records must be durable before storage changes on their behalf
+    wal->sync(true);
+
+    LoDbError result = LODB_OK;
+    std::set<std::string> applied;
+    for (const std::string &name : wal->tableNames()) {
+        auto it = tables.find(name);
+        if (it == tables.end()) {
+            LOG_DEBUG("Keeping logged records of unregistered table %s", name.c_str());
+            continue;
+        }
+
+        LoDbError err = applyLogged(&it->second);
+        if (err != LODB_OK) {
+            LOG_ERROR("Failed to apply logged records to %s", name.c_str());
+            result = err;
+            continue;
+        }
+        applied.insert(name);
+    }
+
+    if (!applied.empty()) {
+        LoDbError err = wal->reset(applied);
+        if (err != LODB_OK && result == LODB_OK) {
+            result = err;
+        }
+    }
+
+    wal_checkpointed = wal->size();
+    LOG_DEBUG("Checkpoint of %s applied %d tables", db_path, applied.size());
+    return result;
+}
+
+LoDbCacheStats LoDb::getCacheStats() const
+{
+    if (!record_cache) {
+        LoDbCacheStats stats = {};
+        return stats;
+    }
+    return record_cache->stats();
+}
+
+LoDbError LoDb::getStats(meshtastic_LoDBStats *stats_out)
+{
+#if LODB_STATS
+    if (!stats_out) {
+        return LODB_ERR_INVALID;
+    }
+
+    memset(stats_out, 0, sizeof(*stats_out));
+    snprintf(stats_out->db_name, sizeof(stats_out->db_name), "%s", db_name.c_str());
+
+    LoDbTableCounters totals;
+    for (auto &entry : tables) {
+        totals.add(entry.second.stats);
+
+        // Tables past the message's capacity still count towards the totals
+        if (stats_out->tables_count >= sizeof(stats_out->tables) / sizeof(stats_out->tables[0])) {
+            stats_out->tables_omitted++;
+            continue;
+        }
+        meshtastic_LoDBTableStats &table_stats = stats_out->tables[stats_out->tables_count++];
+        snprintf(table_stats.name, sizeof(table_stats.name), "%s", entry.first.c_str());
+        entry.second.stats.fill(&table_stats);
+    }
+    totals.addIo(wal_io);
+
+    stats_out->has_totals = true;
+    totals.fill(&stats_out->totals);
+    return LODB_OK;
+#else
+    return LODB_ERR_INVALID;
+#endif
+}
+
+LoDbError LoDb::getTableStats(const char *table_name, meshtastic_LoDBTableStats *stats_out)
+{
+#if LODB_STATS
+    TableMetadata *table = table_name ? getTable(table_name) : nullptr;
+    if (!table || !stats_out) {
+        return LODB_ERR_INVALID;
+    }
+
+    memset(stats_out, 0, sizeof(*stats_out));
+    snprintf(stats_out->name, sizeof(stats_out->name), "%s", table_name);
+    table->stats.fill(stats_out);
+    return LODB_OK;
+#else
+    return LODB_ERR_INVALID;
+#endif
+}
+
+void LoDb::resetStats()
+{
+#if LODB_STATS
+    for (auto &entry : tables) {
+        entry.second.stats = LoDbTableCounters();
+    }
+    wal_io = LoDbIoCounters();
+#endif
+}
+
+void LoDb::recordOperation(const char *table_name, meshtastic_LoDBOperation operation, uint32_t started, int error)
+{
+#if LODB_STATS
+    // Calls on unregistered tables have nowhere to be counted
+    auto it = table_name ? tables.find(table_name) : tables.end();
+    if (it != tables.end()) {
+        it->second.stats.record(operation, error, micros() - started);
+    }
+#endif
+}
+
+LoDbIoCounters *LoDb::tableIo(TableMetadata *table)
+{
+#if LODB_STATS
+    return &table->stats.io;
+#else
+    return nullptr;
+#endif
+}
+
+LoDbError LoDb::logWrite(TableMetadata *table, lodb_uuid_t uuid, const uint8_t *data, size_t length)
+{
+    LoDbError err = data ? wal->put(table->table_name.c_str(), uuid, data, length) : wal->remove(table->table_name.c_str(), uuid);
+    if (err != LODB_OK) {
+        return err;
+    }
+
+    if (wal->size() - wal_checkpointed >= options.wal_checkpoint_bytes) {
+        checkpoint(); // The write is already safe in the log, a failed checkpoint is retried later
+    }
+    return LODB_OK;
+}
+
+LoDbError LoDb::applyLog(TableMetadata *table)
+{
+    if (!wal || !wal->entries(table->table_name)) {
+        return LODB_OK;
+    }
+    return checkpoint();
+}
+
+LoDbError LoDb::applyLogged(TableMetadata *table)
+{
+    const LoDbWal::TableEntries *entries = wal->entries(table->table_name);
+    if (!entries) {
+        return LODB_OK;
+    }
+
+    // Applying is idempotent, so a crash part way replays the same records next time
+    std::vector<uint8_t> buffer;
+    char file_path[192];
+    LoDbError result = LODB_OK;
+
+    if (table->segment_log) {
+        table->segment_log->beginBatch();
+    } else if (table->ring) {
+        table->ring->beginBatch();
+    } else {
+        LoFS::mkdir(table->table_path);
+        invalidateRowCount(table);
+        invalidateBloom(table);
+    }
+
+    for (auto &record : *entries) {
+        lodb_uuid_t uuid = record.first;
+        const LoDbWal::Entry &entry = record.second;
+
+        recordPath(table, uuid, file_path, sizeof(file_path));
+
+        if (entry.deleted) {
+            if (table->segment_log) {
+                if (table->segment_log->contains(uuid)) {
+                    result = table->segment_log->remove(uuid);
+                }
+            } else if (table->ring) {
+                if (table->ring->contains(uuid)) {
+                    result = table->ring->remove(uuid);
+                }
+            } else if (LoFS::remove(file_path)) { // Already gone if the delete was applied before
+                removeKey(table, uuid);
+                adjustRowCount(table, -1);
+            }
+        } else {
+            buffer.resize(entry.length);
+            result = wal->read(entry, buffer.data(), buffer.size());
+            if (result != LODB_OK) {
+                break;
+            }
+
+            if (!table->segment_log && !table->ring) {
+                ensureShard(table, uuid);
+            }
+
+            if (table->segment_log) {
+                result = table->segment_log->append(uuid, buffer.data(), entry.length);
+            } else if (table->ring) {
+                result = appendRing(table, uuid, buffer.data(), entry.length);
+            } else if (table->options.update_mode == LODB_UPDATE_RENAME) {
+                bool existed = table->row_count_known && LoFS::exists(file_path); // Only needed to keep the count
+                result = replaceRecordFile(table, file_path, buffer.data(), nullptr, entry.length);
+                if (result == LODB_OK) {
+                    addKey(table, uuid);
+                    adjustRowCount(table, existed ? 0 : 1);
+                }
+            } else {
+                bool existed = LoFS::remove(file_path);
+                auto file = lodb_open(file_path, FILE_O_WRITE, tableIo(table));
+                bool opened = (bool)file;
+                size_t written = 0;
+                if (opened) {
+                    written = lodb_write(file, buffer.data(), entry.length, tableIo(table));
+                    file.close();
+                }
+                if (opened && written == entry.length) {
+                    addKey(table, uuid);
+                    adjustRowCount(table, existed ? 0 : 1);
+                } else {
+                    LOG_ERROR("Failed to write file: %s", file_path);
+                    adjustRowCount(table, existed ? -1 : 0);
+                    result = LODB_ERR_IO;
+                }
+            }
+        }
+
+        if (result != LODB_OK) {
+            break;
+        }
+    }
+
+    if (table->segment_log) {
+        table->segment_log->endBatch();
+    } else if (table->ring) {
+        table->ring->endBatch();
+    }
+
+    LOG_DEBUG("Applied %d logged records to %s", entries->size(), table->table_name.c_str());
+    return result;
+}
+
+LoDbIndex *LoDb::getIndex(TableMetadata *table, pb_size_t field_tag)
+{
+    auto it = table->indexes.find(field_tag);
+    return it == table->indexes.end() ? nullptr : it->second;
+}
+
+bool LoDb::isExpired(TableMetadata *table, lodb_uuid_t uuid)
+{
+    return table->expiry && table->expiry->isExpired(uuid, getTime());
+}
+
+uint8_t *LoDb::readIndexedRecord(TableMetadata *table, lodb_uuid_t uuid)
+{
+    if (table->indexes.empty()) {
+        return nullptr;
+    }
+
+    uint8_t *record = new uint8_t[table->record_size];
+    if (fetchRecord(table, uuid, record) != LODB_OK) {
+        LOG_WARN("Failed to read indexed record " LODB_UUID_FMT ", its old index entries are kept", LODB_UUID_ARGS(uuid));
+        delete[] record;
+        return nullptr;
+    }
+    return record;
+}
+
+void LoDb::updateIndexes(TableMetadata *table, lodb_uuid_t uuid, const void *old_record, const void *new_record, bool inserted)
+{
+    for (auto &entry : table->indexes) {
+        int64_t old_key = 0;
+        int64_t new_key = 0;
+        LoDbFixedType fixed_type = fixedFieldType(table->fixed_fields.data(), table->fixed_fields.size(), entry.first);
+        bool had_key = old_record && readIndexKey(table->pb_descriptor, fixed_type, old_record, entry.first, &old_key);
+        bool has_key = new_record && readIndexKey(table->pb_descriptor, fixed_type, new_record, entry.first, &new_key);
+
+        if (had_key && has_key && old_key == new_key) {
+            continue; // Indexed field unchanged
+        }
+
+        // The expiry tracker follows the TTL field's index
+        LoDbExpiry *expiry = entry.first == table->options.ttl_field ? table->expiry : nullptr;
+        LoDbError err = LODB_OK;
+        if (had_key) {
+            err = entry.second->remove(old_key, uuid, true); // The old version's entry was indexed with it
+            if (err == LODB_OK && expiry) {
+                expiry->removed(old_key, uuid);
+            }
+        }
+        if (has_key && err == LODB_OK) {
+            // A record has one entry per index, so a new UUID or a moved key can't be indexed yet
+            err = entry.second->add(new_key, uuid, inserted || had_key);
+            if (err == LODB_OK && expiry) {
+                expiry->added(new_key, uuid);
+            }
+        }
+        if (err != LODB_OK) {
+            LOG_WARN("Failed to update index on field %d for " LODB_UUID_FMT, entry.first, LODB_UUID_ARGS(uuid));
+        }
+    }
+}
+
+// Build a compression dictionary from a sample of a table's records
+LoDbError LoDb::trainDictionary(const char *table_name, uint8_t *dictionary_out, size_t capacity, size_t *size_out,
+                                size_t max_samples)
+{
+    if (!table_name || !dictionary_out || !size_out) {
+        return LODB_ERR_INVALID;
+    }
+    *size_out = 0;
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        return LODB_ERR_INVALID;
+    }
+
+    // Samples are re-encoded from decoded records, so records stored compressed or plain count alike
+    std::vector<std::vector<uint8_t>> samples;
+    uint8_t *record = new uint8_t[table->record_size];
+    LoDbCursor cursor = scan(table_name);
+    while (samples.size() < max_samples && cursor.next(record)) {
+        size_t encoded_size;
+        if (!pb_get_encoded_size(&encoded_size, table->pb_descriptor, record)) {
+            continue;
+        }
+        samples.emplace_back(encoded_size);
+        pb_ostream_t stream = pb_ostream_from_buffer(samples.back().data(), encoded_size);
+        if (!pb_encode(&stream, table->pb_descriptor, record)) {
+            samples.pop_back();
+        }
+    }
+    cursor.close();
+    delete[] record;
+
+    *size_out = LoDbCodec::train(samples, dictionary_out, capacity);
+    LOG_INFO("Trained %d byte dictionary for %s from %d records", *size_out, table_name, samples.size());
+    return LODB_OK;
+}
+
+// Create or reopen a secondary index on a field
+LoDbError LoDb::createIndex(const char *table_name, pb_size_t field_tag)
+{
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not registered: %s", table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    if (getIndex(table, field_tag)) {
+        return LODB_OK; // Already maintained
+    }
+
+    // Only bool, enum and integer fields can be indexed, fixed-width ones once declared
+    LoDbFixedType fixed_type = fixedFieldType(table->fixed_fields.data(), table->fixed_fields.size(), field_tag);
+    uint8_t *probe = new uint8_t[table->record_size];
+    pb_field_iter_t iter;
+    bool indexable = findIndexField(table->pb_descriptor, fixed_type, probe, field_tag, &iter);
+    delete[] probe;
+    if (!indexable) {
+        LOG_ERROR("Field %d of table %s cannot be indexed (float, double and undeclared fixed-width fields can't)", field_tag,
+                  table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    // Index files live in a subdirectory that record scans and truncate() skip
+    char index_dir[192];
+    char index_name[8];
+    snprintf(index_dir, sizeof(index_dir), "%s/_idx", table->table_path);
+    snprintf(index_name, sizeof(index_name), "%u", (unsigned)field_tag);
+    LoFS::mkdir(index_dir);
+
+    LoDbIndex *index = new LoDbIndex(index_dir, index_name);
+    index->setIoCounters(tableIo(table));
+    bool existed = index->exists();
+    LoDbError err = existed ? index->open() : LODB_ERR_NOT_FOUND;
+
+    // New or unreadable index: build it from one pass over the table
+    if (err != LODB_OK) {
+        std::vector<LoDbIndex::Entry> entries;
+        uint8_t *record_buffer = new uint8_t[table->record_size];
+        lodb_uuid_t uuid;
+        LoDbCursor cursor = scan(table_name);
+        while (cursor.next(record_buffer, &uuid)) {
+            int64_t key;
+            if (readIndexKey(table->pb_descriptor, fixed_type, record_buffer, field_tag, &key)) {
+                entries.push_back({key, uuid});
+            }
+        }
+        delete[] record_buffer;
+
+        index->clear();
+        err = index->rebuild(entries);
+        if (err != LODB_OK) {
+            LOG_ERROR("Failed to build index on field %d of table %s", field_tag, table_name);
+            delete index;
+            return err;
+        }
+        LOG_INFO("Built index on field %d of table %s: %d entries", field_tag, table_name, index->size());
+    } else {
+        LOG_INFO("Opened index on field %d of table %s: %d entries", field_tag, table_name, index->size());
+    }
+
+    table->indexes[field_tag] = index;
+    return LODB_OK;
+}
+
+// Remove a secondary index and its files
+LoDbError LoDb::dropIndex(const char *table_name, pb_size_t field_tag)
+{
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        LOG_ERROR("Table not registered: %s", table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    LoDbIndex *index = getIndex(table, field_tag);
+    if (!index) {
+        return LODB_ERR_NOT_FOUND;
+    }
+    if (table->expiry && field_tag == table->options.ttl_field) {
+        LOG_ERROR("Index on field %d of table %s tracks record expiry", field_tag, table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    LoDbError err = index->clear();
+    delete index;
+    table->indexes.erase(field_tag);
+    LOG_INFO("Dropped index on field %d of table %s", field_tag, table_name);
+    return err;
+}
+
+// Find UUIDs whose indexed field equals a value
+LoDbError LoDb::findEq(const char *table_name, pb_size_t field_tag, int64_t value, std::vector<lodb_uuid_t> &uuids_out)
+{
+    return findRange(table_name, field_tag, value, value, uuids_out);
+}
+
+// Find UUIDs whose indexed field is within a range
+LoDbError LoDb::findRange(const char *table_name, pb_size_t field_tag, int64_t min_value, int64_t max_value,
+                          std::vector<lodb_uuid_t> &uuids_out)
+{
+    uuids_out.clear();
+
+    if (!table_name) {
+        LOG_ERROR("Invalid table_name");
+        return LODB_ERR_INVALID;
+    }
+
+    TableMetadata *table = getTable(table_name);
+    if (!table) {
+        return LODB_ERR_INVALID;
+    }
+
+    LoDbIndex *index = getIndex(table, field_tag);
+    if (!index) {
+        LOG_ERROR("No index on field %d of table %s", field_tag, table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    std::vector<LoDbIndex::Entry> entries;
+    LoDbError err = index->find(min_value, max_value, entries);
+    if (err != LODB_OK) {
+        return err;
+    }
+
+    uuids_out.reserve(entries.size());
+    for (const LoDbIndex::Entry &entry : entries) {
+        if (!isExpired(table, entry.uuid)) {
+            uuids_out.push_back(entry.uuid);
+        }
+    }
+    return LODB_OK;
+}
+
+// Select records through a secondary index
+std::vector<void *> LoDb::selectByIndex(const char *table_name, pb_size_t field_tag, int64_t min_value, int64_t max_value,
+                                        LoDbFilter filter, size_t limit)
+{
+    uint32_t started = LODB_STATS_NOW();
+    std::vector<void *> results;
+
+    std::vector<lodb_uuid_t> uuids;
+    LoDbError err = findRange(table_name, field_tag, min_value, max_value, uuids);
+    if (err != LODB_OK) {
+        recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_SELECT, started, err);
+        return results;
+    }
+
+    // Only the matching records are read
+    size_t record_size = getTable(table_name)->record_size;
+    uint8_t *record_buffer = new uint8_t[record_size];
+    for (lodb_uuid_t uuid : uuids) {
+        if (limit > 0 && results.size() >= limit) {
+            break;
+        }
+        LoDbError read_err = readRecord(table_name, uuid, record_buffer);
+        if (read_err != LODB_OK) {
+            // The other records are still returned, the failure is reported alongside them
+            LOG_WARN("Indexed record " LODB_UUID_FMT " could not be read", LODB_UUID_ARGS(uuid));
+            err = read_err;
+            continue;
+        }
+        if (filter && !filter(record_buffer)) {
+            continue;
+        }
+        results.push_back(record_buffer);
+        record_buffer = new uint8_t[record_size];
+    }
+    delete[] record_buffer;
+
+    LOG_INFO("Select from %s by index on field %d: %d of %d indexed records returned", table_name, field_tag, results.size(),
+             uuids.size());
+    recordOperation(table_name, meshtastic_LoDBOperation_LODB_OP_SELECT, started, err);
+    return results;
+}
+
+// LoDbCursor Implementation
+
+LoDbCursor::LoDbCursor() : db(nullptr), table(nullptr), segment_scan(nullptr), ring_scan(nullptr) {}
+
+LoDbCursor::LoDbCursor(LoDbCursor &&other) : db(nullptr), table(nullptr), segment_scan(nullptr), ring_scan(nullptr)
+{
+    *this = std::move(other);
+}
+
+LoDbCursor &LoDbCursor::operator=(LoDbCursor &&other)
+{
+    if (this != &other) {
+        close();
+        db = other.db;
+        table = other.table;
+        filter = std::move(other.filter);
+        where = std::move(other.where);
+        walk = std::move(other.walk);
+        segment_scan = other.segment_scan;
+        ring_scan = other.ring_scan;
+
+        // Ownership of the open directory, segment or ring file moves with the cursor
+        other.table = nullptr;
+        other.segment_scan = nullptr;
+        other.ring_scan = nullptr;
+    }
+    return *this;
+}
+
+LoDbCursor::~LoDbCursor()
+{
+    close();
+}
+
+void LoDbCursor::close()
+{
+    if (segment_scan) {
+        if (table) {
+            table->segment_log->endScan(*segment_scan);
+        }
+        delete segment_scan;
+        segment_scan = nullptr;
+    }
+    if (ring_scan) {
+        if (table) {
+            table->ring->endScan(*ring_scan);
+        }
+        delete ring_scan;
+        ring_scan = nullptr;
+    }
+
+    walk.close();
+    table = nullptr;
+}
+
+bool LoDbCursor::next(void *record_out, lodb_uuid_t *uuid_out)
+{
+    if (!table || !record_out) {
+        return false;
+    }
+
+    lodb_uuid_t uuid;
+    while (readNext(record_out, &uuid)) {
+        // Apply filter if provided
+        if (filter && !filter(record_out)) {
+            LOG_DEBUG("Record " LODB_UUID_FMT " filtered out", LODB_UUID_ARGS(uuid));
+            continue;
+        }
+
+        if (uuid_out) {
+            *uuid_out = uuid;
+        }
+        return true;
+    }
+
+    close();
+    return false;
+}
+
+size_t LoDbCursor::skip(size_t count)
+{
+    if (!table) {
+        return 0;
+    }
+
+    size_t skipped = 0;
+
+    // A filter can only be evaluated on decoded records
+    if (filter) {
+        uint8_t *scratch = new uint8_t[table->record_size];
+        while (skipped < count && next(scratch)) {
+            skipped++;
+        }
+        delete[] scratch;
+        return skipped;
+    }
+
+    // A where clause only needs the encoded bytes
+    lodb_uuid_t uuid;
+    if (!where.empty()) {
+        while (skipped < count && readNext(nullptr, &uuid)) {
+            skipped++;
+        }
+        if (skipped < count) {
+            close();
+        }
+        return skipped;
+    }
+
+    // Otherwise just step over directory entries, segment frames or ring slots
+    uint32_t length;
+    while (skipped < count) {
+        bool found = segment_scan || ring_scan ? nextPayload(&uuid, &length) : walk.next(nullptr, &uuid);
+        if (!found) {
+            close();
+            break;
+        }
+        if (db->isExpired(table, uuid)) {
+            continue;
+        }
+        skipped++;
+    }
+    return skipped;
+}
+
+bool LoDbCursor::readNext(void *record_out, lodb_uuid_t *uuid_out)
+{
+    return segment_scan || ring_scan ? readNextPayload(record_out, uuid_out) : readNextFile(record_out, uuid_out);
+}
+
+bool LoDbCursor::nextPayload(lodb_uuid_t *uuid_out, uint32_t *length_out)
+{
+    return segment_scan ? table->segment_log->nextScan(*segment_scan, uuid_out, length_out)
+                        : table->ring->nextScan(*ring_scan, uuid_out, length_out);
+}
+
+bool LoDbCursor::readNextPayload(void *record_out, lodb_uuid_t *uuid_out)
+{
+    uint32_t length;
+
+    while (nextPayload(uuid_out, &length)) {
+        File &file = segment_scan ? segment_scan->file : ring_scan->file;
+
+        // Expired records are passed over without reading them
+        if (db->isExpired(table, *uuid_out)) {
+            continue;
+        }
+
+        // Without a where clause the payload is decoded straight from the segment or slot
+        if (where.empty() && record_out) {
+            if (db->decodeRecord(table, file, length, record_out) != LODB_OK) {
+                LOG_WARN("Failed to decode record " LODB_UUID_FMT " during scan", LODB_UUID_ARGS(*uuid_out));
+                continue;
+            }
+            return true;
+        }
+
+        buffer.resize(length);
+        if (lodb_read(file, buffer.data(), length, LoDb::tableIo(table)) != length) {
+            LOG_WARN("Failed to read record " LODB_UUID_FMT " during scan", LODB_UUID_ARGS(*uuid_out));
+            continue;
+        }
+
+        // Reject on the encoded bytes before paying for a decode (compressed records are expanded first)
+        if (!where.empty()) {
+            if (db->unpackRecord(table, buffer) != LODB_OK) {
+                LOG_WARN("Failed to decode record " LODB_UUID_FMT " during scan", LODB_UUID_ARGS(*uuid_out));
+                continue;
+            }
+            if (!where.matches(buffer.data(), buffer.size())) {
+                continue;
+            }
+        }
+        if (!record_out) {
+            return true;
+        }
+
+        if (db->decodeRecord(table, buffer.data(), buffer.size(), record_out) != LODB_OK) {
+            LOG_WARN("Failed to decode record " LODB_UUID_FMT " during scan", LODB_UUID_ARGS(*uuid_out));
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool LoDbCursor::readNextFile(void *record_out, lodb_uuid_t *uuid_out)
+{
+    File file;
+
+    // Read and decode straight from the entry returned by the directory iterator
+    while (walk.next(&file, uuid_out)) {
+        if (db->isExpired(table, *uuid_out)) {
+            file.close();
+            continue;
+        }
+
+        size_t size = file.size();
+        if (size == 0) {
+            file.close();
+            LOG_WARN("Failed to read record " LODB_UUID_FMT " during scan", LODB_UUID_ARGS(*uuid_out));
+            continue;
+        }
+
+        // Without a where clause there is nothing to check on the encoded bytes
+        if (where.empty() && record_out) {
+            LoDbError err = db->decodeRecord(table, file, size, record_out);
+            file.close();
+            if (err != LODB_OK) {
+                LOG_WARN("Failed to decode record " LODB_UUID_FMT " during scan", LODB_UUID_ARGS(*uuid_out));
+                continue;
+            }
+            return true;
+        }
+
+        buffer.resize(size);
+        size = lodb_read(file, buffer.data(), size, LoDb::tableIo(table));
+        file.close();
+        if (size != buffer.size()) {
+            LOG_WARN("Failed to read record " LODB_UUID_FMT " during scan", LODB_UUID_ARGS(*uuid_out));
+            continue;
+        }
+
+        // Reject on the encoded bytes before paying for a decode (compressed records are expanded first)
+        if (!where.empty()) {
+            if (db->unpackRecord(table, buffer) != LODB_OK) {
+                LOG_WARN("Failed to decode record " LODB_UUID_FMT " during scan", LODB_UUID_ARGS(*uuid_out));
+                continue;
+            }
+            if (!where.matches(buffer.data(), buffer.size())) {
+                continue;
+            }
+        }
+        if (!record_out) {
+            return true;
+        }
+
+        if (db->decodeRecord(table, buffer.data(), buffer.size(), record_out) != LODB_OK) {
+            LOG_WARN("Failed to decode record " LODB_UUID_FMT " during scan", LODB_UUID_ARGS(*uuid_out));
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+// LoDbRecordWalk Implementation
+
+LoDbRecordWalk::LoDbRecordWalk() : layout(LODB_LAYOUT_FLAT), root_open(false), shard_open(false), io(nullptr)
+{
+    root_path[0] = '\0';
+}
+
+LoDbRecordWalk::LoDbRecordWalk(LoDbRecordWalk &&other)
+    : layout(LODB_LAYOUT_FLAT), root_open(false), shard_open(false), io(nullptr)
+{
+    *this = std::move(other);
+}
+
+LoDbRecordWalk &LoDbRecordWalk::operator=(LoDbRecordWalk &&other)
+{
+    if (this != &other) {
+        close();
+        memcpy(root_path, other.root_path, sizeof(root_path));
+        layout = other.layout;
+        root = std::move(other.root);
+        shard = std::move(other.shard);
+        root_open = other.root_open;
+        shard_open = other.shard_open;
+        io = other.io;
+
+        other.root_open = false;
+        other.shard_open = false;
+    }
+    return *this;
+}
+
+LoDbRecordWalk::~LoDbRecordWalk()
+{
+    close();
+}
+
+LoDbError LoDbRecordWalk::open(const char *table_path, LoDbLayout table_layout, LoDbIoCounters *io_counters)
+{
+    close();
+    snprintf(root_path, sizeof(root_path), "%s", table_path);
+    layout = table_layout;
+    io = io_counters;
+
+    root = lodb_open(root_path, FILE_O_READ, io);
+    if (!root) {
+        LOG_DEBUG("Table directory not found: %s (no records)", root_path);
+        return LODB_OK;
+    }
+    if (!root.isDirectory()) {
+        root.close();
+        return LODB_ERR_IO;
+    }
+    root_open = true;
+    return LODB_OK;
+}
+
+bool LoDbRecordWalk::next(File *file_out, lodb_uuid_t *uuid_out)
+{
+    while (root_open) {
+        // Flat tables list records in the table directory, sharded ones in the current shard
+        File &dir = layout == LODB_LAYOUT_FLAT ? root : shard;
+        if (layout != LODB_LAYOUT_FLAT && !shard_open) {
+            File entry = lodb_open_next(root, io);
+            if (!entry) {
+                close();
+                return false;
+            }
+
+            uint8_t width;
+            if (entry.isDirectory() && parseShardName(entry.name(), &width) && width == layout) {
+                char shard_path[192];
+                snprintf(shard_path, sizeof(shard_path), "%s/%s", root_path, baseName(entry.name()));
+                shard = lodb_open(shard_path, FILE_O_READ, io);
+                shard_open = (bool)shard;
+            }
+            entry.close();
+            continue;
+        }
+
+        File file = lodb_open_next(dir, io);
+        if (!file) {
+            if (layout == LODB_LAYOUT_FLAT) {
+                close();
+                return false;
+            }
+            shard.close();
+            shard_open = false;
+            continue;
+        }
+
+        // Skip directories and anything that is not a {uuid}.pr record
+        if (file.isDirectory() || !parseRecordFileName(file.name(), uuid_out)) {
+            LOG_DEBUG("Skipped non-record entry: %s", file.name());
+            file.close();
+            continue;
+        }
+
+        if (file_out) {
+            *file_out = std::move(file);
+        } else {
+            file.close();
+        }
+        return true;
+    }
+    return false;
+}
+
+void LoDbRecordWalk::close()
+{
+    if (shard_open) {
+        shard.close();
+        shard_open = false;
+    }
+    if (root_open) {
+        root.close();
+        root_open = false;
+    }
+}
+
+// LoDbResultSet Implementation
+
+LoDbResultSet::LoDbResultSet() : data(nullptr), count(0), capacity(0), record_size(0) {}
+
+LoDbResultSet::LoDbResultSet(const LoDbAllocator &arena_allocator)
+    : allocator(arena_allocator), data(nullptr), count(0), capacity(0), record_size(0)
+{
+}
+
+LoDbResultSet::~LoDbResultSet()
+{
+    clear();
+}
+
+LoDbResultSet::LoDbResultSet(LoDbResultSet &&other) : data(nullptr), count(0), capacity(0), record_size(0)
+{
+    *this = std::move(other);
+}
+
+LoDbResultSet &LoDbResultSet::operator=(LoDbResultSet &&other)
+{
+    if (this != &other) {
+        clear();
+        allocator = other.allocator;
+        data = other.data;
+        count = other.count;
+        capacity = other.capacity;
+        record_size = other.record_size;
+        other.data = nullptr;
+        other.count = 0;
+        other.capacity = 0;
+    }
+    return *this;
+}
+
+void LoDbResultSet::clear()
+{
+    if (data) {
+        release(data);
+        data = nullptr;
+    }
+    count = 0;
+    capacity = 0;
+}
+
+void LoDbResultSet::reset(size_t new_record_size)
+{
+    if (new_record_size != record_size) {
+        clear();
+        record_size = new_record_size;
+    }
+    count = 0;
+}
+
+void *LoDbResultSet::append()
+{
+    if (record_size == 0) {
+        return nullptr;
+    }
+
+    if (count == capacity) {
+        size_t new_capacity = capacity ? capacity * 2 : 8;
+        uint8_t *grown = (uint8_t *)allocate(new_capacity * record_size);
+        if (!grown) {
+            return nullptr;
+        }
+        if (data) {
+            memcpy(grown, data, count * record_size);
+            release(data);
+        }
+        data = grown;
+        capacity = new_capacity;
+    }
+
+    return data + (count++) * record_size;
+}
+
+void LoDbResultSet::arrange(const std::vector<size_t> &order)
+{
+    // Complete order to a full permutation; unlisted slots end up past the new count
+    std::vector<size_t> source(order);
+    std::vector<bool> listed(count, false);
+    for (size_t index : order) {
+        listed[index] = true;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!listed[i]) {
+            source.push_back(i);
+        }
+    }
+
+    // Apply the permutation in place, one cycle at a time, through a single scratch record
+    uint8_t *scratch = new uint8_t[record_size];
+    std::vector<bool> done(count, false);
+    for (size_t start = 0; start < count; start++) {
+        if (done[start] || source[start] == start) {
+            continue;
+        }
+        memcpy(scratch, data + start * record_size, record_size);
+        size_t dest = start;
+        while (true) {
+            done[dest] = true;
+            size_t from = source[dest];
+            if (from == start) {
+                memcpy(data + dest * record_size, scratch, record_size);
+                break;
+            }
+            memcpy(data + dest * record_size, data + from * record_size, record_size);
+            dest = from;
+        }
+    }
+    delete[] scratch;
+
+    count = order.size();
+}
+
+void LoDbResultSet::dropFront(size_t n)
+{
+    if (n >= count) {
+        count = 0;
+        return;
+    }
+    if (n > 0) {
+        memmove(data, data + n * record_size, (count - n) * record_size);
+        count -= n;
+    }
+}
+
+void *LoDbResultSet::allocate(size_t size)
+{
+    return allocator.allocate ? allocator.allocate(size, allocator.context) : malloc(size);
+}
+
+void LoDbResultSet::release(void *ptr)
+{
+    if (allocator.release) {
+        allocator.release(ptr, allocator.context);
+    } else {
+        free(ptr);
+    }
+}
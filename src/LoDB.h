@@ -1,5 +1,6 @@
 #pragma once
 
+#include "LoDBStats.h"
 #include "lofs/src/LoFS.h"
 #include <cstddef>
 #include <cstdint>
@@ -12,21 +13,62 @@
 /**
  * LoDB - Synchronous Protobuf Database
  *
- * A filesystem-based database for protobuf records stored in {prefix}/lodb/<db_name>/<table_name>/<uuid>.pr files.
+ * A filesystem-based database for protobuf records stored in {prefix}/lodb/<db_name>/<table_name>/<uuid>.pr files,
+ * or appended to <table_name>/<segment>.seg files for tables registered with LODB_STORAGE_SEGMENT_LOG.
  * Uses /sd/lodb/... if SD card is available, otherwise /internal/lodb/...
  *
  * SYNCHRONOUS DESIGN:
  * - Single-record operations (get, insert, update, delete) complete immediately
  * - SELECT returns complete result sets as vectors with optional filtering, sorting, and limiting
+ * - SCAN returns a cursor that decodes one record at a time into a caller-provided buffer
  */
 
 // UUID type - 64-bit unsigned integer
 typedef uint64_t lodb_uuid_t;
 
+class LoDb;
+class LoDbCursor;
+class LoDbSegmentLog;
+struct LoDbSegmentScan;
+class LoDbRing;
+struct LoDbRingScan;
+class LoDbIndex;
+class LoDbWal;
+class LoDbBloom;
+class LoDbRecordCache;
+class LoDbCodec;
+class LoDbExpiry;
+
 // UUID formatting macros for platforms without %llx support
 #define LODB_UUID_FMT "%08x%08x"
 #define LODB_UUID_ARGS(uuid) (uint32_t)((uuid) >> 32), (uint32_t)((uuid)&0xFFFFFFFF)
 
+// Sortable UUIDs (lodb_new_sortable_uuid()): creation time in the high 32 bits, so UUID order is creation order
+#define LODB_SORTABLE_UUID_TIME(uuid) ((uint32_t)((uuid) >> 32))   // Epoch seconds a sortable UUID was created at
+#define LODB_SORTABLE_UUID_MIN(time) ((lodb_uuid_t)(time) << 32)  // Smallest sortable UUID created at or after time
+
+// Open modes for appending to an existing file, and for overwriting part of it in place
+// after a seek. FILE_O_WRITE already opens without truncating on Adafruit LittleFS
+// (nRF52/STM32), but truncates on platforms with fopen-style modes.
+#if defined(ARCH_NRF52) || defined(ARCH_STM32WL)
+#define LODB_FILE_O_APPEND FILE_O_WRITE
+#define LODB_FILE_O_UPDATE FILE_O_WRITE
+#else
+#define LODB_FILE_O_APPEND "a"
+#define LODB_FILE_O_UPDATE "r+"
+#endif
+
+// Default size at which a segment log table rolls over to a new segment file
+#define LODB_SEGMENT_SIZE_DEFAULT (64 * 1024)
+
+// Defaults for the write-ahead log group commit window and checkpoint threshold
+#define LODB_WAL_GROUP_COMMIT_BYTES_DEFAULT 4096
+#define LODB_WAL_GROUP_COMMIT_MS_DEFAULT 50
+#define LODB_WAL_CHECKPOINT_BYTES_DEFAULT (32 * 1024)
+
+// Default time one sweepExpired() call may spend deleting expired records
+#define LODB_SWEEP_BUDGET_MS_DEFAULT 20
+
 /**
  * Error codes returned by LoDB operations
  */
@@ -36,9 +78,111 @@ typedef enum {
     LODB_ERR_IO,        // Filesystem error
     LODB_ERR_DECODE,    // Protobuf decode failed
     LODB_ERR_ENCODE,    // Protobuf encode failed
-    LODB_ERR_INVALID    // Invalid parameters
+    LODB_ERR_INVALID,   // Invalid parameters
+    LODB_ERR_NO_MEMORY, // Allocation failed
+    LODB_ERR_BUSY       // Try again later: async queue full, sweep budget ran out or a scan is open
 } LoDbError;
 
+/**
+ * Storage engines, selected per table at registerTable() time
+ */
+typedef enum {
+    LODB_STORAGE_FILES = 0,   // One {uuid}.pr file per record (default)
+    LODB_STORAGE_SEGMENT_LOG, // Records appended to rolling {segment}.seg files
+    LODB_STORAGE_RING         // Capped table: fixed slots of a preallocated ring.dat, the oldest record overwritten first
+} LoDbStorage;
+
+/**
+ * How update() replaces a record file (LODB_STORAGE_FILES only)
+ */
+typedef enum {
+    LODB_UPDATE_REWRITE = 0, // Remove the file, then write it again (default)
+    LODB_UPDATE_RENAME       // Write a {uuid}.tmp sibling and rename it over the file, so the record never goes missing
+} LoDbUpdateMode;
+
+/**
+ * Directory layout of a files table's record files (LODB_STORAGE_FILES only)
+ * The value is the number of leading UUID hex digits naming the shard directory.
+ */
+typedef enum {
+    LODB_LAYOUT_FLAT = 0,     // {table}/{uuid}.pr (default)
+    LODB_LAYOUT_SHARD_16 = 1, // {table}/{first hex digit}/{uuid}.pr
+    LODB_LAYOUT_SHARD_256 = 2 // {table}/{first two hex digits}/{uuid}.pr
+} LoDbLayout;
+
+/**
+ * Compression of stored records, applied after encoding and reversed before decoding
+ * Records written before compression was enabled (or after it was disabled) stay readable.
+ */
+typedef enum {
+    LODB_COMPRESSION_NONE = 0, // Records stored as plain protobuf (default)
+    LODB_COMPRESSION_LZ        // LZ77 with a 64 KB window, optionally primed with a trained dictionary
+} LoDbCompression;
+
+/**
+ * Protobuf type of a fixed-width field
+ * nanopb describes fixed32, sfixed32 and float fields with the same type (and likewise
+ * fixed64, sfixed64 and double), so tables declare the ones they index or query.
+ */
+typedef enum {
+    LODB_FIXED_FLOAT = 0, // float or double, and any undeclared field: not indexable
+    LODB_FIXED_UNSIGNED,  // fixed32 or fixed64
+    LODB_FIXED_SIGNED     // sfixed32 or sfixed64
+} LoDbFixedType;
+
+/**
+ * Declared type of one fixed-width field, see LoDbTableOptions::fixed_fields
+ */
+struct LoDbFixedField {
+    pb_size_t tag;      // Protobuf field number
+    LoDbFixedType type; // What the field holds
+};
+
+/**
+ * Per-table options passed to registerTable()
+ */
+struct LoDbTableOptions {
+    LoDbStorage storage = LODB_STORAGE_FILES;         // Storage engine for the table
+    size_t segment_size = LODB_SEGMENT_SIZE_DEFAULT;  // Roll-over size of a segment file (segment log only)
+    bool key_directory = false;                       // Keep all UUIDs in RAM to answer existence checks without opens
+    LoDbUpdateMode update_mode = LODB_UPDATE_REWRITE; // How update() replaces a record file
+    size_t bloom_capacity = 0;                        // Expected UUIDs of an in-RAM Bloom filter of stored keys (0 disables)
+    float bloom_false_positive_rate = 0.01f;          // Target share of absent UUIDs the filter can't rule out
+    LoDbLayout layout = LODB_LAYOUT_FLAT;             // Flat or sharded record directory, migrated at registerTable()
+    LoDbCompression compression = LODB_COMPRESSION_NONE; // Compress records as they are written
+    const uint8_t *compression_dictionary = nullptr;     // Dictionary from trainDictionary() (copied), or NULL
+    size_t compression_dictionary_size = 0;              // Number of dictionary bytes (at most 16 KB)
+    uint32_t ring_capacity = 0;       // Most records a ring table holds (ring only)
+    size_t ring_capacity_bytes = 0;   // ...or the most bytes its ring file may take, whichever is smaller
+    uint32_t ring_slot_size = 0;      // Largest stored record of a ring table, e.g. the generated {Message}_size (required)
+    pb_size_t ttl_field = 0;          // Integer field holding a time in epoch seconds that records expire from (0 disables)
+    uint32_t ttl_seconds = 0;         // Seconds a record lives past its ttl_field value (0 if the field is the expiry time)
+    const LoDbFixedField *fixed_fields = nullptr; // Types of the fixed-width fields to index or query (copied), or NULL
+    size_t fixed_field_count = 0;                 // Number of fixed_fields entries
+};
+
+/**
+ * Per-database options passed to the LoDb constructor
+ */
+struct LoDbOptions {
+    bool write_ahead_log = false;                                        // Log writes to {db_path}/wal.log, apply at checkpoints
+    size_t wal_group_commit_bytes = LODB_WAL_GROUP_COMMIT_BYTES_DEFAULT; // Flush the log once this many bytes are waiting
+    uint32_t wal_group_commit_ms = LODB_WAL_GROUP_COMMIT_MS_DEFAULT;     // ...or once the oldest waiting write is this old
+    size_t wal_checkpoint_bytes = LODB_WAL_CHECKPOINT_BYTES_DEFAULT;     // Checkpoint once this many bytes were logged
+    size_t record_cache_bytes = 0;                                       // Budget of the decoded-record cache for get() (0 disables)
+};
+
+/**
+ * Decoded-record cache counters returned by LoDb::getCacheStats()
+ */
+struct LoDbCacheStats {
+    uint32_t hits;      // get() calls answered from the cache
+    uint32_t misses;    // get() calls that read storage
+    uint32_t evictions; // Records evicted to stay within the budget
+    size_t entries;     // Records currently cached
+    size_t bytes;       // Bytes currently charged against the budget
+};
+
 /**
  * Filter function: returns true to include record in results
  * Supports lambdas with captures via std::function
@@ -56,6 +200,196 @@ typedef std::function<bool(const void *)> LoDbFilter;
  */
 typedef std::function<int(const void *, const void *)> LoDbComparator;
 
+/**
+ * Comparison operators for LoDbWhere conditions
+ */
+typedef enum {
+    LODB_OP_EQ = 0, // field == value
+    LODB_OP_NE,     // field != value
+    LODB_OP_LT,     // field < value
+    LODB_OP_LE,     // field <= value
+    LODB_OP_GT,     // field > value
+    LODB_OP_GE      // field >= value
+} LoDbOperator;
+
+/**
+ * Declarative predicate evaluated on encoded protobuf bytes
+ *
+ * Conditions on field numbers are ANDed together and checked by walking the wire
+ * format, so rows that don't match are rejected without being decoded into a struct.
+ * Only rows that pass are fully decoded (and then given to any LoDbFilter).
+ *
+ * Integer, enum and bool fields compare as int64_t, string and bytes fields compare
+ * bytewise. Fixed-width fields must be declared in LoDbTableOptions::fixed_fields
+ * (fixed32/fixed64 compare as unsigned, sfixed32/sfixed64 as signed). A field missing
+ * from the encoding compares as zero or empty, like proto3 defaults. Repeated fields,
+ * submessages, oneof members and float/double fields are not supported; a query using
+ * them matches nothing. Messages containing a oneof are walked to the end, since nanopb
+ * encodes them out of tag order.
+ *
+ * Example:
+ *   LoDbWhere where = LoDbWhere().eq(Message_from_node_tag, 0x1234).gt(Message_timestamp_tag, since);
+ *   auto recent = db->select("messages", where);
+ */
+class LoDbWhere
+{
+  public:
+    LoDbWhere &eq(pb_size_t field_tag, int64_t value) { return add(field_tag, LODB_OP_EQ, value); }
+    LoDbWhere &ne(pb_size_t field_tag, int64_t value) { return add(field_tag, LODB_OP_NE, value); }
+    LoDbWhere &lt(pb_size_t field_tag, int64_t value) { return add(field_tag, LODB_OP_LT, value); }
+    LoDbWhere &le(pb_size_t field_tag, int64_t value) { return add(field_tag, LODB_OP_LE, value); }
+    LoDbWhere &gt(pb_size_t field_tag, int64_t value) { return add(field_tag, LODB_OP_GT, value); }
+    LoDbWhere &ge(pb_size_t field_tag, int64_t value) { return add(field_tag, LODB_OP_GE, value); }
+
+    LoDbWhere &eq(pb_size_t field_tag, const std::string &value) { return add(field_tag, LODB_OP_EQ, value); }
+    LoDbWhere &ne(pb_size_t field_tag, const std::string &value) { return add(field_tag, LODB_OP_NE, value); }
+
+    /**
+     * Add a condition with an explicit operator
+     */
+    LoDbWhere &add(pb_size_t field_tag, LoDbOperator op, int64_t value);
+    LoDbWhere &add(pb_size_t field_tag, LoDbOperator op, const std::string &value);
+
+    /**
+     * Whether there are no conditions (matches every row)
+     */
+    bool empty() const { return conditions.empty(); }
+
+  private:
+    friend class LoDb;
+    friend class LoDbCursor;
+
+    struct Condition {
+        pb_size_t tag;
+        LoDbOperator op;
+        bool is_text;     // Compare against text instead of value
+        int64_t value;
+        std::string text;
+        pb_type_t type;   // Field type, resolved by bind()
+        bool is_signed;   // Fixed-width field declared LODB_FIXED_SIGNED, resolved by bind()
+        bool outcome;     // Result for the row being evaluated
+        int order;        // Running text comparison for the row, 0 while still equal
+    };
+
+    std::vector<Condition> conditions; // Sorted by tag once bound
+    bool bound = false;
+    bool in_tag_order = true;          // The message has no oneof, so fields are encoded in tag order
+
+    /**
+     * Resolve field types against a table's message descriptor
+     * @param descriptor Message descriptor of the table
+     * @param record_size Size of the table's record struct
+     * @param fixed_fields Declared types of the table's fixed-width fields
+     * @return false if a condition names a missing or unsupported field
+     */
+    bool bind(const pb_msgdesc_t *descriptor, size_t record_size, const std::vector<LoDbFixedField> &fixed_fields);
+
+    /**
+     * Evaluate the bound conditions on an encoded record
+     */
+    bool matches(const uint8_t *buffer, size_t size);
+};
+
+/**
+ * Memory source for a LoDbResultSet arena
+ * Leave both functions NULL to use malloc()/free().
+ */
+struct LoDbAllocator {
+    void *(*allocate)(size_t size, void *context) = nullptr; // Return NULL on failure
+    void (*release)(void *ptr, void *context) = nullptr;
+    void *context = nullptr; // Passed through to allocate/release
+};
+
+/**
+ * Result set filled by LoDb::select(table_name, results, ...)
+ *
+ * All records live back to back in a single arena that grows by doubling and is
+ * released in one operation by clear() or the destructor, so a query costs one
+ * live allocation instead of one per record.
+ *
+ * Example:
+ *   LoDbResultSet users;
+ *   db->select("users", users, filter, comparator, 10);
+ *   for (size_t i = 0; i < users.size(); i++) {
+ *       const User *user = users.at<User>(i);
+ *   }
+ */
+class LoDbResultSet
+{
+  public:
+    LoDbResultSet();
+    explicit LoDbResultSet(const LoDbAllocator &arena_allocator);
+    ~LoDbResultSet();
+
+    LoDbResultSet(LoDbResultSet &&other);
+    LoDbResultSet &operator=(LoDbResultSet &&other);
+    LoDbResultSet(const LoDbResultSet &) = delete;
+    LoDbResultSet &operator=(const LoDbResultSet &) = delete;
+
+    /**
+     * Number of records in the set
+     */
+    size_t size() const { return count; }
+
+    bool empty() const { return count == 0; }
+
+    /**
+     * Size of each record (the table's record_size)
+     */
+    size_t recordSize() const { return record_size; }
+
+    /**
+     * Record at an index, NULL if out of range
+     */
+    void *operator[](size_t index) { return index < count ? data + index * record_size : nullptr; }
+    const void *operator[](size_t index) const { return index < count ? data + index * record_size : nullptr; }
+
+    /**
+     * Typed record at an index, NULL if out of range
+     */
+    template <typename T> T *at(size_t index) { return (T *)(*this)[index]; }
+    template <typename T> const T *at(size_t index) const { return (const T *)(*this)[index]; }
+
+    /**
+     * Release the arena and empty the set
+     */
+    void clear();
+
+  private:
+    friend class LoDb;
+
+    LoDbAllocator allocator;
+    uint8_t *data;
+    size_t count;
+    size_t capacity;
+    size_t record_size;
+
+    /**
+     * Empty the set, keeping the arena when the record size is unchanged
+     */
+    void reset(size_t new_record_size);
+
+    /**
+     * Append an uninitialised record slot
+     * @return Pointer to the slot, NULL if the arena could not grow
+     */
+    void *append();
+
+    /**
+     * Reorder records so that slot i holds the record previously at order[i]
+     * Records not listed in order are discarded.
+     */
+    void arrange(const std::vector<size_t> &order);
+
+    /**
+     * Discard the first n records
+     */
+    void dropFront(size_t n);
+
+    void *allocate(size_t size);
+    void release(void *ptr);
+};
+
 /**
  * Convert UUID to 16-character hex string for filenames
  * @param uuid UUID to convert
@@ -71,6 +405,19 @@ void lodb_uuid_to_hex(lodb_uuid_t uuid, char hex_out[17]);
  */
 lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
 
+/**
+ * Generate a time-ordered UUID without hashing
+ * Layout: [32 bits epoch seconds][12 bits sequence][8 bits salt][12 bits random]. UUIDs
+ * from one device only ever increase, so they sort in creation order (sequences that run
+ * past 4096 in a second borrow the next second, and a clock set back keeps counting from
+ * the last second used). The salt byte and random bits keep devices apart.
+ * With the RTC unset, UUIDs made after a reboot may sort before earlier ones.
+ * Not thread-safe; generate from one thread.
+ * @param salt Typically the node ID (only its low byte is used)
+ * @return 64-bit UUID, see LODB_SORTABLE_UUID_TIME() and LODB_SORTABLE_UUID_MIN()
+ */
+lodb_uuid_t lodb_new_sortable_uuid(uint64_t salt);
+
     /**
      * LoDB Database Class
      *
@@ -85,8 +432,9 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
      * Create a new database instance
      * @param db_name Name of the database (creates {prefix}/lodb/{db_name}/ directory)
      * @param filesystem Filesystem type (LoFS::FSType::INTERNAL, LoFS::FSType::SD, or LoFS::FSType::AUTO for auto-select)
+     * @param options Optional per-database options (write-ahead log, etc.)
      */
-    LoDb(const char *db_name, LoFS::FSType filesystem = LoFS::FSType::AUTO);
+    LoDb(const char *db_name, LoFS::FSType filesystem = LoFS::FSType::AUTO, const LoDbOptions &options = LoDbOptions());
 
     /**
      * Destructor
@@ -98,9 +446,11 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
      * @param table_name Name of the table (directory name)
      * @param pb_descriptor Nanopb message descriptor for the protobuf type
      * @param record_size Size of the in-memory struct (sizeof)
-     * @return LODB_OK on success, error code otherwise
+     * @param options Optional per-table options (storage engine, etc.)
+     * @return LODB_OK on success, error code otherwise (the table is then not registered)
      */
-    LoDbError registerTable(const char *table_name, const pb_msgdesc_t *pb_descriptor, size_t record_size);
+    LoDbError registerTable(const char *table_name, const pb_msgdesc_t *pb_descriptor, size_t record_size,
+                            const LoDbTableOptions &options = LoDbTableOptions());
 
     /**
      * Insert a new record with a UUID
@@ -111,6 +461,25 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
      */
     LoDbError insert(const char *table_name, lodb_uuid_t uuid, const void *record);
 
+    /**
+     * Insert a batch of new records
+     *
+     * All UUIDs are validated in one pass before anything is written, the encode buffer
+     * is reused across rows, and segment log tables keep the active segment open for the
+     * whole batch and flush it once at the end. A failing row does not stop the batch.
+     *
+     * @param table_name Name of the table to insert into
+     * @param uuids Array of count UUIDs, one per record
+     * @param records Array of count pointers to the protobuf records to insert
+     * @param count Number of records in the batch
+     * @param statuses_out Optional array of count entries receiving each row's result
+     *                     (LODB_ERR_INVALID for a UUID that exists or repeats within the batch)
+     * @return LODB_OK if every row was inserted, LODB_ERR_INVALID if the arguments are invalid or
+     *         table not registered, otherwise the error of the first failed row
+     */
+    LoDbError insertMany(const char *table_name, const lodb_uuid_t *uuids, const void *const *records, size_t count,
+                         LoDbError *statuses_out = nullptr);
+
     /**
      * Get a record by UUID
      * @param table_name Name of the table to read from
@@ -120,6 +489,16 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
      */
     LoDbError get(const char *table_name, lodb_uuid_t uuid, void *record_out);
 
+    /**
+     * Check whether a record exists without reading it
+     * Answered from memory when the key is known (write-ahead log, segment log, key directory,
+     * or a Bloom filter ruling the UUID out); otherwise the record file is probed.
+     * @param table_name Name of the table to check
+     * @param uuid UUID of the record
+     * @return true if the record exists, false if it doesn't or the table is not registered
+     */
+    bool exists(const char *table_name, lodb_uuid_t uuid);
+
     /**
      * Update a single record by UUID
      * @param table_name Name of the table to update
@@ -137,15 +516,32 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
      */
     LoDbError deleteRecord(const char *table_name, lodb_uuid_t uuid);
 
+    /**
+     * Delete every record whose UUID is below a bound
+     * With UUIDs from lodb_new_sortable_uuid(), this deletes records by age without reading
+     * them: pass LODB_SORTABLE_UUID_MIN(time) to delete everything created before time.
+     * @param table_name Name of the table to delete from
+     * @param before Records with a smaller UUID are deleted
+     * @param deleted_out Optional, receives the number of records deleted
+     * @return LODB_OK on success, LODB_ERR_INVALID if table not registered, error code otherwise
+     */
+    LoDbError deleteBefore(const char *table_name, lodb_uuid_t before, size_t *deleted_out = nullptr);
+
     /**
      * Select records from a table with optional filtering, sorting, and limiting
      *
      * Operation order: FILTER → SORT → LIMIT
      *
+     * With both a comparator and a limit, only the best `offset + limit` records are kept
+     * in a bounded heap while scanning (O(offset + limit) memory, O(n log limit) comparisons).
+     * Without a comparator, the scan stops as soon as `limit` records have been collected,
+     * and skipped rows are not decoded unless a filter needs them.
+     *
      * @param table_name Name of the table to query
      * @param filter Optional filter function (NULL to select all records)
      * @param comparator Optional comparator for sorting (NULL for no sorting)
      * @param limit Optional result limit (0 for no limit)
+     * @param offset Optional number of matching records to skip before the first result (0 for none)
      * @return Vector of heap-allocated record pointers (caller must free each with delete[])
      *
      * USAGE:
@@ -168,7 +564,45 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
      *   }
      */
     std::vector<void *> select(const char *table_name, LoDbFilter filter = LoDbFilter(),
-                               LoDbComparator comparator = LoDbComparator(), size_t limit = 0);
+                               LoDbComparator comparator = LoDbComparator(), size_t limit = 0, size_t offset = 0);
+
+    /**
+     * Select records into a single-arena result set
+     * Same semantics as the vector form of select(), but all records share one allocation
+     * that is released by results.clear() or the result set's destructor.
+     *
+     * @param table_name Name of the table to query
+     * @param results Result set to fill (emptied first)
+     * @param filter Optional filter function (NULL to select all records)
+     * @param comparator Optional comparator for sorting (NULL for no sorting)
+     * @param limit Optional result limit (0 for no limit)
+     * @param offset Optional number of matching records to skip before the first result (0 for none)
+     * @return LODB_OK on success, LODB_ERR_INVALID if table not registered, LODB_ERR_NO_MEMORY if the arena could not grow
+     */
+    LoDbError select(const char *table_name, LoDbResultSet &results, LoDbFilter filter = LoDbFilter(),
+                     LoDbComparator comparator = LoDbComparator(), size_t limit = 0, size_t offset = 0);
+
+    /**
+     * Select records matching a declarative predicate
+     * Rows are checked against `where` on their encoded bytes and only decoded if they pass,
+     * then the optional filter, sort, offset and limit apply as in the other forms of select().
+     * @param table_name Name of the table to query
+     * @param where Field conditions evaluated before decoding
+     * @param filter Optional filter function applied to decoded rows that pass `where`
+     * @param comparator Optional comparator for sorting (NULL for no sorting)
+     * @param limit Optional result limit (0 for no limit)
+     * @param offset Optional number of matching records to skip before the first result (0 for none)
+     * @return Vector of heap-allocated record pointers (caller must free each with delete[]), empty if `where` is invalid
+     */
+    std::vector<void *> select(const char *table_name, const LoDbWhere &where, LoDbFilter filter = LoDbFilter(),
+                               LoDbComparator comparator = LoDbComparator(), size_t limit = 0, size_t offset = 0);
+
+    /**
+     * Select records matching a declarative predicate into a single-arena result set
+     * @return LODB_OK on success, LODB_ERR_INVALID if table not registered or `where` is invalid, LODB_ERR_NO_MEMORY if the arena could not grow
+     */
+    LoDbError select(const char *table_name, LoDbResultSet &results, const LoDbWhere &where, LoDbFilter filter = LoDbFilter(),
+                     LoDbComparator comparator = LoDbComparator(), size_t limit = 0, size_t offset = 0);
 
     /**
      * Free a vector of records returned by select()
@@ -176,6 +610,50 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
      */
     static void freeRecords(std::vector<void *> &records);
 
+    /**
+     * Open a streaming cursor over a table with optional filtering
+     *
+     * Records are decoded lazily, one per call to LoDbCursor::next(), into a single
+     * caller-provided buffer, so peak memory is one record regardless of table size.
+     * Stopping early simply means not calling next() again.
+     *
+     * @param table_name Name of the table to scan
+     * @param filter Optional filter function (NULL to visit all records)
+     * @return Cursor over matching records (already exhausted if the table is not registered)
+     *
+     * USAGE:
+     *   User user;
+     *   LoDbCursor cursor = db->scan("users", filter);
+     *   while (cursor.next(&user)) {
+     *       // ... use user, break out whenever done
+     *   }
+     */
+    LoDbCursor scan(const char *table_name, LoDbFilter filter = LoDbFilter());
+
+    /**
+     * Open a streaming cursor over records matching a declarative predicate
+     * Rows failing `where` are rejected on their encoded bytes without being decoded.
+     * @param table_name Name of the table to scan
+     * @param where Field conditions evaluated before decoding
+     * @param filter Optional filter function applied to decoded rows that pass `where`
+     * @return Cursor over matching records (already exhausted if the table is not registered or `where` is invalid)
+     */
+    LoDbCursor scan(const char *table_name, const LoDbWhere &where, LoDbFilter filter = LoDbFilter());
+
+    /**
+     * Select the most recently inserted records, newest first
+     * Ring tables read only their newest slots, whatever the size of the ring; updates keep a
+     * record's place, so recency is insertion order. Other tables return records in descending
+     * UUID order, which is newest first for UUIDs from lodb_new_sortable_uuid(). Only the
+     * returned records are decoded: UUIDs come from memory for segment log tables and tables
+     * with a key directory, and from one directory walk otherwise.
+     * @param table_name Name of the table
+     * @param count Number of records to return
+     * @param filter Optional filter; rejected records don't count towards count
+     * @return Vector of heap-allocated record pointers (caller must free each with delete[]), empty on error
+     */
+    std::vector<void *> selectLatest(const char *table_name, size_t count, LoDbFilter filter = LoDbFilter());
+
     /**
      * Count records in a table with optional filtering
      * 
@@ -188,6 +666,16 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
      */
     int count(const char *table_name, LoDbFilter filter = LoDbFilter());
 
+    /**
+     * Count records matching a declarative predicate
+     * Without a filter, no record is decoded.
+     * @param table_name Name of the table to count
+     * @param where Field conditions evaluated on the encoded records
+     * @param filter Optional filter function applied to decoded rows that pass `where`
+     * @return Number of matching records, or -1 on error
+     */
+    int count(const char *table_name, const LoDbWhere &where, LoDbFilter filter = LoDbFilter());
+
     /**
      * Truncate a table - delete all records but keep the table registered
      * @param table_name Name of the table to truncate
@@ -202,7 +690,156 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
      */
     LoDbError drop(const char *table_name);
 
+    /**
+     * Compact a segment log table - rewrite live records into fresh segments and
+     * remove the old ones, reclaiming space held by superseded and deleted records.
+     * Does nothing for tables using LODB_STORAGE_FILES.
+     * @param table_name Name of the table to compact
+     * @return LODB_OK on success, LODB_ERR_INVALID if table not registered,
+     *         LODB_ERR_BUSY while a cursor from scan() is open on the table, error code otherwise
+     */
+    LoDbError compact(const char *table_name);
+
+    /**
+     * Delete the expired records of a TTL table, earliest expiry first
+     * Records are found through the table's expiry index and deleted a few at a time
+     * until none is left or the time budget runs out, so calls can be spread over the
+     * main loop. Expired records are already hidden from reads until they are swept.
+     * @param table_name Name of the table
+     * @param budget_ms Time to spend before returning (0 for no limit)
+     * @param swept_out Optional, receives the number of records deleted
+     * @return LODB_OK once no expired record is left (or the table has no TTL), LODB_ERR_BUSY if the
+     *         budget ran out first, LODB_ERR_INVALID if table not registered, error code otherwise
+     */
+    LoDbError sweepExpired(const char *table_name, uint32_t budget_ms = LODB_SWEEP_BUDGET_MS_DEFAULT, size_t *swept_out = nullptr);
+
+    /**
+     * Sweep every TTL table, sharing one time budget (see sweepExpired())
+     * @return LODB_OK once no expired record is left, LODB_ERR_BUSY if the budget ran out first, error code otherwise
+     */
+    LoDbError sweepAllExpired(uint32_t budget_ms = LODB_SWEEP_BUDGET_MS_DEFAULT, size_t *swept_out = nullptr);
+
+    /**
+     * Flush write-ahead log appends still waiting for their group commit
+     * The log's own timer flushes them once the commit window has passed; call this to
+     * flush before then, e.g. ahead of a planned shutdown. No-op without a log.
+     */
+    void sync();
+
+    /**
+     * Apply the write-ahead log to table storage in one batch and reset it
+     * Records of tables that are not registered yet are kept in the log until they are.
+     * Runs automatically once wal_checkpoint_bytes have been logged, before scans, selects
+     * and counts of a table with logged records, and from the destructor.
+     * @return LODB_OK on success (or without a log), error code otherwise (the log is kept)
+     */
+    LoDbError checkpoint();
+
+    /**
+     * Counters of the decoded-record cache (all zero when options.record_cache_bytes is 0)
+     */
+    LoDbCacheStats getCacheStats() const;
+
+    /**
+     * Operation counts, failures by error code, log2 latency histograms and storage I/O
+     * of every registered table, plus database totals
+     * @param stats_out Message to fill (several KB, so avoid the stack on small devices)
+     * @return LODB_OK on success, LODB_ERR_INVALID if stats_out is NULL or LODB_STATS is 0
+     */
+    LoDbError getStats(meshtastic_LoDBStats *stats_out);
+
+    /**
+     * Instrumentation of a single table (see getStats())
+     * @return LODB_OK on success, LODB_ERR_INVALID if the table is not registered, stats_out is NULL or LODB_STATS is 0
+     */
+    LoDbError getTableStats(const char *table_name, meshtastic_LoDBTableStats *stats_out);
+
+    /**
+     * Zero the instrumentation of every table
+     */
+    void resetStats();
+
+    /**
+     * Build a compression dictionary from a table's records
+     * Substrings shared by many records are collected from a sample of the table. Store
+     * the result and pass it as options.compression_dictionary on every registerTable();
+     * records compressed with a dictionary can't be read without the same bytes.
+     * Training holds the sampled records in RAM, so it is best run on a host or at setup.
+     * @param table_name Name of the table
+     * @param dictionary_out Output buffer
+     * @param capacity Size of the output buffer (16 KB at most is used)
+     * @param size_out Receives the number of dictionary bytes (0 if the records share nothing)
+     * @param max_samples Number of records to sample
+     * @return LODB_OK on success, LODB_ERR_INVALID if table not registered or a buffer is NULL, error code otherwise
+     */
+    LoDbError trainDictionary(const char *table_name, uint8_t *dictionary_out, size_t capacity, size_t *size_out,
+                              size_t max_samples = 256);
+
+    /**
+     * Create (or reopen) a persistent secondary index on a scalar protobuf field
+     * The index maps the field value to record UUIDs and is kept up to date by insert,
+     * update, deleteRecord and truncate. It is stored under {table}/_idx/ and survives
+     * reboots: registerTable() reopens every index found there, so each index only has
+     * to be created once.
+     * Supported fields: bool, enum and integer types. Signed and unsigned values compare
+     * as int64_t. Fixed-width fields must be declared in LoDbTableOptions::fixed_fields,
+     * since nanopb can't tell them from float/double; float and double are rejected.
+     * @param table_name Name of the table
+     * @param field_tag Protobuf field number to index
+     * @return LODB_OK on success, LODB_ERR_INVALID if table not registered or field not indexable (float, double
+     *         or an undeclared fixed-width field), error code otherwise
+     */
+    LoDbError createIndex(const char *table_name, pb_size_t field_tag);
+
+    /**
+     * Remove a secondary index and its files
+     * @param table_name Name of the table
+     * @param field_tag Protobuf field number of the index
+     * @return LODB_OK on success, LODB_ERR_INVALID if table not registered or the index serves the table's TTL,
+     *         LODB_ERR_NOT_FOUND if no such index
+     */
+    LoDbError dropIndex(const char *table_name, pb_size_t field_tag);
+
+    /**
+     * Find UUIDs of records whose indexed field equals a value
+     * @param table_name Name of the table
+     * @param field_tag Protobuf field number of the index
+     * @param value Field value to match
+     * @param uuids_out Receives matching UUIDs (cleared first)
+     * @return LODB_OK on success, LODB_ERR_INVALID if table not registered or field not indexed, error code otherwise
+     */
+    LoDbError findEq(const char *table_name, pb_size_t field_tag, int64_t value, std::vector<lodb_uuid_t> &uuids_out);
+
+    /**
+     * Find UUIDs of records whose indexed field is within [min_value, max_value], in field order
+     * @param table_name Name of the table
+     * @param field_tag Protobuf field number of the index
+     * @param min_value Smallest field value to include
+     * @param max_value Largest field value to include
+     * @param uuids_out Receives matching UUIDs (cleared first)
+     * @return LODB_OK on success, LODB_ERR_INVALID if table not registered or field not indexed, error code otherwise
+     */
+    LoDbError findRange(const char *table_name, pb_size_t field_tag, int64_t min_value, int64_t max_value,
+                        std::vector<lodb_uuid_t> &uuids_out);
+
+    /**
+     * Select records whose indexed field is within [min_value, max_value]
+     * Only the matching records are read. Results are ordered by the indexed field.
+     * @param table_name Name of the table
+     * @param field_tag Protobuf field number of the index
+     * @param min_value Smallest field value to include
+     * @param max_value Largest field value to include
+     * @param filter Optional filter applied to the matching records
+     * @param limit Optional result limit (0 for no limit)
+     * @return Vector of heap-allocated record pointers (caller must free each with delete[]), empty on error
+     */
+    std::vector<void *> selectByIndex(const char *table_name, pb_size_t field_tag, int64_t min_value, int64_t max_value,
+                                      LoDbFilter filter = LoDbFilter(), size_t limit = 0);
+
   private:
+    friend class LoDbCursor;
+    friend class LoDbAsync;
+
     /**
      * Table metadata
      */
@@ -211,12 +848,76 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
         const pb_msgdesc_t *pb_descriptor;
         size_t record_size;
         char table_path[160]; // Full path: {prefix}/lodb/{db_name}/{table_name}/
+        LoDbTableOptions options;
+        LoDbSegmentLog *segment_log; // Owned engine state, NULL unless options.storage == LODB_STORAGE_SEGMENT_LOG
+        LoDbRing *ring;              // Owned engine state, NULL unless options.storage == LODB_STORAGE_RING
+        std::vector<lodb_uuid_t> keys; // Sorted key directory (options.key_directory only)
+        bool keys_loaded;              // Whether keys reflects the table directory
+        std::map<pb_size_t, LoDbIndex *> indexes; // Owned secondary indexes by field tag
+        uint32_t row_count;    // Number of record files (LODB_STORAGE_FILES, when row_count_known)
+        bool row_count_known;  // Whether row_count is valid, otherwise the next count() walks the directory
+        bool row_count_saved;  // Whether {table_path}/_meta holds row_count (removed on the first change)
+        LoDbBloom *bloom;      // Owned Bloom filter of stored UUIDs, NULL unless options.bloom_capacity is set
+        bool bloom_ready;      // Whether bloom covers every record file, otherwise it is rebuilt on first lookup
+        uint32_t shards_made[8]; // Bit per shard directory known to exist (sharded layouts)
+        LoDbCodec *codec;        // Owned record codec, NULL unless options.compression is set
+        LoDbExpiry *expiry;      // Owned expiry tracker over the ttl_field index, NULL unless options.ttl_field is set
+        bool cacheable;          // Whether the record cache may hold this table's records (static fields only)
+        int8_t rename_replaces;  // Whether renaming over a record file replaces it (1) or fails (0), -1 until an update finds out
+        std::vector<LoDbFixedField> fixed_fields; // Declared fixed-width field types (copy of options.fixed_fields)
+#if LODB_STATS
+        LoDbTableCounters stats; // Operation and I/O instrumentation, kept across re-registration
+#endif
     };
 
     std::string db_name;
     char fs_prefix[10]; // "/sd" or "/internal"
     char db_path[128]; // {prefix}/lodb/{db_name}/
     std::map<std::string, TableMetadata> tables;
+    LoDbOptions options;
+    LoDbWal *wal;             // Owned write-ahead log, NULL unless options.write_ahead_log
+    size_t wal_checkpointed; // Log size after the last checkpoint (records carried for unregistered tables)
+    LoDbRecordCache *record_cache; // Owned decoded-record cache, NULL unless options.record_cache_bytes
+#if LODB_STATS
+    LoDbIoCounters wal_io; // Write-ahead log I/O, counted in the database totals only
+#endif
+
+    // Implementations of the instrumented public operations
+    LoDbError insertRecord(const char *table_name, lodb_uuid_t uuid, const void *record);
+    LoDbError insertRecords(const char *table_name, const lodb_uuid_t *uuids, const void *const *records, size_t count,
+                            LoDbError *statuses_out);
+    LoDbError readRecord(const char *table_name, lodb_uuid_t uuid, void *record_out);
+    bool recordExists(const char *table_name, lodb_uuid_t uuid, LoDbError *error_out);
+    LoDbError updateRecord(const char *table_name, lodb_uuid_t uuid, const void *record);
+    LoDbError removeRecord(const char *table_name, lodb_uuid_t uuid);
+    LoDbError removeRecordsBefore(const char *table_name, lodb_uuid_t before, size_t *deleted_out);
+    std::vector<void *> selectRecords(const char *table_name, const LoDbWhere &where, LoDbFilter filter, LoDbComparator comparator,
+                                      size_t limit, size_t offset, LoDbError *error_out);
+    LoDbError selectRecords(const char *table_name, LoDbResultSet &results, const LoDbWhere &where, LoDbFilter filter,
+                            LoDbComparator comparator, size_t limit, size_t offset);
+    std::vector<void *> selectLatestRecords(const char *table_name, size_t count, LoDbFilter filter, LoDbError *error_out);
+    int countRecords(const char *table_name, LoDbFilter filter);
+    int countRecords(const char *table_name, const LoDbWhere &where, LoDbFilter filter);
+    LoDbError truncateTable(const char *table_name);
+
+    /**
+     * Why scan() returned an exhausted cursor
+     * @return LODB_OK if the cursor is open, LODB_ERR_INVALID for a where clause that doesn't fit the table,
+     *         LODB_ERR_IO if the log could not be applied or the table directory not opened
+     */
+    static LoDbError scanError(const LoDbCursor &cursor);
+
+    /**
+     * Count a finished call in its table's instrumentation (no-op when LODB_STATS is 0)
+     * @param started micros() when the call began
+     * @param error LoDbError the call returned, or -1 for a failure without a code
+     */
+    void recordOperation(const char *table_name, meshtastic_LoDBOperation operation, uint32_t started, int error);
+
+    /**
+     * I/O counters of a table (NULL when LODB_STATS is 0)
+     */
+    static LoDbIoCounters *tableIo(TableMetadata *table);
 
     /**
      * Get table metadata by name
@@ -224,4 +925,352 @@ lodb_uuid_t lodb_new_uuid(const char *str, uint64_t salt);
      * @return Pointer to table metadata, NULL if not found
      */
     TableMetadata *getTable(const char *table_name);
+
+    /**
+     * Release engine state owned by a table (does not touch stored records)
+     * @param table Table metadata to release
+     */
+    void releaseTable(TableMetadata *table);
+
+    /**
+     * Answer an existence check from memory when possible
+     * Segment log tables always know their UUIDs; file tables do when the key directory is enabled.
+     * @param table Table to check
+     * @param uuid UUID to look up
+     * @param exists_out Set to whether the UUID exists when the answer is known
+     * @return true if the answer is known, false if the caller must probe the filesystem
+     */
+    bool lookupKey(TableMetadata *table, lodb_uuid_t uuid, bool *exists_out);
+
+    /**
+     * Find a table's secondary index on a field
+     * @return Pointer to the index, NULL if the field is not indexed
+     */
+    LoDbIndex *getIndex(TableMetadata *table, pb_size_t field_tag);
+
+    /**
+     * Read the current version of a record when the table has secondary indexes
+     * @return Heap-allocated record (caller must delete[]), NULL if the table has no indexes or the read failed
+     */
+    uint8_t *readIndexedRecord(TableMetadata *table, lodb_uuid_t uuid);
+
+    /**
+     * Read and decode a record, expired or not (see readRecord() for the checks callers get)
+     */
+    LoDbError fetchRecord(TableMetadata *table, lodb_uuid_t uuid, void *record_out);
+
+    /**
+     * Whether a record of a TTL table has expired (memory only, unless another record fell due)
+     */
+    bool isExpired(TableMetadata *table, lodb_uuid_t uuid);
+
+    /**
+     * Sweep one table within the budget of a sweep that began at started (millis())
+     */
+    LoDbError sweepTable(TableMetadata *table, uint32_t started, uint32_t budget_ms, size_t *swept);
+
+    /**
+     * Move a record's entries in every secondary index from its old to its new version
+     * @param table Table whose indexes to update
+     * @param uuid UUID of the record
+     * @param old_record Previous version, NULL if the record is new or its previous version is unreadable
+     * @param new_record New version, NULL if the record was deleted
+     * @param inserted Whether uuid was just inserted, so none of its entries can be in an index yet
+     */
+    void updateIndexes(TableMetadata *table, lodb_uuid_t uuid, const void *old_record, const void *new_record,
+                       bool inserted = false);
+
+    /**
+     * Append a record version (or a deletion when data is NULL) to the write-ahead log,
+     * checkpointing once enough has been logged
+     * @return LODB_OK on success, error code otherwise
+     */
+    LoDbError logWrite(TableMetadata *table, lodb_uuid_t uuid, const uint8_t *data, size_t length);
+
+    /**
+     * Checkpoint before a table is read in bulk, so scans see its logged records
+     * @return LODB_OK on success, error code otherwise
+     */
+    LoDbError applyLog(TableMetadata *table);
+
+    /**
+     * Write a table's logged records to its storage
+     * @return LODB_OK on success, error code otherwise
+     */
+    LoDbError applyLogged(TableMetadata *table);
+
+    /**
+     * Build a table's key directory from one scan of its directory
+     * @param table Table to load
+     * @return LODB_OK on success, LODB_ERR_IO if the directory could not be read
+     */
+    LoDbError loadKeyDirectory(TableMetadata *table);
+
+    /**
+     * List the UUIDs of all record files in a table directory, sorted
+     */
+    LoDbError listRecordKeys(TableMetadata *table, std::vector<lodb_uuid_t> &keys_out);
+
+    /**
+     * List the UUIDs of a table's stored records, sorted, from memory where the table keeps them
+     * Logged writes must be applied first.
+     */
+    LoDbError sortedKeys(TableMetadata *table, std::vector<lodb_uuid_t> &keys_out);
+
+    /**
+     * Load a files table's row count from {table_path}/_meta
+     * A missing or invalid file (e.g. after a power loss) leaves the count unknown.
+     */
+    void loadRowCount(TableMetadata *table);
+
+    /**
+     * Persist a files table's row count to {table_path}/_meta if it changed since it was saved
+     */
+    void saveRowCount(TableMetadata *table);
+
+    /**
+     * Remove the saved row count before the table's record files change, so a
+     * power loss before the next save can't leave a stale count behind
+     */
+    void invalidateRowCount(TableMetadata *table);
+
+    /**
+     * Adjust a files table's row count after record files were added or removed
+     */
+    void adjustRowCount(TableMetadata *table, int delta);
+
+    /**
+     * Rebuild a table's Bloom filter from one scan of its directory, used when
+     * {table_path}/_bloom was missing or invalid at registerTable() time
+     * @return true if the filter is ready to answer lookups
+     */
+    bool buildBloom(TableMetadata *table);
+
+    /**
+     * Remove the saved Bloom filter before UUIDs are added to the table's storage
+     */
+    void invalidateBloom(TableMetadata *table);
+
+    /**
+     * Record that a UUID was added to or removed from a table's key directory and Bloom filter
+     */
+    void addKey(TableMetadata *table, lodb_uuid_t uuid);
+    void removeKey(TableMetadata *table, lodb_uuid_t uuid);
+
+    /**
+     * Build the path of a record file in the table's layout
+     * @param table Table the record belongs to
+     * @param uuid UUID of the record
+     * @param path_out Buffer receiving {table_path}[/{shard}]/{uuid}.pr
+     * @param size Size of path_out
+     */
+    void recordPath(TableMetadata *table, lodb_uuid_t uuid, char *path_out, size_t size);
+
+    /**
+     * Create the shard directory a new record file goes into, once per shard and session
+     */
+    void ensureShard(TableMetadata *table, lodb_uuid_t uuid);
+
+    /**
+     * Move record files left in another layout (by an earlier registration or an
+     * interrupted migration) into the table's configured layout
+     * The layout in use is recorded in {table_path}/_layout, so tables already in
+     * the configured layout are not scanned.
+     * @return LODB_OK on success, LODB_ERR_IO if some files could not be moved (retried next registration)
+     */
+    LoDbError migrateLayout(TableMetadata *table);
+
+    /**
+     * Promote the {uuid}.tmp file of a rename-mode update interrupted after the old record file was
+     * removed, and remove temp files whose record file is still in place
+     */
+    void recoverReplacements(TableMetadata *table);
+
+    /**
+     * Replace a record file: write a {uuid}.tmp sibling, then rename it over the file. Where the
+     * filesystem refuses to rename over a file (found out once per table), the old one is removed first.
+     * @param file_path Path of the {uuid}.pr file
+     * @param data Encoded record bytes, or NULL to encode record into the file
+     * @param record Record to encode when data is NULL
+     * @param length Number of encoded bytes
+     * @return LODB_OK on success, LODB_ERR_IO or LODB_ERR_ENCODE on failure (the old file is left in place)
+     */
+    LoDbError replaceRecordFile(TableMetadata *table, const char *file_path, const uint8_t *data, const void *record,
+                                size_t length);
+
+    /**
+     * Store a record in a ring table, dropping the record it overwrites from the indexes and cache
+     */
+    LoDbError appendRing(TableMetadata *table, lodb_uuid_t uuid, const uint8_t *data, size_t length);
+
+    /**
+     * Encode a record into its stored form: protobuf bytes sized with pb_get_encoded_size(),
+     * compressed with the table's codec if it has one
+     * @return LODB_OK on success, LODB_ERR_ENCODE otherwise
+     */
+    LoDbError encodeRecord(TableMetadata *table, const void *record, std::vector<uint8_t> &buffer_out);
+
+    /**
+     * Prepare a record for writeRecord(): size it for streaming, or encode it into buffer_out
+     * when the table compresses (its stored size is only known after compressing)
+     * @param buffer_out Receives the stored bytes, left empty when the record should be streamed
+     * @param length_out Receives the number of bytes writeRecord() will write
+     * @return LODB_OK on success, LODB_ERR_ENCODE otherwise
+     */
+    LoDbError prepareRecord(TableMetadata *table, const void *record, std::vector<uint8_t> &buffer_out, size_t *length_out);
+
+    /**
+     * Write a record's encoded bytes to an open file
+     * Without data the record is encoded straight into the file through a small chunk buffer.
+     * @param data Encoded record bytes, or NULL to encode record
+     * @param record Record to encode when data is NULL
+     * @param length Number of encoded bytes (from pb_get_encoded_size() when encoding)
+     * @return LODB_OK on success, LODB_ERR_IO if the write fell short, LODB_ERR_ENCODE if encoding failed
+     */
+    LoDbError writeRecord(TableMetadata *table, File &file, const uint8_t *data, const void *record, size_t length);
+
+    /**
+     * Decode a record straight from a file positioned at its stored bytes, through a small chunk buffer
+     * Compressed records are read whole and decompressed first.
+     * @param size Number of stored bytes
+     * @param record_out Buffer to store decoded record (must be at least record_size bytes)
+     * @return LODB_OK on success, LODB_ERR_IO on a short read, LODB_ERR_DECODE otherwise
+     */
+    LoDbError decodeRecord(TableMetadata *table, File &file, size_t size, void *record_out);
+
+    /**
+     * Decode a stored record into a caller-provided struct
+     * @param table Table the record belongs to
+     * @param buffer Stored bytes (protobuf, or compressed)
+     * @param size Number of stored bytes
+     * @param record_out Buffer to store decoded record (must be at least record_size bytes)
+     * @return LODB_OK on success, LODB_ERR_DECODE otherwise
+     */
+    LoDbError decodeRecord(TableMetadata *table, const uint8_t *buffer, size_t size, void *record_out);
+
+    /**
+     * Replace compressed stored bytes with the protobuf bytes they hold (plain bytes are left alone)
+     * @return LODB_OK on success, LODB_ERR_DECODE if they can't be decompressed
+     */
+    LoDbError unpackRecord(TableMetadata *table, std::vector<uint8_t> &buffer);
+};
+
+/**
+ * Iterator over the {uuid}.pr record files of a files table
+ *
+ * Sharded tables are walked one shard directory at a time, so only the table
+ * directory and a single shard are held open.
+ */
+class LoDbRecordWalk
+{
+  public:
+    LoDbRecordWalk();
+    LoDbRecordWalk(LoDbRecordWalk &&other);
+    LoDbRecordWalk &operator=(LoDbRecordWalk &&other);
+    LoDbRecordWalk(const LoDbRecordWalk &) = delete;
+    LoDbRecordWalk &operator=(const LoDbRecordWalk &) = delete;
+    ~LoDbRecordWalk();
+
+    /**
+     * Start walking a table directory
+     * @param table_path Table directory
+     * @param layout Layout of the table's record files
+     * @param io Counters of the directory entries opened, or NULL
+     * @return LODB_OK on success (a missing directory walks no records), LODB_ERR_IO if table_path is not a directory
+     */
+    LoDbError open(const char *table_path, LoDbLayout layout, LoDbIoCounters *io = nullptr);
+
+    /**
+     * Advance to the next record file and parse its UUID from the entry name
+     * @param file_out Receives the open entry for reading, or NULL to close it unread
+     * @param uuid_out UUID parsed from the file name
+     * @return true if a record file was found, false once every record was visited
+     */
+    bool next(File *file_out, lodb_uuid_t *uuid_out);
+
+    /**
+     * Release the open directories (also done by the destructor)
+     */
+    void close();
+
+  private:
+    char root_path[160];
+    LoDbLayout layout;
+    File root;  // Table directory
+    File shard; // Current shard directory (sharded layouts)
+    bool root_open;
+    bool shard_open;
+    LoDbIoCounters *io;
+};
+
+/**
+ * Streaming cursor returned by LoDb::scan()
+ *
+ * Holds the table directory (or current segment) open between calls. The cursor
+ * must not outlive its database, and the table must not be dropped while it is open.
+ * Records inserted or deleted during a scan may or may not be visited.
+ */
+class LoDbCursor
+{
+  public:
+    /**
+     * Create a closed cursor (next() always returns false)
+     */
+    LoDbCursor();
+    LoDbCursor(LoDbCursor &&other);
+    LoDbCursor &operator=(LoDbCursor &&other);
+    LoDbCursor(const LoDbCursor &) = delete;
+    LoDbCursor &operator=(const LoDbCursor &) = delete;
+    ~LoDbCursor();
+
+    /**
+     * Decode the next matching record
+     * @param record_out Buffer to store decoded record (must be at least record_size bytes), reused for every row
+     * @param uuid_out Optional pointer to receive the UUID of the record
+     * @return true if a record was decoded, false when the scan is exhausted
+     */
+    bool next(void *record_out, lodb_uuid_t *uuid_out = nullptr);
+
+    /**
+     * Skip matching records without returning them
+     * Without a filter, skipped records are neither read nor decoded.
+     * @param count Number of matching records to skip
+     * @return Number of records actually skipped (less than count if the scan ran out)
+     */
+    size_t skip(size_t count);
+
+    /**
+     * Release the directory or segment held by the cursor (also done by the destructor)
+     */
+    void close();
+
+    /**
+     * @return true until the scan is exhausted or closed
+     */
+    bool isOpen() const { return table != nullptr; }
+
+  private:
+    friend class LoDb;
+
+    LoDb *db;
+    LoDb::TableMetadata *table;
+    LoDbFilter filter;
+    LoDbWhere where; // Bound to the table's descriptor when the cursor is opened
+    LoDbRecordWalk walk;                // Record files (LODB_STORAGE_FILES)
+    LoDbSegmentScan *segment_scan;      // Segment scan state (LODB_STORAGE_SEGMENT_LOG)
+    LoDbRingScan *ring_scan;            // Slot scan state (LODB_STORAGE_RING)
+    std::vector<uint8_t> buffer;        // Encoded bytes of the current record, when the where clause needs them
+
+    /**
+     * Fetch the next record passing the where clause and decode it, before filtering
+     * @param record_out Output buffer, or NULL to only check the where clause without decoding
+     */
+    bool readNext(void *record_out, lodb_uuid_t *uuid_out);
+    bool readNextFile(void *record_out, lodb_uuid_t *uuid_out);
+    bool readNextPayload(void *record_out, lodb_uuid_t *uuid_out);
+
+    /**
+     * Advance the segment or ring scan, leaving its file positioned at the record's bytes
+     */
+    bool nextPayload(lodb_uuid_t *uuid_out, uint32_t *length_out);
 };
@@ -0,0 +1,390 @@
+#include "LoDBAsync.h"
+#include "configuration.h"
+#include <Arduino.h>
+#include <cstring>
+
+#ifdef LODB_HOST
+LoDbAsync::LoDbAsync(LoDb *db, size_t max_depth)
+    : db(db), max_depth(max_depth), coalesced(0), sweep_interval_ms(0), sweep_budget_ms(LODB_SWEEP_BUDGET_MS_DEFAULT),
+      last_sweep(0), sweep_due(false), paused(false), running(false), stopping(false)
+{
+    worker = std::thread(&LoDbAsync::workerLoop, this);
+}
+
+LoDbAsync::~LoDbAsync()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join(); // The worker drains the queue before it exits
+}
+#else
+LoDbAsync::LoDbAsync(LoDb *db, size_t max_depth)
+    : concurrency::OSThread("LoDbAsync"), db(db), max_depth(max_depth), coalesced(0), sweep_interval_ms(0),
+      sweep_budget_ms(LODB_SWEEP_BUDGET_MS_DEFAULT), last_sweep(0), sweep_due(false), paused(false)
+{
+}
+
+LoDbAsync::~LoDbAsync()
+{
+    flush();
+}
+#endif
+
+LoDbError LoDbAsync::insertAsync(const char *table_name, lodb_uuid_t uuid, const void *record, LoDbDoneCallback done)
+{
+    LoDb::TableMetadata *table = table_name ? db->getTable(table_name) : nullptr;
+    if (!table || !record) {
+        return LODB_ERR_INVALID;
+    }
+
+    Request request;
+    request.kind = REQUEST_INSERT;
+    request.table_name = table_name;
+    request.uuid = uuid;
+    request.record.assign((const uint8_t *)record, (const uint8_t *)record + table->record_size);
+    request.limit = 0;
+    request.done = done;
+    return enqueue(request);
+}
+
+LoDbError LoDbAsync::updateAsync(const char *table_name, lodb_uuid_t uuid, const void *record, LoDbDoneCallback done)
+{
+    LoDb::TableMetadata *table = table_name ? db->getTable(table_name) : nullptr;
+    if (!table || !record) {
+        return LODB_ERR_INVALID;
+    }
+
+    Request request;
+    request.kind = REQUEST_UPDATE;
+    request.table_name = table_name;
+    request.uuid = uuid;
+    request.record.assign((const uint8_t *)record, (const uint8_t *)record + table->record_size);
+    request.limit = 0;
+    request.done = done;
+    return enqueue(request);
+}
+
+LoDbError LoDbAsync::selectAsync(const char *table_name, LoDbSelectCallback selected, LoDbFilter filter,
+                                 LoDbComparator comparator, size_t limit)
+{
+    if (!table_name || !db->getTable(table_name)) {
+        return LODB_ERR_INVALID;
+    }
+
+    Request request;
+    request.kind = REQUEST_SELECT;
+    request.table_name = table_name;
+    request.uuid = 0;
+    request.filter = filter;
+    request.comparator = comparator;
+    request.limit = limit;
+    request.selected = selected;
+    return enqueue(request);
+}
+
+LoDbError LoDbAsync::countAsync(const char *table_name, LoDbCountCallback counted, LoDbFilter filter)
+{
+    if (!table_name || !db->getTable(table_name)) {
+        return LODB_ERR_INVALID;
+    }
+
+    Request request;
+    request.kind = REQUEST_COUNT;
+    request.table_name = table_name;
+    request.uuid = 0;
+    request.filter = filter;
+    request.limit = 0;
+    request.counted = counted;
+    return enqueue(request);
+}
+
+LoDbError LoDbAsync::enqueue(Request &request)
+{
+#ifdef LODB_HOST
+    std::lock_guard<std::mutex> guard(lock);
+#endif
+
+    // Merged requests don't take a queue slot, so coalescing also relieves backpressure
+    if (coalesce(request)) {
+        coalesced++;
+        return LODB_OK;
+    }
+
+    if (queue.size() >= max_depth) {
+        LOG_WARN("LoDB async queue full (%d requests), rejecting request on %s", (int)queue.size(), request.table_name.c_str());
+        return LODB_ERR_BUSY;
+    }
+
+    queue.push_back(std::move(request));
+#ifdef LODB_HOST
+    wake.notify_one();
+#else
+    enabled = true;
+    setIntervalFromNow(0);
+#endif
+    return LODB_OK;
+}
+
+bool LoDbAsync::coalesce(Request &request)
+{
+    // Unfiltered counts queued back to back return the same number
+    if (request.kind == REQUEST_COUNT) {
+        if (request.filter || queue.empty()) {
+            return false;
+        }
+        Request &tail = queue.back();
+        if (tail.kind != REQUEST_COUNT || tail.filter || tail.table_name != request.table_name) {
+            return false;
+        }
+        LoDbCountCallback first = tail.counted;
+        LoDbCountCallback second = request.counted;
+        tail.counted = [first, second](int count) {
+            if (first) {
+                first(count);
+            }
+            if (second) {
+                second(count);
+            }
+        };
+        return true;
+    }
+
+    if (request.kind != REQUEST_UPDATE) {
+        return false;
+    }
+
+    // The earlier update's version is never observed if nothing in between reads the table,
+    // and both updates succeed or fail together, so only the later version needs writing
+    for (auto it = queue.rbegin(); it != queue.rend(); ++it) {
+        if (it->table_name != request.table_name) {
+            continue;
+        }
+        if (it->kind == REQUEST_SELECT || it->kind == REQUEST_COUNT) {
+            return false;
+        }
+        if (it->uuid != request.uuid) {
+            continue;
+        }
+        if (it->kind != REQUEST_UPDATE) {
+            return false; // An insert of the same UUID may fail where the update wouldn't
+        }
+
+        it->record.swap(request.record);
+        LoDbDoneCallback first = it->done;
+        LoDbDoneCallback second = request.done;
+        it->done = [first, second](LoDbError result) {
+            if (first) {
+                first(result);
+            }
+            if (second) {
+                second(result);
+            }
+        };
+        return true;
+    }
+    return false;
+}
+
+void LoDbAsync::execute(Request &request)
+{
+    const char *table_name = request.table_name.c_str();
+    switch (request.kind) {
+    case REQUEST_INSERT: {
+        LoDbError result = db->insert(table_name, request.uuid, request.record.data());
+        if (request.done) {
+            request.done(result);
+        }
+        break;
+    }
+    case REQUEST_UPDATE: {
+        LoDbError result = db->update(table_name, request.uuid, request.record.data());
+        if (request.done) {
+            request.done(result);
+        }
+        break;
+    }
+    case REQUEST_SELECT: {
+        std::vector<void *> records = db->select(table_name, request.filter, request.comparator, request.limit);
+        if (request.selected) {
+            request.selected(records);
+        } else {
+            db->freeRecords(records);
+        }
+        break;
+    }
+    case REQUEST_COUNT: {
+        int count = db->count(table_name, request.filter);
+        if (request.counted) {
+            request.counted(count);
+        }
+        break;
+    }
+    }
+}
+
+uint32_t LoDbAsync::sweepDelay() const
+{
+    uint32_t elapsed = millis() - last_sweep;
+    return sweep_due || elapsed >= sweep_interval_ms ? 0 : sweep_interval_ms - elapsed;
+}
+
+#ifdef LODB_HOST
+void LoDbAsync::setSweepInterval(uint32_t interval_ms, uint32_t budget_ms)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        sweep_interval_ms = interval_ms;
+        sweep_budget_ms = budget_ms;
+        sweep_due = interval_ms > 0;
+    }
+    wake.notify_one();
+}
+
+void LoDbAsync::pause()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    paused = true;
+}
+
+void LoDbAsync::resume()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        paused = false;
+    }
+    wake.notify_one();
+}
+
+void LoDbAsync::flush()
+{
+    resume();
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [this] { return queue.empty() && !running; });
+}
+
+size_t LoDbAsync::pending()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return queue.size();
+}
+
+void LoDbAsync::workerLoop()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    auto woken = [this] { return stopping || (!paused && !queue.empty()); };
+    while (true) {
+        if (sweep_interval_ms == 0 || paused) {
+            wake.wait(guard, woken);
+        } else {
+            wake.wait_for(guard, std::chrono::milliseconds(sweepDelay()), woken);
+        }
+        if (queue.empty() && stopping) {
+            break; // Every request has run
+        }
+        if (paused && !stopping) {
+            continue; // Paused while waiting for the next sweep
+        }
+
+        // Sweep slices run only while no request is waiting
+        if (queue.empty()) {
+            if (sweep_interval_ms > 0 && sweepDelay() == 0) {
+                uint32_t budget_ms = sweep_budget_ms;
+                running = true;
+                guard.unlock();
+                bool more = db->sweepAllExpired(budget_ms) == LODB_ERR_BUSY;
+                guard.lock();
+                running = false;
+
+                // Continue right away while expired records are left
+                sweep_due = more;
+                last_sweep = millis();
+                idle.notify_all();
+            }
+            continue;
+        }
+
+        Request request = std::move(queue.front());
+        queue.pop_front();
+        running = true;
+
+        // Callers keep queueing while the request runs
+        guard.unlock();
+        execute(request);
+        guard.lock();
+
+        running = false;
+        if (queue.empty()) {
+            idle.notify_all();
+        }
+    }
+}
+#else
+void LoDbAsync::setSweepInterval(uint32_t interval_ms, uint32_t budget_ms)
+{
+    sweep_interval_ms = interval_ms;
+    sweep_budget_ms = budget_ms;
+    sweep_due = interval_ms > 0;
+    if (interval_ms > 0) {
+        enabled = true;
+        setIntervalFromNow(0);
+    }
+}
+
+void LoDbAsync::pause()
+{
+    paused = true;
+}
+
+void LoDbAsync::resume()
+{
+    paused = false;
+    if (!queue.empty() || sweep_interval_ms > 0) {
+        enabled = true;
+        setIntervalFromNow(0);
+    }
+}
+
+void LoDbAsync::flush()
+{
+    paused = false;
+    while (!queue.empty()) {
+        Request request = std::move(queue.front());
+        queue.pop_front();
+        execute(request);
+    }
+}
+
+size_t LoDbAsync::pending()
+{
+    return queue.size();
+}
+
+int32_t LoDbAsync::runOnce()
+{
+    if (paused) {
+        return disable(); // resume() enables the thread again
+    }
+
+    // One request per pass keeps the main loop (radio, router) responsive
+    if (!queue.empty()) {
+        Request request = std::move(queue.front());
+        queue.pop_front();
+        execute(request);
+        if (!queue.empty()) {
+            return 0;
+        }
+    } else if (sweep_interval_ms > 0 && sweepDelay() == 0) {
+        // Sweep slices take a pass of their own, continued on the next pass while expired records are left
+        sweep_due = db->sweepAllExpired(sweep_budget_ms) == LODB_ERR_BUSY;
+        last_sweep = millis();
+    }
+
+    if (sweep_interval_ms == 0) {
+        return disable();
+    }
+    return sweepDelay();
+}
+#endif
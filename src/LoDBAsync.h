@@ -0,0 +1,201 @@
+#pragma once
+
+#include "LoDB.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef LODB_HOST
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#else
+#include "concurrency/OSThread.h"
+#endif
+
+// Default number of requests an async front end queues before rejecting new ones
+#define LODB_ASYNC_QUEUE_DEPTH_DEFAULT 16
+
+/**
+ * Completion callback of insertAsync() and updateAsync()
+ * @param result Result of the underlying LoDb call
+ */
+typedef std::function<void(LoDbError)> LoDbDoneCallback;
+
+/**
+ * Completion callback of selectAsync()
+ * @param records Selected records, owned by the callback (free with LoDb::freeRecords())
+ */
+typedef std::function<void(std::vector<void *> &)> LoDbSelectCallback;
+
+/**
+ * Completion callback of countAsync()
+ * @param count Number of matching records, -1 on error
+ */
+typedef std::function<void(int)> LoDbCountCallback;
+
+/**
+ * Asynchronous front end of a LoDb
+ *
+ * Requests are queued and executed in order by a worker, so callers such as
+ * handleReceived() return without waiting for flash or SD writes. In the firmware
+ * the worker is an OSThread run from the main loop, one request per pass; host
+ * builds (LODB_HOST) use a std::thread. Completion callbacks run on the worker.
+ *
+ * The queue is bounded: once max_depth requests are waiting, new requests are
+ * rejected with LODB_ERR_BUSY. Before that check, an update is merged into a queued
+ * update of the same record when nothing queued in between reads the table, and an
+ * unfiltered count joins an identical count at the tail of the queue.
+ *
+ * The worker can also sweep expired records of TTL tables in the background, see
+ * setSweepInterval().
+ *
+ * Tables must be registered before requests are queued. While requests are pending,
+ * use the LoDb only through this front end (or call flush() first). On host builds
+ * a background sweep runs on the worker thread too, so the same applies while sweeping
+ * is enabled.
+ */
+class LoDbAsync
+#ifndef LODB_HOST
+    : private concurrency::OSThread
+#endif
+{
+  public:
+    /**
+     * @param db Database to run requests on (must outlive this object)
+     * @param max_depth Maximum number of queued requests
+     */
+    LoDbAsync(LoDb *db, size_t max_depth = LODB_ASYNC_QUEUE_DEPTH_DEFAULT);
+
+    /**
+     * Runs every queued request before returning
+     */
+    ~LoDbAsync();
+
+    /**
+     * Queue an insert (the record is copied)
+     * @return LODB_OK if queued, LODB_ERR_INVALID if the table is not registered, LODB_ERR_BUSY if the queue is full
+     */
+    LoDbError insertAsync(const char *table_name, lodb_uuid_t uuid, const void *record, LoDbDoneCallback done = LoDbDoneCallback());
+
+    /**
+     * Queue an update (the record is copied), merged into a queued update of the same record when safe
+     * @return LODB_OK if queued, LODB_ERR_INVALID if the table is not registered, LODB_ERR_BUSY if the queue is full
+     */
+    LoDbError updateAsync(const char *table_name, lodb_uuid_t uuid, const void *record, LoDbDoneCallback done = LoDbDoneCallback());
+
+    /**
+     * Queue a select (see LoDb::select())
+     * @return LODB_OK if queued, LODB_ERR_INVALID if the table is not registered, LODB_ERR_BUSY if the queue is full
+     */
+    LoDbError selectAsync(const char *table_name, LoDbSelectCallback selected, LoDbFilter filter = LoDbFilter(),
+                          LoDbComparator comparator = LoDbComparator(), size_t limit = 0);
+
+    /**
+     * Queue a count (see LoDb::count()), joining an identical unfiltered count at the tail of the queue
+     * @return LODB_OK if queued, LODB_ERR_INVALID if the table is not registered, LODB_ERR_BUSY if the queue is full
+     */
+    LoDbError countAsync(const char *table_name, LoDbCountCallback counted, LoDbFilter filter = LoDbFilter());
+
+    /**
+     * Sweep expired records between requests (see LoDb::sweepAllExpired())
+     * The first sweep runs right away. A sweep that leaves expired records behind is
+     * continued slice by slice on the next passes; otherwise the worker waits interval_ms.
+     * Queued requests always run before the next slice.
+     * @param interval_ms Time between sweeps (0 stops sweeping)
+     * @param budget_ms Time one slice may take
+     */
+    void setSweepInterval(uint32_t interval_ms, uint32_t budget_ms = LODB_SWEEP_BUDGET_MS_DEFAULT);
+
+    /**
+     * Hold the worker: queued requests and sweeps wait until resume() or flush()
+     * Lets a caller queue a burst knowing none of it has started, e.g. to check merging.
+     */
+    void pause();
+
+    /**
+     * Let the worker run queued requests and sweeps again
+     */
+    void resume();
+
+    /**
+     * Wait until every queued request has run (runs them on the calling thread in the firmware)
+     * A paused worker is resumed first.
+     */
+    void flush();
+
+    /**
+     * Number of queued requests
+     */
+    size_t pending();
+
+    /**
+     * Number of requests merged into queued ones instead of taking a queue slot
+     */
+    uint32_t coalescedCount() const { return coalesced; }
+
+  private:
+    typedef enum { REQUEST_INSERT, REQUEST_UPDATE, REQUEST_SELECT, REQUEST_COUNT } RequestKind;
+
+    struct Request {
+        RequestKind kind;
+        std::string table_name;
+        lodb_uuid_t uuid;
+        std::vector<uint8_t> record; // Copy of the record to write
+        LoDbFilter filter;
+        LoDbComparator comparator;
+        size_t limit;
+        LoDbDoneCallback done;
+        LoDbSelectCallback selected;
+        LoDbCountCallback counted;
+    };
+
+    LoDb *db;
+    size_t max_depth;
+    std::deque<Request> queue;
+    uint32_t coalesced;
+    uint32_t sweep_interval_ms; // 0 when background sweeps are off
+    uint32_t sweep_budget_ms;
+    uint32_t last_sweep;        // millis() when the last slice ended
+    bool sweep_due;             // Run a slice as soon as the queue is empty
+    bool paused;                // Between pause() and resume(): nothing is started
+
+#ifdef LODB_HOST
+    std::mutex lock;
+    std::condition_variable wake;    // Signalled when a request is queued or the worker must stop
+    std::condition_variable idle;    // Signalled when the queue drains
+    bool running;                    // A request is being executed
+    bool stopping;
+    std::thread worker;
+
+    void workerLoop();
+#else
+    virtual int32_t runOnce() override;
+#endif
+
+    /**
+     * Queue a request, or merge it into a queued one
+     * @return LODB_OK if queued or merged, LODB_ERR_BUSY if the queue is full
+     */
+    LoDbError enqueue(Request &request);
+
+    /**
+     * Merge a request into a queued one when the outcome is the same as running both
+     * @return true if merged
+     */
+    bool coalesce(Request &request);
+
+    /**
+     * Run one request and deliver its result
+     */
+    void execute(Request &request);
+
+    /**
+     * Milliseconds until the next sweep slice is due (0 if due now)
+     */
+    uint32_t sweepDelay() const;
+};
@@ -0,0 +1,137 @@
+#include "LoDBBloom.h"
+#include "LoDBBytes.h"
+#include "configuration.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define BLOOM_MAGIC "LBF1"
+#define BLOOM_HEADER_SIZE 16
+#define BLOOM_MIN_BITS 64
+#define BLOOM_MAX_HASHES 16
+#define BLOOM_LN2 0.69314718055994530942
+
+// Mix a UUID into two independent 32-bit hashes (splitmix64 finalizer); sequential UUIDs spread well
+static uint64_t mixUuid(lodb_uuid_t uuid)
+{
+    uint64_t z = uuid + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+LoDbBloom::LoDbBloom(const char *dir_path, size_t capacity, float false_positive_rate)
+    : bit_count(0), hash_count(0), saved(false), io(nullptr)
+{
+    snprintf(file_path, sizeof(file_path), "%s/_bloom", dir_path);
+
+    // Optimal size for n UUIDs at rate p: m = -n ln(p) / ln(2)^2 bits and k = m/n ln(2) hashes
+    double n = capacity > 0 ? (double)capacity : 1.0;
+    double p = false_positive_rate > 0.0f && false_positive_rate < 1.0f ? false_positive_rate : 0.01;
+    double m = std::ceil(-n * std::log(p) / (BLOOM_LN2 * BLOOM_LN2));
+    bit_count = m < BLOOM_MIN_BITS ? BLOOM_MIN_BITS : (uint32_t)m;
+    bit_count = (bit_count + 7) & ~7u;
+
+    long k = std::lround(bit_count / n * BLOOM_LN2);
+    hash_count = k < 1 ? 1 : (k > BLOOM_MAX_HASHES ? BLOOM_MAX_HASHES : (uint32_t)k);
+
+    bits.assign(bit_count / 8, 0);
+}
+
+bool LoDbBloom::load()
+{
+    saved = false;
+    std::fill(bits.begin(), bits.end(), 0);
+
+    auto file = lodb_open(file_path, FILE_O_READ, io);
+    if (!file) {
+        return false;
+    }
+
+    uint8_t header[BLOOM_HEADER_SIZE];
+    bool valid = file.size() == BLOOM_HEADER_SIZE + bits.size() && lodb_read(file, header, sizeof(header), io) == sizeof(header) &&
+                 memcmp(header, BLOOM_MAGIC, 4) == 0 && lodb_get_le32(header + 4) == bit_count &&
+                 lodb_get_le32(header + 8) == hash_count && lodb_read(file, bits.data(), bits.size(), io) == bits.size() &&
+                 lodb_get_le32(header + 12) == lodb_fnv1a(LODB_FNV_OFFSET_BASIS, bits.data(), bits.size());
+    file.close();
+
+    if (!valid) {
+        // Written with other sizing options, or torn by a power loss
+        LOG_WARN("Ignoring invalid Bloom filter: %s", file_path);
+        std::fill(bits.begin(), bits.end(), 0);
+        return false;
+    }
+
+    saved = true;
+    return true;
+}
+
+void LoDbBloom::save()
+{
+    if (saved) {
+        return;
+    }
+
+    uint8_t header[BLOOM_HEADER_SIZE];
+    memcpy(header, BLOOM_MAGIC, 4);
+    lodb_put_le32(header + 4, bit_count);
+    lodb_put_le32(header + 8, hash_count);
+    lodb_put_le32(header + 12, lodb_fnv1a(LODB_FNV_OFFSET_BASIS, bits.data(), bits.size()));
+
+    LoFS::remove(file_path);
+    auto file = lodb_open(file_path, FILE_O_WRITE, io);
+    if (!file) {
+        LOG_WARN("Failed to save Bloom filter: %s", file_path);
+        return;
+    }
+    size_t written = lodb_write(file, header, sizeof(header), io);
+    written += lodb_write(file, bits.data(), bits.size(), io);
+    file.close();
+
+    saved = written == sizeof(header) + bits.size();
+}
+
+bool LoDbBloom::invalidate()
+{
+    if (!saved) {
+        return true;
+    }
+
+    if (!LoFS::remove(file_path) && LoFS::exists(file_path)) {
+        LOG_WARN("Failed to invalidate Bloom filter: %s", file_path);
+        return false;
+    }
+    saved = false;
+    return true;
+}
+
+void LoDbBloom::add(lodb_uuid_t uuid)
+{
+    uint64_t hash = mixUuid(uuid);
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0; i < hash_count; i++) {
+        uint32_t bit = (h1 + i * h2) % bit_count;
+        bits[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+    }
+}
+
+bool LoDbBloom::mightContain(lodb_uuid_t uuid) const
+{
+    uint64_t hash = mixUuid(uuid);
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0; i < hash_count; i++) {
+        uint32_t bit = (h1 + i * h2) % bit_count;
+        if (!(bits[bit >> 3] & (1 << (bit & 7)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LoDbBloom::clear()
+{
+    std::fill(bits.begin(), bits.end(), 0);
+    saved = false; // Any file left behind is a superset, rewritten at the next save()
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "LoDB.h"
+#include "lofs/src/LoFS.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * LoDB Bloom Filter
+ *
+ * Set of the UUIDs stored in a files table, kept in RAM so lookups of UUIDs that
+ * were never inserted are answered without opening a file. Answers "definitely
+ * absent" or "maybe present"; deletions are not removed, they only cost a probe.
+ *
+ * File {dir_path}/_bloom (little-endian):
+ *   [4 bytes magic "LBF1"][4 bytes bit count][4 bytes hash count][4 bytes FNV-1a of the bits][bits]
+ *
+ * The file is removed before the first UUID is added after a load and written again
+ * at save(), so a power loss in between leaves no file rather than one missing UUIDs.
+ */
+class LoDbBloom
+{
+  public:
+    /**
+     * Size the filter for an expected number of UUIDs
+     * @param dir_path Directory holding the filter file (the table path)
+     * @param capacity Expected number of UUIDs (the false positive rate rises beyond it)
+     * @param false_positive_rate Target rate of "maybe present" answers for absent UUIDs (0 < rate < 1)
+     */
+    LoDbBloom(const char *dir_path, size_t capacity, float false_positive_rate);
+
+    /**
+     * Load the saved filter
+     * @return true if the file matched this filter's size and checksum, false if the filter must be rebuilt
+     */
+    bool load();
+
+    /**
+     * Write the filter to disk unless the file already holds it
+     * Only call once the filter covers every UUID in the table.
+     */
+    void save();
+
+    /**
+     * Remove the saved filter before the first change, so a stale copy can't be loaded after a restart
+     * @return false if the file exists and could not be removed
+     */
+    bool invalidate();
+
+    /**
+     * Add a UUID (call invalidate() before the record reaches storage)
+     */
+    void add(lodb_uuid_t uuid);
+
+    /**
+     * Whether a UUID may be in the set
+     * @return false if the UUID was definitely never added
+     */
+    bool mightContain(lodb_uuid_t uuid) const;
+
+    /**
+     * Remove every UUID
+     */
+    void clear();
+
+    /**
+     * Number of bits in the filter
+     */
+    size_t bitCount() const { return bit_count; }
+
+    /**
+     * Number of hash functions per UUID
+     */
+    uint32_t hashCount() const { return hash_count; }
+
+    /**
+     * Count the filter's storage traffic in these counters (NULL stops counting)
+     */
+    void setIoCounters(LoDbIoCounters *counters) { io = counters; }
+
+  private:
+    char file_path[192];
+    std::vector<uint8_t> bits;
+    uint32_t bit_count;
+    uint32_t hash_count;
+    bool saved; // Whether the file holds the current bits
+    LoDbIoCounters *io;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Little-endian integer packing and checksums shared by LoDB's on-disk formats
+ */
+
+static inline void lodb_put_le32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static inline void lodb_put_le64(uint8_t *out, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static inline uint32_t lodb_get_le32(const uint8_t *in)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static inline uint64_t lodb_get_le64(const uint8_t *in)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+/**
+ * 32-bit FNV-1a, used as a checksum by LoDB's on-disk formats
+ * @param hash Running hash (start with LODB_FNV_OFFSET_BASIS)
+ */
+#define LODB_FNV_OFFSET_BASIS 2166136261u
+
+static inline uint32_t lodb_fnv1a(uint32_t hash, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
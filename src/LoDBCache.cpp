@@ -0,0 +1,101 @@
+#include "LoDBCache.h"
+#include <cstring>
+#include <iterator>
+
+// Approximate heap bookkeeping per cached record (list node, map node, allocation headers)
+#define CACHE_ENTRY_OVERHEAD 64
+
+LoDbRecordCache::LoDbRecordCache(size_t capacity_bytes)
+    : capacity_bytes(capacity_bytes), used_bytes(0), hits(0), misses(0), evictions(0)
+{
+}
+
+LoDbRecordCache::~LoDbRecordCache()
+{
+    for (Entry &entry : lru) {
+        delete[] entry.data;
+    }
+}
+
+bool LoDbRecordCache::get(const void *table, lodb_uuid_t uuid, void *record_out, size_t record_size)
+{
+    auto it = entries.find(Key(table, uuid));
+    if (it == entries.end() || it->second->size != record_size) {
+        misses++;
+        return false;
+    }
+
+    lru.splice(lru.begin(), lru, it->second);
+    memcpy(record_out, it->second->data, record_size);
+    hits++;
+    return true;
+}
+
+uint8_t *LoDbRecordCache::put(const void *table, lodb_uuid_t uuid, size_t record_size)
+{
+    Key key(table, uuid);
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        if (it->second->size == record_size) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->data;
+        }
+        remove(it->second);
+    }
+
+    size_t cost = record_size + CACHE_ENTRY_OVERHEAD;
+    if (cost > capacity_bytes) {
+        return nullptr;
+    }
+
+    while (used_bytes + cost > capacity_bytes) {
+        remove(std::prev(lru.end()));
+        evictions++;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.data = new uint8_t[record_size];
+    entry.size = record_size;
+    lru.push_front(entry);
+    entries[key] = lru.begin();
+    used_bytes += cost;
+    return entry.data;
+}
+
+void LoDbRecordCache::erase(const void *table, lodb_uuid_t uuid)
+{
+    auto it = entries.find(Key(table, uuid));
+    if (it != entries.end()) {
+        remove(it->second);
+    }
+}
+
+void LoDbRecordCache::eraseTable(const void *table)
+{
+    // Keys sort by table first, so a table's records are contiguous
+    auto it = entries.lower_bound(Key(table, 0));
+    while (it != entries.end() && it->first.first == table) {
+        EntryIterator entry = (it++)->second;
+        remove(entry);
+    }
+}
+
+LoDbCacheStats LoDbRecordCache::stats() const
+{
+    LoDbCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    stats.entries = lru.size();
+    stats.bytes = used_bytes;
+    return stats;
+}
+
+void LoDbRecordCache::remove(EntryIterator entry)
+{
+    used_bytes -= entry->size + CACHE_ENTRY_OVERHEAD;
+    entries.erase(entry->key);
+    delete[] entry->data;
+    lru.erase(entry);
+}
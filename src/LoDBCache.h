@@ -0,0 +1,80 @@
+#pragma once
+
+#include "LoDB.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <utility>
+
+/**
+ * LoDB Record Cache
+ *
+ * Decoded records of every table of a database, keyed by (table, UUID) and bounded by
+ * a byte budget. A hit is a single memcpy into the caller's struct; when the budget is
+ * exceeded the least recently used records are evicted. The cache holds copies of the
+ * nanopb structs as decoded from storage, so LoDb only uses it for tables whose messages
+ * have no pointer or callback fields, and writes just erase the record.
+ */
+class LoDbRecordCache
+{
+  public:
+    /**
+     * @param capacity_bytes Byte budget, counting each record's struct size plus bookkeeping
+     */
+    explicit LoDbRecordCache(size_t capacity_bytes);
+
+    ~LoDbRecordCache();
+
+    /**
+     * Copy a cached record out and mark it most recently used
+     * @param table Identity of the table the record belongs to
+     * @param uuid UUID of the record
+     * @param record_out Buffer receiving record_size bytes
+     * @param record_size Size of the table's record struct
+     * @return true on a hit, false if the record is not cached
+     */
+    bool get(const void *table, lodb_uuid_t uuid, void *record_out, size_t record_size);
+
+    /**
+     * Reserve the most recently used slot for a record, evicting others to make room
+     * @return Slot of record_size bytes to fill, NULL if the record can't fit the budget
+     */
+    uint8_t *put(const void *table, lodb_uuid_t uuid, size_t record_size);
+
+    /**
+     * Forget a record (no-op if it is not cached)
+     */
+    void erase(const void *table, lodb_uuid_t uuid);
+
+    /**
+     * Forget every record of a table
+     */
+    void eraseTable(const void *table);
+
+    /**
+     * Hit, miss and eviction counters and current usage
+     */
+    LoDbCacheStats stats() const;
+
+  private:
+    typedef std::pair<const void *, lodb_uuid_t> Key;
+
+    struct Entry {
+        Key key;
+        uint8_t *data;
+        size_t size;
+    };
+
+    typedef std::list<Entry>::iterator EntryIterator;
+
+    std::list<Entry> lru;                  // Most recently used first
+    std::map<Key, EntryIterator> entries;  // Lookup by (table, UUID)
+    size_t capacity_bytes;
+    size_t used_bytes;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+
+    void remove(EntryIterator entry);
+};
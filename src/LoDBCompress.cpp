@@ -0,0 +1,312 @@
+#include "LoDBCompress.h"
+#include "LoDBBytes.h"
+#include "configuration.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#define LODB_CODEC_LZ 0x01      // LZ sequences
+#define LODB_CODEC_LZ_DICT 0x02 // LZ sequences that may refer into the dictionary
+#define LODB_CODEC_MIN_MATCH 4
+#define LODB_CODEC_MAX_OFFSET 65535
+#define LODB_CODEC_HASH_BITS 11
+#define LODB_CODEC_TRAIN_GRAM 8        // Substring length whose sample frequency drives training
+#define LODB_CODEC_TRAIN_SEGMENT_MAX 256
+
+static uint32_t read32(const uint8_t *in)
+{
+    uint32_t value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+static uint32_t hashSequence(const uint8_t *in)
+{
+    return (read32(in) * 2654435761u) >> (32 - LODB_CODEC_HASH_BITS);
+}
+
+// Extension bytes of a length whose nibble is 15
+static void putLength(std::vector<uint8_t> &out, size_t length)
+{
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back((uint8_t)length);
+}
+
+static bool getLength(const uint8_t *in, size_t size, size_t *position, size_t *length)
+{
+    uint8_t byte;
+    do {
+        if (*position >= size) {
+            return false;
+        }
+        byte = in[(*position)++];
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// One sequence; a match_length of 0 makes it the final, literals-only one
+static void putSequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t literal_count, size_t offset,
+                        size_t match_length)
+{
+    size_t match_code = match_length > 0 ? match_length - LODB_CODEC_MIN_MATCH : 0;
+    out.push_back((uint8_t)(std::min<size_t>(literal_count, 15) << 4 | std::min<size_t>(match_code, 15)));
+    if (literal_count >= 15) {
+        putLength(out, literal_count - 15);
+    }
+    out.insert(out.end(), literals, literals + literal_count);
+    if (match_length == 0) {
+        return;
+    }
+
+    out.push_back((uint8_t)offset);
+    out.push_back((uint8_t)(offset >> 8));
+    if (match_code >= 15) {
+        putLength(out, match_code - 15);
+    }
+}
+
+LoDbCodec::LoDbCodec(const uint8_t *dictionary_bytes, size_t dictionary_size) : dictionary_id(0)
+{
+    if (dictionary_bytes && dictionary_size > 0) {
+        dictionary_size = std::min<size_t>(dictionary_size, LODB_DICTIONARY_MAX_SIZE);
+        dictionary.assign(dictionary_bytes, dictionary_bytes + dictionary_size);
+
+        // Never 0, so a record always names the dictionary it needs
+        uint32_t hash = lodb_fnv1a(LODB_FNV_OFFSET_BASIS, dictionary.data(), dictionary.size());
+        dictionary_id = (uint16_t)(hash ^ (hash >> 16));
+        dictionary_id = dictionary_id ? dictionary_id : 1;
+    }
+}
+
+bool LoDbCodec::compress(const uint8_t *data, size_t size, std::vector<uint8_t> &stored_out) const
+{
+    stored_out.clear();
+    stored_out.reserve(size);
+
+    stored_out.push_back(dictionary.empty() ? LODB_CODEC_LZ : LODB_CODEC_LZ_DICT);
+    if (!dictionary.empty()) {
+        stored_out.push_back((uint8_t)dictionary_id);
+        stored_out.push_back((uint8_t)(dictionary_id >> 8));
+    }
+    for (size_t length = size; true; length >>= 7) {
+        stored_out.push_back((uint8_t)(length & 0x7F) | (length >= 0x80 ? 0x80 : 0));
+        if (length < 0x80) {
+            break;
+        }
+    }
+
+    // Matches are searched in the dictionary followed by the record
+    std::vector<uint8_t> window(dictionary.size() + size);
+    std::copy(dictionary.begin(), dictionary.end(), window.begin());
+    std::copy(data, data + size, window.begin() + dictionary.size());
+    const uint8_t *in = window.data();
+    size_t end = window.size();
+
+    std::vector<uint32_t> last_seen(1u << LODB_CODEC_HASH_BITS, 0); // Position + 1 of the last 4 bytes with each hash
+    for (size_t position = 0; position + LODB_CODEC_MIN_MATCH <= dictionary.size(); position++) {
+        last_seen[hashSequence(in + position)] = position + 1;
+    }
+
+    size_t position = dictionary.size();
+    size_t anchor = position;
+    while (position + LODB_CODEC_MIN_MATCH <= end) {
+        uint32_t hash = hashSequence(in + position);
+        size_t candidate = last_seen[hash];
+        last_seen[hash] = position + 1;
+
+        if (candidate == 0 || position - (candidate - 1) > LODB_CODEC_MAX_OFFSET || read32(in + candidate - 1) != read32(in + position)) {
+            position++;
+            continue;
+        }
+
+        size_t match = candidate - 1;
+        size_t length = LODB_CODEC_MIN_MATCH;
+        while (position + length < end && in[match + length] == in[position + length]) {
+            length++;
+        }
+        putSequence(stored_out, in + anchor, position - anchor, position - match, length);
+        position += length;
+        anchor = position;
+
+        // Let the next match start inside this one
+        if (position - 2 + LODB_CODEC_MIN_MATCH <= end) {
+            last_seen[hashSequence(in + position - 2)] = position - 1;
+        }
+        if (stored_out.size() >= size) {
+            break; // Already no smaller than the record
+        }
+    }
+
+    if (stored_out.size() < size) {
+        putSequence(stored_out, in + anchor, end - anchor, 0, 0);
+    }
+    if (stored_out.size() >= size) {
+        stored_out.assign(data, data + size);
+        return false;
+    }
+    return true;
+}
+
+LoDbError LoDbCodec::decompress(const uint8_t *stored, size_t size, std::vector<uint8_t> &data_out) const
+{
+    data_out.clear();
+    if (!isCompressed(stored, size)) {
+        return LODB_ERR_DECODE;
+    }
+
+    size_t position = 1;
+    const uint8_t *history = nullptr; // Dictionary bytes matches may reach back into
+    size_t history_size = 0;
+    if (stored[0] == LODB_CODEC_LZ_DICT) {
+        if (size < 3) {
+            return LODB_ERR_DECODE;
+        }
+        uint16_t id = (uint16_t)(stored[1] | stored[2] << 8);
+        if (dictionary.empty() || id != dictionary_id) {
+            LOG_ERROR("Record needs compression dictionary %04x, table has %04x", id, dictionary_id);
+            return LODB_ERR_DECODE;
+        }
+        history = dictionary.data();
+        history_size = dictionary.size();
+        position = 3;
+    } else if (stored[0] != LODB_CODEC_LZ) {
+        return LODB_ERR_DECODE;
+    }
+
+    size_t raw_size = 0;
+    for (int shift = 0; true; shift += 7) {
+        if (position >= size || shift > 28) {
+            return LODB_ERR_DECODE;
+        }
+        uint8_t byte = stored[position++];
+        raw_size |= (size_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    if (raw_size / 255 > size) {
+        return LODB_ERR_DECODE; // More than a sequence can expand to
+    }
+    data_out.reserve(raw_size);
+
+    while (position < size) {
+        uint8_t token = stored[position++];
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !getLength(stored, size, &position, &literal_count)) {
+            return LODB_ERR_DECODE;
+        }
+        if (literal_count > size - position || literal_count > raw_size - data_out.size()) {
+            return LODB_ERR_DECODE;
+        }
+        data_out.insert(data_out.end(), stored + position, stored + position + literal_count);
+        position += literal_count;
+        if (position == size) {
+            break; // Final sequence
+        }
+
+        if (size - position < 2) {
+            return LODB_ERR_DECODE;
+        }
+        size_t offset = stored[position] | (size_t)stored[position + 1] << 8;
+        position += 2;
+        size_t length = token & 0x0F;
+        if (length == 15 && !getLength(stored, size, &position, &length)) {
+            return LODB_ERR_DECODE;
+        }
+        length += LODB_CODEC_MIN_MATCH;
+        if (offset == 0 || offset > data_out.size() + history_size || length > raw_size - data_out.size()) {
+            return LODB_ERR_DECODE;
+        }
+
+        // Byte by byte, since a match may overlap the bytes it produces
+        for (size_t i = 0; i < length; i++) {
+            size_t produced = data_out.size();
+            data_out.push_back(offset <= produced ? data_out[produced - offset] : history[history_size - (offset - produced)]);
+        }
+    }
+
+    return data_out.size() == raw_size ? LODB_OK : LODB_ERR_DECODE;
+}
+
+size_t LoDbCodec::train(const std::vector<std::vector<uint8_t>> &samples, uint8_t *dictionary_out, size_t capacity)
+{
+    if (!dictionary_out || capacity == 0) {
+        return 0;
+    }
+    capacity = std::min<size_t>(capacity, LODB_DICTIONARY_MAX_SIZE);
+
+    // Number of samples containing each substring
+    struct Frequency {
+        uint32_t samples;
+        size_t last_sample;
+    };
+    std::unordered_map<std::string, Frequency> frequency;
+    for (size_t s = 0; s < samples.size(); s++) {
+        const std::vector<uint8_t> &sample = samples[s];
+        for (size_t i = 0; i + LODB_CODEC_TRAIN_GRAM <= sample.size(); i++) {
+            Frequency &entry = frequency[std::string((const char *)sample.data() + i, LODB_CODEC_TRAIN_GRAM)];
+            if (entry.samples == 0 || entry.last_sample != s) {
+                entry.samples++;
+                entry.last_sample = s;
+            }
+        }
+    }
+
+    // Runs of shared substrings become candidate segments, scored by how widely their parts are shared
+    std::unordered_map<std::string, uint64_t> segments;
+    for (const std::vector<uint8_t> &sample : samples) {
+        size_t i = 0;
+        while (i + LODB_CODEC_TRAIN_GRAM <= sample.size()) {
+            size_t start = i;
+            uint64_t score = 0;
+            while (i + LODB_CODEC_TRAIN_GRAM <= sample.size() && i - start + LODB_CODEC_TRAIN_GRAM < LODB_CODEC_TRAIN_SEGMENT_MAX) {
+                uint32_t shared = frequency[std::string((const char *)sample.data() + i, LODB_CODEC_TRAIN_GRAM)].samples;
+                if (shared < 2) {
+                    break;
+                }
+                score += shared;
+                i++;
+            }
+            if (i == start) {
+                i++;
+                continue;
+            }
+            segments[std::string((const char *)sample.data() + start, i - start + LODB_CODEC_TRAIN_GRAM - 1)] += score;
+        }
+    }
+
+    std::vector<std::pair<uint64_t, std::string>> ranked;
+    ranked.reserve(segments.size());
+    for (auto &segment : segments) {
+        ranked.push_back(std::make_pair(segment.second, segment.first));
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const std::pair<uint64_t, std::string> &a, const std::pair<uint64_t, std::string> &b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    // Best segments go last, nearest to the record, where they stay in reach of long records
+    std::vector<const std::string *> chosen;
+    std::string joined;
+    for (auto &entry : ranked) {
+        if (joined.size() + entry.second.size() > capacity) {
+            continue;
+        }
+        if (joined.find(entry.second) != std::string::npos) {
+            continue;
+        }
+        joined += entry.second;
+        chosen.push_back(&entry.second);
+    }
+
+    size_t written = 0;
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        memcpy(dictionary_out + written, (*it)->data(), (*it)->size());
+        written += (*it)->size();
+    }
+    return written;
+}
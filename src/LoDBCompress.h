@@ -0,0 +1,80 @@
+#pragma once
+
+#include "LoDB.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Largest dictionary a codec accepts (matches reach back at most 64 KB into dictionary and record)
+#define LODB_DICTIONARY_MAX_SIZE (16 * 1024)
+
+/**
+ * LoDB Record Codec
+ *
+ * LZ77 compression of encoded records, in the LZ4 block format: each sequence is a
+ * token byte (literal count in the high nibble, match length - 4 in the low nibble,
+ * 15 meaning more length bytes follow), the literals, then a 2-byte little-endian
+ * match offset. The final sequence carries literals only. Compression uses a 2048-entry
+ * hash table (8 KB, allocated per call); decompression needs no state beyond its output.
+ *
+ * A dictionary (sample bytes typical of the table's records) acts as history the first
+ * matches of every record can refer to, which is what makes short records compress.
+ *
+ * Stored form of a compressed record:
+ *   [1 byte format][2 bytes dictionary id, LODB_CODEC_LZ_DICT only][varint raw length][sequences]
+ *
+ * Protobuf encodings start with a tag byte of 0x08 or more, so records stored uncompressed
+ * (incompressible ones, or written before compression was enabled) are told apart by
+ * their first byte and need no header.
+ */
+class LoDbCodec
+{
+  public:
+    /**
+     * @param dictionary Dictionary bytes (copied), or NULL
+     * @param dictionary_size Number of dictionary bytes (at most LODB_DICTIONARY_MAX_SIZE, the rest is ignored)
+     */
+    LoDbCodec(const uint8_t *dictionary, size_t dictionary_size);
+
+    /**
+     * Compress an encoded record into its stored form
+     * @param data Encoded protobuf bytes
+     * @param size Number of encoded bytes
+     * @param stored_out Receives the stored form, a copy of data if compression doesn't shrink it
+     * @return true if stored_out is compressed
+     */
+    bool compress(const uint8_t *data, size_t size, std::vector<uint8_t> &stored_out) const;
+
+    /**
+     * Expand a stored record into its protobuf bytes
+     * @param stored Stored form (must be compressed, see isCompressed())
+     * @param size Number of stored bytes
+     * @param data_out Receives the encoded protobuf bytes
+     * @return LODB_OK on success, LODB_ERR_DECODE if the stream is corrupt or needs a dictionary this codec doesn't have
+     */
+    LoDbError decompress(const uint8_t *stored, size_t size, std::vector<uint8_t> &data_out) const;
+
+    /**
+     * Whether stored record bytes are compressed (as opposed to plain protobuf)
+     */
+    static bool isCompressed(const uint8_t *stored, size_t size) { return size > 0 && stored[0] < 0x08; }
+
+    /**
+     * Build a dictionary from sample records
+     * Substrings found in the most samples are kept, the most common placed last.
+     * @param samples Encoded protobuf bytes of typical records
+     * @param dictionary_out Output buffer
+     * @param capacity Size of the output buffer
+     * @return Number of dictionary bytes written (0 if the samples share nothing)
+     */
+    static size_t train(const std::vector<std::vector<uint8_t>> &samples, uint8_t *dictionary_out, size_t capacity);
+
+    /**
+     * Dictionary id written into records compressed with the dictionary (0 without one)
+     */
+    uint16_t dictionaryId() const { return dictionary_id; }
+
+  private:
+    std::vector<uint8_t> dictionary;
+    uint16_t dictionary_id;
+};
@@ -0,0 +1,111 @@
+#include "LoDBExpiry.h"
+#include "configuration.h"
+#include <algorithm>
+#include <climits>
+
+LoDbExpiry::LoDbExpiry(LoDbIndex *index, uint32_t ttl_seconds)
+    : index(index), ttl_seconds(ttl_seconds), due_loaded(false), due_cutoff(0), next_key(INT64_MAX), next_known(false)
+{
+}
+
+bool LoDbExpiry::refresh(uint32_t now)
+{
+    int64_t target = cutoff(now);
+
+    // The clock was set back, so some due records may be live again
+    if (due_loaded && target < due_cutoff) {
+        due_loaded = false;
+    }
+
+    std::vector<LoDbIndex::Entry> entries;
+    if (!due_loaded) {
+        if (index->find(1, target, entries) != LODB_OK) {
+            return false;
+        }
+        due.clear();
+        for (const LoDbIndex::Entry &entry : entries) {
+            due.push_back(entry.uuid);
+        }
+        std::sort(due.begin(), due.end());
+        due_cutoff = target;
+        due_loaded = true;
+        next_known = false;
+        return true;
+    }
+    if (target == due_cutoff) {
+        return true;
+    }
+
+    // Only look past the cutoff when the next record may have fallen due
+    int64_t from = std::max<int64_t>(due_cutoff + 1, 1);
+    if (!next_known) {
+        if (index->find(from, INT64_MAX, entries, 1) != LODB_OK) {
+            return false;
+        }
+        next_key = entries.empty() ? INT64_MAX : entries[0].key;
+        next_known = true;
+        entries.clear();
+    }
+    if (next_key <= target) {
+        if (index->find(from, target, entries) != LODB_OK) {
+            return false;
+        }
+        for (const LoDbIndex::Entry &entry : entries) {
+            due.push_back(entry.uuid);
+        }
+        std::sort(due.begin(), due.end());
+        next_known = false;
+    }
+    due_cutoff = target;
+    return true;
+}
+
+bool LoDbExpiry::isExpired(lodb_uuid_t uuid, uint32_t now)
+{
+    return refresh(now) && std::binary_search(due.begin(), due.end(), uuid);
+}
+
+size_t LoDbExpiry::expiredCount(uint32_t now)
+{
+    return refresh(now) ? due.size() : 0;
+}
+
+LoDbError LoDbExpiry::findExpired(uint32_t now, size_t limit, std::vector<LoDbIndex::Entry> &entries_out)
+{
+    entries_out.clear();
+    return index->find(1, cutoff(now), entries_out, limit);
+}
+
+void LoDbExpiry::added(int64_t key, lodb_uuid_t uuid)
+{
+    if (!due_loaded) {
+        return;
+    }
+    if (key >= 1 && key <= due_cutoff) {
+        due.insert(std::lower_bound(due.begin(), due.end(), uuid), uuid);
+    } else if (key > due_cutoff && next_known && key < next_key) {
+        next_key = key;
+    }
+}
+
+void LoDbExpiry::removed(int64_t key, lodb_uuid_t uuid)
+{
+    if (!due_loaded) {
+        return;
+    }
+    if (key >= 1 && key <= due_cutoff) {
+        auto it = std::lower_bound(due.begin(), due.end(), uuid);
+        if (it != due.end() && *it == uuid) {
+            due.erase(it);
+        }
+    } else if (next_known && key == next_key) {
+        next_known = false; // Another entry may share the key, look again
+    }
+}
+
+void LoDbExpiry::reset()
+{
+    due.clear();
+    due_loaded = false;
+    next_known = false;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "LoDB.h"
+#include "LoDBIndex.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * LoDB Expiry Tracker
+ *
+ * Answers which records of a TTL table have expired, on top of the table's sorted
+ * index on its TTL field (see LoDbTableOptions::ttl_field). A record expires once
+ * its field value plus ttl_seconds is at most the current time; a field value of 0
+ * never expires.
+ *
+ * The UUIDs already due are kept in RAM, along with the next field value to fall due,
+ * so reads check a record in memory and only touch the index when another record
+ * falls due. The due list only holds records the sweeper hasn't deleted yet.
+ */
+class LoDbExpiry
+{
+  public:
+    /**
+     * @param index Index on the TTL field (not owned, must outlive the tracker)
+     * @param ttl_seconds Seconds a record lives past its field value
+     */
+    LoDbExpiry(LoDbIndex *index, uint32_t ttl_seconds);
+
+    /**
+     * Check whether a record has expired
+     * @param uuid UUID of the record
+     * @param now Current time in seconds since the epoch
+     */
+    bool isExpired(lodb_uuid_t uuid, uint32_t now);
+
+    /**
+     * Number of expired records still stored
+     */
+    size_t expiredCount(uint32_t now);
+
+    /**
+     * Collect expired index entries, earliest expiry first
+     * @param now Current time in seconds since the epoch
+     * @param limit Maximum number of entries to collect
+     * @param entries_out Receives the entries (cleared first)
+     * @return LODB_OK on success, LODB_ERR_IO if the index could not be read
+     */
+    LoDbError findExpired(uint32_t now, size_t limit, std::vector<LoDbIndex::Entry> &entries_out);
+
+    /**
+     * Note an entry added to the index
+     */
+    void added(int64_t key, lodb_uuid_t uuid);
+
+    /**
+     * Note an entry removed from the index
+     */
+    void removed(int64_t key, lodb_uuid_t uuid);
+
+    /**
+     * Forget what is known about the index (after it was cleared or rebuilt)
+     */
+    void reset();
+
+  private:
+    LoDbIndex *index;
+    uint32_t ttl_seconds;
+    std::vector<lodb_uuid_t> due; // Sorted UUIDs with a key in [1, due_cutoff]
+    bool due_loaded;              // Whether due reflects the index
+    int64_t due_cutoff;           // Largest key known to be due
+    int64_t next_key;             // Smallest key above due_cutoff, INT64_MAX if none
+    bool next_known;              // Whether next_key reflects the index
+
+    int64_t cutoff(uint32_t now) const { return (int64_t)now - ttl_seconds; }
+    bool refresh(uint32_t now);
+};
@@ -0,0 +1,456 @@
+#include "LoDBIndex.h"
+#include "LoDBBytes.h"
+#include "configuration.h"
+#include <algorithm>
+#include <cstring>
+
+// Journal ops - the 0xB0 marker lets replay detect a torn or garbage tail
+#define INDEX_OP_ADD 0xB1
+#define INDEX_OP_REMOVE 0xB2
+#define INDEX_JOURNAL_RECORD_SIZE 17
+#define INDEX_ENTRY_SIZE 16
+#define INDEX_HEADER_SIZE 8
+#define INDEX_MAGIC "LIX1"
+
+// Merge once the journal holds this many records, or a quarter of the snapshot if larger
+#define INDEX_MERGE_MIN 64
+
+// Entries read or written per filesystem call when streaming the snapshot
+#define INDEX_CHUNK_ENTRIES 32
+
+static void encodeEntry(uint8_t *out, const LoDbIndex::Entry &entry)
+{
+    lodb_put_le64(out, (uint64_t)entry.key);
+    lodb_put_le64(out + 8, entry.uuid);
+}
+
+static LoDbIndex::Entry decodeEntry(const uint8_t *in)
+{
+    LoDbIndex::Entry entry;
+    entry.key = (int64_t)lodb_get_le64(in);
+    entry.uuid = lodb_get_le64(in + 8);
+    return entry;
+}
+
+LoDbIndex::LoDbIndex(const char *dir_path, const char *name) : snapshot_count(0), journal_count(0), journal_torn(false), io(nullptr)
+{
+    snprintf(snapshot_path, sizeof(snapshot_path), "%s/%s.idx", dir_path, name);
+    snprintf(journal_path, sizeof(journal_path), "%s/%s.ixj", dir_path, name);
+    snprintf(temp_path, sizeof(temp_path), "%s/%s.tmp", dir_path, name);
+}
+
+bool LoDbIndex::exists() const
+{
+    return LoFS::exists(snapshot_path) || LoFS::exists(journal_path);
+}
+
+LoDbError LoDbIndex::open()
+{
+    snapshot_count = 0;
+    journal_count = 0;
+    journal_torn = false;
+    added.clear();
+    removed.clear();
+
+    // Finish or discard a merge that was interrupted around the rename
+    if (LoFS::exists(temp_path)) {
+        if (LoFS::exists(snapshot_path)) {
+            LoFS::remove(temp_path);
+        } else if (!LoFS::rename(temp_path, snapshot_path)) {
+            LOG_ERROR("Failed to recover index snapshot: %s", temp_path);
+            return LODB_ERR_IO;
+        }
+    }
+
+    // Snapshot header
+    auto snapshot = lodb_open(snapshot_path, FILE_O_READ, io);
+    if (snapshot) {
+        uint8_t header[INDEX_HEADER_SIZE];
+        bool valid = lodb_read(snapshot, header, sizeof(header), io) == sizeof(header) && memcmp(header, INDEX_MAGIC, 4) == 0;
+        if (valid) {
+            snapshot_count = lodb_get_le32(header + 4);
+            valid = snapshot.size() == INDEX_HEADER_SIZE + (size_t)snapshot_count * INDEX_ENTRY_SIZE;
+        }
+        snapshot.close();
+
+        if (!valid) {
+            LOG_ERROR("Corrupt index snapshot: %s", snapshot_path);
+            snapshot_count = 0;
+            return LODB_ERR_IO;
+        }
+    }
+
+    // Replay the journal on top of the snapshot
+    auto journal = lodb_open(journal_path, FILE_O_READ, io);
+    if (journal) {
+        uint8_t buffer[INDEX_JOURNAL_RECORD_SIZE];
+        while (true) {
+            size_t got = lodb_read(journal, buffer, sizeof(buffer), io);
+            if (got == 0) {
+                break;
+            }
+            if (got != sizeof(buffer) || (buffer[0] != INDEX_OP_ADD && buffer[0] != INDEX_OP_REMOVE)) {
+                LOG_WARN("Torn index journal tail: %s", journal_path);
+                journal_torn = true;
+                break;
+            }
+            apply(buffer[0], decodeEntry(buffer + 1), false);
+            journal_count++;
+        }
+        journal.close();
+    }
+
+    LOG_DEBUG("Opened index %s: %d entries (%d journaled)", snapshot_path, size(), journal_count);
+
+    if (journal_torn) {
+        return merge();
+    }
+    return LODB_OK;
+}
+
+bool LoDbIndex::readSnapshotEntry(File &file, uint32_t position, Entry *entry_out)
+{
+    uint8_t buffer[INDEX_ENTRY_SIZE];
+    if (!file.seek(INDEX_HEADER_SIZE + position * INDEX_ENTRY_SIZE) || lodb_read(file, buffer, sizeof(buffer), io) != sizeof(buffer)) {
+        return false;
+    }
+    *entry_out = decodeEntry(buffer);
+    return true;
+}
+
+uint32_t LoDbIndex::snapshotLowerBound(File &file, const Entry &entry)
+{
+    uint32_t low = 0;
+    uint32_t high = snapshot_count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        Entry probe;
+        if (!readSnapshotEntry(file, mid, &probe)) {
+            return snapshot_count; // Treat an unreadable snapshot as exhausted
+        }
+        if (probe < entry) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+bool LoDbIndex::snapshotContains(const Entry &entry)
+{
+    if (snapshot_count == 0) {
+        return false;
+    }
+
+    auto file = lodb_open(snapshot_path, FILE_O_READ, io);
+    if (!file) {
+        return false;
+    }
+
+    Entry found;
+    uint32_t position = snapshotLowerBound(file, entry);
+    bool contains = position < snapshot_count && readSnapshotEntry(file, position, &found) && found == entry;
+    file.close();
+    return contains;
+}
+
+// With known set, the caller vouches that an added entry is absent from the index, or a removed
+// one present, which spares a search of the snapshot file. Journal replay never knows.
+bool LoDbIndex::apply(uint8_t op, const Entry &entry, bool known)
+{
+    auto in_added = std::lower_bound(added.begin(), added.end(), entry);
+    bool is_added = in_added != added.end() && *in_added == entry;
+    auto in_removed = std::lower_bound(removed.begin(), removed.end(), entry);
+    bool is_removed = in_removed != removed.end() && *in_removed == entry;
+
+    if (op == INDEX_OP_ADD) {
+        if (is_removed) {
+            removed.erase(in_removed); // Back in the snapshot
+            return true;
+        }
+        if (is_added || (!known && snapshotContains(entry))) {
+            return false;
+        }
+        added.insert(in_added, entry);
+        return true;
+    }
+
+    if (is_added) {
+        added.erase(in_added);
+        return true;
+    }
+    if (is_removed || (!known && !snapshotContains(entry))) {
+        return false;
+    }
+    removed.insert(in_removed, entry);
+    return true;
+}
+
+LoDbError LoDbIndex::record(uint8_t op, const Entry &entry, bool known)
+{
+    // A torn journal can't be appended to safely, fold it into the snapshot first
+    if (journal_torn) {
+        LoDbError err = merge();
+        if (err != LODB_OK) {
+            return err;
+        }
+    }
+
+    if (!apply(op, entry, known)) {
+        return LODB_OK; // Already in the requested state
+    }
+
+    uint8_t buffer[INDEX_JOURNAL_RECORD_SIZE];
+    buffer[0] = op;
+    encodeEntry(buffer + 1, entry);
+
+    auto file = lodb_open(journal_path, LODB_FILE_O_APPEND, io);
+    if (!file) {
+        LOG_ERROR("Failed to open index journal: %s", journal_path);
+        journal_torn = true; // Memory is ahead of disk until the next merge
+        return LODB_ERR_IO;
+    }
+    size_t written = lodb_write(file, buffer, sizeof(buffer), io);
+    file.flush();
+    file.close();
+
+    if (written != sizeof(buffer)) {
+        LOG_ERROR("Failed to append to index journal, wrote %d of %d bytes", written, sizeof(buffer));
+        journal_torn = true;
+        return LODB_ERR_IO;
+    }
+
+    journal_count++;
+    if (journal_count >= std::max((size_t)INDEX_MERGE_MIN, (size_t)snapshot_count / 4)) {
+        return merge();
+    }
+    return LODB_OK;
+}
+
+LoDbError LoDbIndex::add(int64_t key, lodb_uuid_t uuid, bool known_absent)
+{
+    return record(INDEX_OP_ADD, {key, uuid}, known_absent);
+}
+
+LoDbError LoDbIndex::remove(int64_t key, lodb_uuid_t uuid, bool known_present)
+{
+    return record(INDEX_OP_REMOVE, {key, uuid}, known_present);
+}
+
+LoDbError LoDbIndex::find(int64_t min_key, int64_t max_key, std::vector<Entry> &entries_out, size_t limit)
+{
+    if (min_key > max_key) {
+        return LODB_OK;
+    }
+
+    const Entry first = {min_key, 0};
+    auto next_added = std::lower_bound(added.begin(), added.end(), first);
+    size_t collected = 0;
+
+    auto emit = [&](const Entry &entry) {
+        entries_out.push_back(entry);
+        collected++;
+        return limit == 0 || collected < limit;
+    };
+
+    // Stream the snapshot from the first candidate, merging in the added entries
+    File file;
+    uint32_t position = snapshot_count;
+    if (snapshot_count > 0) {
+        file = lodb_open(snapshot_path, FILE_O_READ, io);
+        if (!file) {
+            LOG_ERROR("Failed to open index snapshot: %s", snapshot_path);
+            return LODB_ERR_IO;
+        }
+        position = snapshotLowerBound(file, first);
+        file.seek(INDEX_HEADER_SIZE + position * INDEX_ENTRY_SIZE);
+    }
+
+    uint8_t chunk[INDEX_CHUNK_ENTRIES * INDEX_ENTRY_SIZE];
+    size_t chunk_count = 0;
+    size_t chunk_index = 0;
+    bool more = true;
+
+    while (more) {
+        // Refill the snapshot chunk
+        if (chunk_index == chunk_count && position < snapshot_count) {
+            size_t want = std::min((size_t)INDEX_CHUNK_ENTRIES, (size_t)(snapshot_count - position));
+            if (lodb_read(file, chunk, want * INDEX_ENTRY_SIZE, io) != want * INDEX_ENTRY_SIZE) {
+                LOG_ERROR("Failed to read index snapshot: %s", snapshot_path);
+                file.close();
+                return LODB_ERR_IO;
+            }
+            chunk_count = want;
+            chunk_index = 0;
+            position += want;
+        }
+
+        bool have_snapshot = chunk_index < chunk_count;
+        bool have_added = next_added != added.end();
+        if (!have_snapshot && !have_added) {
+            break;
+        }
+
+        Entry snapshot_entry = have_snapshot ? decodeEntry(chunk + chunk_index * INDEX_ENTRY_SIZE) : Entry();
+        bool take_added = have_added && (!have_snapshot || *next_added < snapshot_entry);
+        Entry entry = take_added ? *next_added : snapshot_entry;
+        if (entry.key > max_key) {
+            break;
+        }
+
+        if (take_added) {
+            ++next_added;
+            more = emit(entry);
+        } else {
+            chunk_index++;
+            if (!std::binary_search(removed.begin(), removed.end(), entry)) {
+                more = emit(entry);
+            }
+        }
+    }
+
+    if (file) {
+        file.close();
+    }
+    return LODB_OK;
+}
+
+LoDbError LoDbIndex::writeSnapshot(const std::vector<Entry> *entries)
+{
+    uint32_t count = entries ? (uint32_t)entries->size() : (uint32_t)size();
+
+    auto out = lodb_open(temp_path, FILE_O_WRITE, io);
+    if (!out) {
+        LOG_ERROR("Failed to create index snapshot: %s", temp_path);
+        return LODB_ERR_IO;
+    }
+
+    uint8_t header[INDEX_HEADER_SIZE];
+    memcpy(header, INDEX_MAGIC, 4);
+    lodb_put_le32(header + 4, count);
+    bool ok = lodb_write(out, header, sizeof(header), io) == sizeof(header);
+
+    // Buffered writer for whole chunks of entries
+    uint8_t chunk[INDEX_CHUNK_ENTRIES * INDEX_ENTRY_SIZE];
+    size_t pending = 0;
+    uint32_t written = 0;
+    auto put = [&](const Entry &entry) {
+        encodeEntry(chunk + pending * INDEX_ENTRY_SIZE, entry);
+        written++;
+        if (++pending == INDEX_CHUNK_ENTRIES) {
+            ok = ok && lodb_write(out, chunk, sizeof(chunk), io) == sizeof(chunk);
+            pending = 0;
+        }
+    };
+
+    if (entries) {
+        for (const Entry &entry : *entries) {
+            put(entry);
+        }
+    } else {
+        // Merge the old snapshot with the journaled changes in one sequential pass
+        File in;
+        if (snapshot_count > 0) {
+            in = lodb_open(snapshot_path, FILE_O_READ, io);
+            ok = ok && in && in.seek(INDEX_HEADER_SIZE);
+        }
+
+        auto next_added = added.begin();
+        auto next_removed = removed.begin();
+        uint8_t read_chunk[INDEX_CHUNK_ENTRIES * INDEX_ENTRY_SIZE];
+        uint32_t position = 0;
+        while (ok && position < snapshot_count) {
+            size_t want = std::min((size_t)INDEX_CHUNK_ENTRIES, (size_t)(snapshot_count - position));
+            if (lodb_read(in, read_chunk, want * INDEX_ENTRY_SIZE, io) != want * INDEX_ENTRY_SIZE) {
+                ok = false;
+                break;
+            }
+            for (size_t i = 0; i < want; i++) {
+                Entry entry = decodeEntry(read_chunk + i * INDEX_ENTRY_SIZE);
+                while (next_added != added.end() && *next_added < entry) {
+                    put(*next_added++);
+                }
+                if (next_removed != removed.end() && *next_removed == entry) {
+                    ++next_removed;
+                    continue;
+                }
+                put(entry);
+            }
+            position += want;
+        }
+        while (next_added != added.end()) {
+            put(*next_added++);
+        }
+
+        if (in) {
+            in.close();
+        }
+    }
+
+    if (pending > 0) {
+        ok = ok && lodb_write(out, chunk, pending * INDEX_ENTRY_SIZE, io) == pending * INDEX_ENTRY_SIZE;
+    }
+    out.flush();
+    out.close();
+
+    if (!ok || written != count) {
+        LOG_ERROR("Failed to write index snapshot: %s", temp_path);
+        LoFS::remove(temp_path);
+        return LODB_ERR_IO;
+    }
+
+    // Swap the new snapshot in; open() completes this if interrupted after the remove
+    if (LoFS::exists(snapshot_path) && !LoFS::remove(snapshot_path)) {
+        LOG_ERROR("Failed to replace index snapshot: %s", snapshot_path);
+        LoFS::remove(temp_path);
+        return LODB_ERR_IO;
+    }
+    if (!LoFS::rename(temp_path, snapshot_path)) {
+        LOG_ERROR("Failed to rename index snapshot: %s", temp_path);
+        return LODB_ERR_IO;
+    }
+
+    // The journal is now folded in (replaying it again would be harmless)
+    LoFS::remove(journal_path);
+    snapshot_count = count;
+    journal_count = 0;
+    journal_torn = false;
+    added.clear();
+    removed.clear();
+    return LODB_OK;
+}
+
+LoDbError LoDbIndex::merge()
+{
+    LoDbError err = writeSnapshot(nullptr);
+    if (err == LODB_OK) {
+        LOG_DEBUG("Merged index %s: %d entries", snapshot_path, snapshot_count);
+    }
+    return err;
+}
+
+LoDbError LoDbIndex::rebuild(std::vector<Entry> &entries)
+{
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    return writeSnapshot(&entries);
+}
+
+LoDbError LoDbIndex::clear()
+{
+    bool ok = true;
+    for (const char *path : {snapshot_path, journal_path, temp_path}) {
+        if (LoFS::exists(path) && !LoFS::remove(path)) {
+            LOG_WARN("Failed to remove index file: %s", path);
+            ok = false;
+        }
+    }
+
+    snapshot_count = 0;
+    journal_count = 0;
+    journal_torn = false;
+    added.clear();
+    removed.clear();
+    return ok ? LODB_OK : LODB_ERR_IO;
+}
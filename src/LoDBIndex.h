@@ -0,0 +1,125 @@
+#pragma once
+
+#include "LoDB.h"
+#include "lofs/src/LoFS.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * LoDB Sorted Index
+ *
+ * Persistent multimap from a 64-bit key to record UUIDs, kept sorted by (key, uuid).
+ * Used for secondary indexes on protobuf fields.
+ *
+ * Files (little-endian):
+ *   {name}.idx  Snapshot: [4 bytes magic "LIX1"][4 bytes count] then count x [8 bytes key][8 bytes uuid]
+ *   {name}.ixj  Journal:  [1 byte op][8 bytes key][8 bytes uuid] per change since the snapshot
+ *
+ * Lookups binary search the snapshot on disk, so RAM only holds the changes made since
+ * the last snapshot. Once the journal grows past a fraction of the snapshot, both are
+ * merged into a new snapshot written to {name}.tmp and renamed into place. Replaying
+ * the journal is idempotent, so a crash at any point of the merge loses nothing.
+ */
+class LoDbIndex
+{
+  public:
+    /**
+     * One index entry
+     */
+    struct Entry {
+        int64_t key;
+        lodb_uuid_t uuid;
+
+        bool operator<(const Entry &other) const { return key < other.key || (key == other.key && uuid < other.uuid); }
+        bool operator==(const Entry &other) const { return key == other.key && uuid == other.uuid; }
+    };
+
+    /**
+     * @param dir_path Directory holding the index files
+     * @param name Base name of the index files (without extension)
+     */
+    LoDbIndex(const char *dir_path, const char *name);
+
+    /**
+     * Load the snapshot header and replay the journal
+     * @return LODB_OK on success, LODB_ERR_IO if the snapshot is unreadable
+     */
+    LoDbError open();
+
+    /**
+     * Whether a snapshot or journal exists on disk (false for a brand new index)
+     */
+    bool exists() const;
+
+    /**
+     * Number of entries
+     */
+    size_t size() const { return snapshot_count + added.size() - removed.size(); }
+
+    /**
+     * Add an entry (no-op if already present)
+     * @param known_absent The caller knows the entry isn't in the index, so the snapshot isn't searched for it
+     * @return LODB_OK on success, LODB_ERR_IO on write failure
+     */
+    LoDbError add(int64_t key, lodb_uuid_t uuid, bool known_absent = false);
+
+    /**
+     * Remove an entry (no-op if absent)
+     * @param known_present The caller knows the entry is in the index, so the snapshot isn't searched for it
+     * @return LODB_OK on success, LODB_ERR_IO on write failure
+     */
+    LoDbError remove(int64_t key, lodb_uuid_t uuid, bool known_present = false);
+
+    /**
+     * Replace the whole index with a fresh snapshot of entries
+     * @param entries Entries to store (sorted in place)
+     * @return LODB_OK on success, LODB_ERR_IO on write failure
+     */
+    LoDbError rebuild(std::vector<Entry> &entries);
+
+    /**
+     * Remove all entries
+     * @return LODB_OK on success, LODB_ERR_IO on failure
+     */
+    LoDbError clear();
+
+    /**
+     * Collect entries with min_key <= key <= max_key in (key, uuid) order
+     * @param min_key Smallest key to include
+     * @param max_key Largest key to include
+     * @param entries_out Receives matching entries (appended)
+     * @param limit Maximum number of entries to collect (0 for no limit)
+     * @return LODB_OK on success, LODB_ERR_IO if the snapshot could not be read
+     */
+    LoDbError find(int64_t min_key, int64_t max_key, std::vector<Entry> &entries_out, size_t limit = 0);
+
+    /**
+     * Merge the journal into a new snapshot
+     * @return LODB_OK on success, LODB_ERR_IO on failure (the journal is kept)
+     */
+    LoDbError merge();
+
+    /**
+     * Count the index's storage traffic in these counters (NULL stops counting)
+     */
+    void setIoCounters(LoDbIoCounters *counters) { io = counters; }
+
+  private:
+    char snapshot_path[192];
+    char journal_path[192];
+    char temp_path[192];
+    uint32_t snapshot_count;
+    size_t journal_count;
+    bool journal_torn;         // A journal write failed part way, merge before appending again
+    std::vector<Entry> added;   // Sorted entries added since the snapshot
+    std::vector<Entry> removed; // Sorted snapshot entries removed since the snapshot
+    LoDbIoCounters *io;
+
+    bool apply(uint8_t op, const Entry &entry, bool known);
+    LoDbError record(uint8_t op, const Entry &entry, bool known);
+    bool snapshotContains(const Entry &entry);
+    bool readSnapshotEntry(File &file, uint32_t position, Entry *entry_out);
+    uint32_t snapshotLowerBound(File &file, const Entry &entry);
+    LoDbError writeSnapshot(const std::vector<Entry> *entries);
+};
@@ -0,0 +1,465 @@
+#include "LoDBRing.h"
+#include "LoDBBytes.h"
+#include "configuration.h"
+#include <cstring>
+
+#define RING_MAGIC "LRG1"
+#define RING_HEADER_SIZE 16
+#define RING_SLOT_HEADER_SIZE LODB_RING_SLOT_OVERHEAD
+#define RING_FILL_CHUNK 256
+
+LoDbRing::LoDbRing(const char *dir_path, uint32_t slot_count, uint32_t slot_size)
+    : slot_count(slot_count), slot_size(slot_size), next_slot(0), next_sequence(1), batching(false), io(nullptr)
+{
+    strncpy(this->dir_path, dir_path, sizeof(this->dir_path) - 1);
+    this->dir_path[sizeof(this->dir_path) - 1] = '\0';
+    snprintf(file_path, sizeof(file_path), "%s/ring.dat", this->dir_path);
+}
+
+LoDbRing::~LoDbRing()
+{
+    // The ring file is closed after every write outside a batch
+    if (batch_file) {
+        batch_file.close();
+    }
+}
+
+uint32_t LoDbRing::slotOffset(uint32_t slot) const
+{
+    return RING_HEADER_SIZE + slot * (RING_SLOT_HEADER_SIZE + slot_size);
+}
+
+LoDbError LoDbRing::open()
+{
+    char temp_path[192];
+    snprintf(temp_path, sizeof(temp_path), "%s/ring.tmp", dir_path);
+
+    // A rebuild interrupted after removing the old file left its result behind
+    if (!LoFS::exists(file_path) && LoFS::exists(temp_path)) {
+        LoFS::rename(temp_path, file_path);
+    }
+
+    File file = lodb_open(file_path, FILE_O_READ, io);
+    if (!file) {
+        return create();
+    }
+
+    uint8_t header[RING_HEADER_SIZE];
+    bool valid = lodb_read(file, header, RING_HEADER_SIZE, io) == RING_HEADER_SIZE && memcmp(header, RING_MAGIC, 4) == 0 &&
+                 lodb_get_le32(header + 12) == lodb_fnv1a(LODB_FNV_OFFSET_BASIS, header, 12);
+    if (!valid) {
+        file.close();
+        LOG_WARN("Ring file has no valid header, recreating it: %s", file_path);
+        return create();
+    }
+
+    uint32_t file_slot_size = lodb_get_le32(header + 4);
+    uint32_t file_slot_count = lodb_get_le32(header + 8);
+    if (file_slot_size != slot_size || file_slot_count != slot_count) {
+        file.close();
+        return rebuild(file_slot_count, file_slot_size);
+    }
+
+    size_t file_size = file.size();
+    load(file);
+    file.close();
+
+    // Finish a preallocation cut short by a power loss
+    if (file_size < slotOffset(slot_count)) {
+        File tail = lodb_open(file_path, LODB_FILE_O_APPEND, io);
+        bool filled = tail && fill(tail, file_size);
+        if (tail) {
+            tail.close();
+        }
+        if (!filled) {
+            LOG_ERROR("Failed to preallocate ring file: %s", file_path);
+            return LODB_ERR_IO;
+        }
+    }
+
+    LOG_DEBUG("Opened ring %s: %d of %d slots used", file_path, index.size(), slot_count);
+    return LODB_OK;
+}
+
+LoDbError LoDbRing::create()
+{
+    slots.assign(slot_count, Slot());
+    index.clear();
+    next_slot = 0;
+    next_sequence = 1;
+
+    // FILE_O_WRITE appends on some platforms, so start from a fresh file
+    LoFS::remove(file_path);
+    File file = lodb_open(file_path, FILE_O_WRITE, io);
+    if (!file) {
+        LOG_ERROR("Failed to create ring file: %s", file_path);
+        return LODB_ERR_IO;
+    }
+
+    uint8_t header[RING_HEADER_SIZE];
+    memcpy(header, RING_MAGIC, 4);
+    lodb_put_le32(header + 4, slot_size);
+    lodb_put_le32(header + 8, slot_count);
+    lodb_put_le32(header + 12, lodb_fnv1a(LODB_FNV_OFFSET_BASIS, header, 12));
+    // Every slot is written now, so the ring never has to grow the file later
+    bool written = lodb_write(file, header, RING_HEADER_SIZE, io) == RING_HEADER_SIZE && fill(file, RING_HEADER_SIZE);
+    file.close();
+
+    if (!written) {
+        LOG_ERROR("Failed to preallocate ring file: %s", file_path);
+        LoFS::remove(file_path);
+        return LODB_ERR_IO;
+    }
+    LOG_DEBUG("Created ring %s: %d slots of %d bytes", file_path, slot_count, slot_size);
+    return LODB_OK;
+}
+
+bool LoDbRing::fill(File &file, size_t position)
+{
+    uint8_t zeros[RING_FILL_CHUNK] = {};
+    while (position < slotOffset(slot_count)) {
+        size_t count = slotOffset(slot_count) - position < sizeof(zeros) ? slotOffset(slot_count) - position : sizeof(zeros);
+        if (lodb_write(file, zeros, count, io) != count) {
+            return false;
+        }
+        position += count;
+    }
+    return true;
+}
+
+void LoDbRing::load(File &file)
+{
+    slots.assign(slot_count, Slot());
+    index.clear();
+
+    uint64_t newest = 0;
+    uint32_t newest_slot = slot_count - 1; // An empty ring starts at slot 0
+    std::vector<uint8_t> payload(slot_size);
+    uint8_t header[RING_SLOT_HEADER_SIZE];
+
+    for (uint32_t slot = 0; slot < slot_count; slot++) {
+        if (!file.seek(slotOffset(slot)) || lodb_read(file, header, RING_SLOT_HEADER_SIZE, io) != RING_SLOT_HEADER_SIZE) {
+            break; // Short file, the remaining slots are empty
+        }
+
+        uint64_t sequence = lodb_get_le64(header);
+        lodb_uuid_t uuid = lodb_get_le64(header + 8);
+        uint32_t length = lodb_get_le32(header + 16);
+        if (sequence == 0) {
+            continue;
+        }
+
+        bool intact = length <= slot_size && lodb_read(file, payload.data(), length, io) == length &&
+                      lodb_get_le32(header + 20) ==
+                          lodb_fnv1a(lodb_fnv1a(LODB_FNV_OFFSET_BASIS, header, 20), payload.data(), length);
+        if (!intact) {
+            LOG_WARN("Ring slot %d of %s is torn, treating it as empty", slot, file_path);
+            continue;
+        }
+
+        // A UUID is only ever in one slot, but keep the newer copy should both survive
+        auto existing = index.find(uuid);
+        if (existing != index.end()) {
+            if (slots[existing->second].sequence > sequence) {
+                continue;
+            }
+            slots[existing->second] = Slot();
+        }
+
+        slots[slot].uuid = uuid;
+        slots[slot].sequence = sequence;
+        slots[slot].length = length;
+        index[uuid] = slot;
+        if (sequence > newest) {
+            newest = sequence;
+            newest_slot = slot;
+        }
+    }
+
+    // Slots are taken in order, so the one after the newest write holds the oldest record
+    next_slot = (newest_slot + 1) % slot_count;
+    next_sequence = newest + 1;
+}
+
+LoDbError LoDbRing::rebuild(uint32_t old_slot_count, uint32_t old_slot_size)
+{
+    LoDbRing old(dir_path, old_slot_count, old_slot_size);
+    old.io = io;
+    File file = lodb_open(file_path, FILE_O_READ, io);
+    if (!file || old_slot_count == 0) {
+        return LODB_ERR_IO;
+    }
+    old.load(file);
+    file.close();
+
+    // The newest records that fit the new slots are kept
+    uint64_t oldest_kept = UINT64_MAX;
+    size_t kept = 0;
+    for (uint32_t i = 0; i < old_slot_count && kept < slot_count; i++) {
+        const Slot &slot = old.slots[(old.next_slot + old_slot_count - 1 - i) % old_slot_count];
+        if (slot.sequence != 0 && slot.length <= slot_size) {
+            oldest_kept = slot.sequence;
+            kept++;
+        }
+    }
+
+    LoDbRing fresh(dir_path, slot_count, slot_size);
+    fresh.io = io;
+    snprintf(fresh.file_path, sizeof(fresh.file_path), "%s/ring.tmp", dir_path);
+    LoDbError err = fresh.create();
+    if (err != LODB_OK) {
+        return err;
+    }
+
+    // Copy oldest first, so the records keep their order
+    std::vector<uint8_t> payload(old_slot_size);
+    Scan scan;
+    lodb_uuid_t uuid;
+    uint32_t length;
+    old.beginScan(scan);
+    fresh.beginBatch();
+    while (err == LODB_OK && old.nextScan(scan, &uuid, &length)) {
+        const Slot &slot = old.slots[old.index[uuid]];
+        if (slot.sequence < oldest_kept || length > slot_size) {
+            continue;
+        }
+        if (lodb_read(scan.file, payload.data(), length, io) != length) {
+            err = LODB_ERR_IO;
+            break;
+        }
+        err = fresh.append(uuid, payload.data(), length);
+    }
+    fresh.endBatch();
+    old.endScan(scan);
+
+    if (err != LODB_OK) {
+        LOG_ERROR("Failed to rebuild ring file: %s", file_path);
+        LoFS::remove(fresh.file_path);
+        return err;
+    }
+
+    // Renaming over an existing file fails on some filesystems; open() finishes an interrupted swap
+    LoFS::remove(file_path);
+    if (!LoFS::rename(fresh.file_path, file_path)) {
+        LOG_ERROR("Failed to rename rebuilt ring file: %s", fresh.file_path);
+        return LODB_ERR_IO;
+    }
+    LOG_INFO("Rebuilt ring %s from %d x %d to %d x %d bytes, kept %d of %d records", file_path, old_slot_count, old_slot_size,
+             slot_count, slot_size, kept, old.size());
+
+    file = lodb_open(file_path, FILE_O_READ, io);
+    if (!file) {
+        return LODB_ERR_IO;
+    }
+    load(file);
+    file.close();
+    return LODB_OK;
+}
+
+bool LoDbRing::writeAt(uint32_t offset, const uint8_t *header, size_t header_size, const uint8_t *data, size_t length)
+{
+    // Batches keep the ring file open between writes
+    File file;
+    File &target = batching ? batch_file : file;
+    if (!target) {
+        target = lodb_open(file_path, LODB_FILE_O_UPDATE, io);
+        if (!target) {
+            LOG_ERROR("Failed to open ring file for writing: %s", file_path);
+            return false;
+        }
+    }
+
+    bool written = target.seek(offset) && lodb_write(target, header, header_size, io) == header_size &&
+                   (length == 0 || lodb_write(target, data, length, io) == length);
+    if (!batching || !written) {
+        target.close();
+    }
+    return written;
+}
+
+bool LoDbRing::nextEvicted(lodb_uuid_t *uuid_out) const
+{
+    if (slots[next_slot].sequence == 0) {
+        return false;
+    }
+    *uuid_out = slots[next_slot].uuid;
+    return true;
+}
+
+LoDbError LoDbRing::append(lodb_uuid_t uuid, const uint8_t *data, size_t length)
+{
+    if (length > slot_size) {
+        LOG_ERROR("Record of %d bytes doesn't fit a %d byte ring slot", length, slot_size);
+        return LODB_ERR_INVALID;
+    }
+
+    // An update keeps its slot and sequence, so it keeps its place in the ring
+    auto existing = index.find(uuid);
+    bool update = existing != index.end();
+    uint32_t slot = update ? existing->second : next_slot;
+    uint64_t sequence = update ? slots[slot].sequence : next_sequence;
+
+    uint8_t header[RING_SLOT_HEADER_SIZE];
+    lodb_put_le64(header, sequence);
+    lodb_put_le64(header + 8, uuid);
+    lodb_put_le32(header + 16, (uint32_t)length);
+    lodb_put_le32(header + 20, lodb_fnv1a(lodb_fnv1a(LODB_FNV_OFFSET_BASIS, header, 20), data, length));
+
+    bool written = writeAt(slotOffset(slot), header, RING_SLOT_HEADER_SIZE, data, length);
+
+    // The slot's previous record is gone either way: overwritten, or torn by the failed write
+    if (slots[slot].sequence != 0) {
+        index.erase(slots[slot].uuid);
+        slots[slot] = Slot();
+    }
+    if (!update) {
+        next_slot = (slot + 1) % slot_count;
+        next_sequence++;
+    }
+    if (!written) {
+        LOG_ERROR("Failed to write ring slot %d of %s", slot, file_path);
+        return LODB_ERR_IO;
+    }
+
+    slots[slot].uuid = uuid;
+    slots[slot].sequence = sequence;
+    slots[slot].length = (uint32_t)length;
+    index[uuid] = slot;
+    return LODB_OK;
+}
+
+LoDbError LoDbRing::remove(lodb_uuid_t uuid)
+{
+    auto it = index.find(uuid);
+    if (it == index.end()) {
+        return LODB_ERR_NOT_FOUND;
+    }
+
+    // A zero sequence marks the slot empty
+    uint32_t slot = it->second;
+    uint8_t empty[8] = {};
+    if (!writeAt(slotOffset(slot), empty, sizeof(empty), nullptr, 0)) {
+        return LODB_ERR_IO;
+    }
+    index.erase(it);
+    slots[slot] = Slot();
+    return LODB_OK;
+}
+
+void LoDbRing::keys(std::vector<lodb_uuid_t> &keys_out) const
+{
+    keys_out.clear();
+    keys_out.reserve(index.size());
+    for (const auto &entry : index) {
+        keys_out.push_back(entry.first);
+    }
+}
+
+LoDbError LoDbRing::openRecord(lodb_uuid_t uuid, File *file_out, size_t *length_out)
+{
+    auto it = index.find(uuid);
+    if (it == index.end()) {
+        return LODB_ERR_NOT_FOUND;
+    }
+
+    // A batch's writes must reach the file before another handle reads it
+    if (batch_file) {
+        batch_file.flush();
+    }
+    *file_out = lodb_open(file_path, FILE_O_READ, io);
+    if (!*file_out || !file_out->seek(slotOffset(it->second) + RING_SLOT_HEADER_SIZE)) {
+        LOG_ERROR("Failed to open ring file: %s", file_path);
+        file_out->close();
+        return LODB_ERR_IO;
+    }
+    *length_out = slots[it->second].length;
+    return LODB_OK;
+}
+
+LoDbError LoDbRing::clear()
+{
+    // Only the used slots need their sequence cleared
+    bool was_batching = batching;
+    batching = true;
+    LoDbError result = LODB_OK;
+    uint8_t empty[8] = {};
+    for (uint32_t slot = 0; slot < slot_count; slot++) {
+        if (slots[slot].sequence == 0) {
+            continue;
+        }
+        if (!writeAt(slotOffset(slot), empty, sizeof(empty), nullptr, 0)) {
+            result = LODB_ERR_IO;
+            break;
+        }
+        index.erase(slots[slot].uuid);
+        slots[slot] = Slot();
+    }
+    batching = was_batching;
+    if (!batching && batch_file) {
+        batch_file.close();
+    }
+
+    if (result == LODB_OK) {
+        next_slot = 0;
+    }
+    return result;
+}
+
+void LoDbRing::beginScan(Scan &scan, bool newest_first) const
+{
+    scan.newest_first = newest_first;
+    scan.slot = newest_first ? (next_slot + slot_count - 1) % slot_count : next_slot;
+    scan.remaining = slot_count;
+    scan.open = false;
+}
+
+bool LoDbRing::nextScan(Scan &scan, lodb_uuid_t *uuid_out, uint32_t *length_out)
+{
+    while (scan.remaining > 0) {
+        uint32_t slot = scan.slot;
+        scan.slot = scan.newest_first ? (slot + slot_count - 1) % slot_count : (slot + 1) % slot_count;
+        scan.remaining--;
+        if (slots[slot].sequence == 0) {
+            continue;
+        }
+
+        if (!scan.open) {
+            scan.file = lodb_open(file_path, FILE_O_READ, io);
+            if (!scan.file) {
+                LOG_ERROR("Failed to open ring file for scan: %s", file_path);
+                scan.remaining = 0;
+                return false;
+            }
+            scan.open = true;
+        }
+        if (!scan.file.seek(slotOffset(slot) + RING_SLOT_HEADER_SIZE)) {
+            continue;
+        }
+
+        *uuid_out = slots[slot].uuid;
+        *length_out = slots[slot].length;
+        return true;
+    }
+    return false;
+}
+
+void LoDbRing::endScan(Scan &scan) const
+{
+    if (scan.open) {
+        scan.file.close();
+        scan.open = false;
+    }
+}
+
+void LoDbRing::beginBatch()
+{
+    batching = true;
+}
+
+void LoDbRing::endBatch()
+{
+    batching = false;
+    if (batch_file) {
+        batch_file.close();
+    }
+}
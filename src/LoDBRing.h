@@ -0,0 +1,185 @@
+#pragma once
+
+#include "LoDB.h"
+#include "lofs/src/LoFS.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Bytes a ring file spends per slot besides the record, and the largest ring file
+#define LODB_RING_SLOT_OVERHEAD 24
+#define LODB_RING_FILE_MAX (1024u * 1024 * 1024)
+
+/**
+ * Slot-order scan state, see LoDbRing::beginScan()/nextScan()/endScan()
+ */
+struct LoDbRingScan {
+    uint32_t slot = 0;          // Next slot to visit
+    uint32_t remaining = 0;     // Slots left to visit
+    bool newest_first = false;  // Walk backwards from the newest slot
+    bool open = false;          // Whether file holds the open ring file
+    File file;                  // Ring file, positioned at the payload after nextScan()
+};
+
+/**
+ * LoDB Ring Storage Engine
+ *
+ * Stores a capped table in one preallocated file of fixed-size slots: {table_path}/ring.dat
+ * Slots are filled in order and wrap around, so once the ring is full every insert
+ * overwrites the oldest record in place. Retention costs no extra I/O, and the file
+ * never grows past its preallocated size. Updates rewrite the record's own slot, and
+ * deletes clear it until the ring wraps around to it again.
+ *
+ * File layout (little-endian):
+ *   [4 bytes magic "LRG1"][4 bytes slot size][4 bytes slot count][4 bytes FNV-1a of the first 12]
+ *   slot_count x [8 bytes sequence][8 bytes uuid][4 bytes length][4 bytes FNV-1a][payload, padded to slot size]
+ *
+ * The sequence number (0 in an empty slot) grows with every write, so opening the ring
+ * finds the newest slot without any other metadata. The checksum covers the slot header
+ * and payload; a slot torn by a power loss fails it and reads as empty.
+ *
+ * RAM use is an in-memory copy of the slot headers (24 bytes per slot) plus a UUID map.
+ */
+class LoDbRing
+{
+  public:
+    typedef LoDbRingScan Scan;
+
+    /**
+     * @param dir_path Directory holding ring.dat (the table path)
+     * @param slot_count Number of records the ring holds
+     * @param slot_size Largest stored record in bytes
+     */
+    LoDbRing(const char *dir_path, uint32_t slot_count, uint32_t slot_size);
+
+    ~LoDbRing();
+
+    /**
+     * Load the ring file, creating and preallocating it if missing
+     * A ring file with a different slot count or size is rebuilt with the newest records that fit.
+     * @return LODB_OK on success, LODB_ERR_IO otherwise
+     */
+    LoDbError open();
+
+    /**
+     * Check whether a record exists for a UUID (memory only)
+     */
+    bool contains(lodb_uuid_t uuid) const { return index.find(uuid) != index.end(); }
+
+    /**
+     * Number of records
+     */
+    size_t size() const { return index.size(); }
+
+    /**
+     * UUIDs of the records in ascending order (memory only)
+     */
+    void keys(std::vector<lodb_uuid_t> &keys_out) const;
+
+    /**
+     * Largest stored record a slot holds
+     */
+    uint32_t slotSize() const { return slot_size; }
+
+    /**
+     * UUID of the record the next new UUID overwrites
+     * @return true if the next slot holds a record (the ring is full or has wrapped)
+     */
+    bool nextEvicted(lodb_uuid_t *uuid_out) const;
+
+    /**
+     * Store a record: a new UUID takes the next slot, overwriting the oldest record
+     * once the ring is full, and an existing UUID is rewritten in its own slot
+     * @param uuid UUID of the record
+     * @param data Stored record bytes
+     * @param length Number of bytes (at most slotSize())
+     * @return LODB_OK on success, LODB_ERR_INVALID if the record doesn't fit a slot, LODB_ERR_IO on write failure
+     */
+    LoDbError append(lodb_uuid_t uuid, const uint8_t *data, size_t length);
+
+    /**
+     * Clear a record's slot
+     * @return LODB_OK on success, LODB_ERR_NOT_FOUND if UUID doesn't exist, LODB_ERR_IO on write failure
+     */
+    LoDbError remove(lodb_uuid_t uuid);
+
+    /**
+     * Open the ring file positioned at a record's payload
+     * @param uuid UUID of the record
+     * @param file_out Receives the open ring file (the caller closes it)
+     * @param length_out Receives the payload length
+     * @return LODB_OK on success, LODB_ERR_NOT_FOUND if UUID doesn't exist, LODB_ERR_IO otherwise
+     */
+    LoDbError openRecord(lodb_uuid_t uuid, File *file_out, size_t *length_out);
+
+    /**
+     * Clear every slot and forget all records (the file keeps its size)
+     * @return LODB_OK on success, LODB_ERR_IO otherwise
+     */
+    LoDbError clear();
+
+    /**
+     * Start a scan over the records in slot order: oldest first, or newest first to read
+     * the most recent records without visiting the rest of the ring
+     */
+    void beginScan(Scan &scan, bool newest_first = false) const;
+
+    /**
+     * Advance to the next record
+     * @param scan Scan state from beginScan()
+     * @param uuid_out UUID of the record
+     * @param length_out Payload length; scan.file is positioned at the payload
+     * @return true if a record was found, false once every slot was visited
+     */
+    bool nextScan(Scan &scan, lodb_uuid_t *uuid_out, uint32_t *length_out);
+
+    /**
+     * Release resources held by a scan
+     */
+    void endScan(Scan &scan) const;
+
+    /**
+     * Start a batch: writes keep the ring file open and skip the per-record flush
+     */
+    void beginBatch();
+
+    /**
+     * End a batch: flush and close the ring file
+     */
+    void endBatch();
+
+    /**
+     * Count the ring's storage traffic in these counters (NULL stops counting)
+     */
+    void setIoCounters(LoDbIoCounters *counters) { io = counters; }
+
+  private:
+    /**
+     * In-memory copy of a slot header
+     */
+    struct Slot {
+        lodb_uuid_t uuid = 0;
+        uint64_t sequence = 0; // 0 if the slot is empty
+        uint32_t length = 0;
+    };
+
+    char dir_path[160];
+    char file_path[192];
+    uint32_t slot_count;
+    uint32_t slot_size;
+    std::vector<Slot> slots;
+    std::map<lodb_uuid_t, uint32_t> index; // UUID -> slot
+    uint32_t next_slot;                    // Slot the next new UUID takes
+    uint64_t next_sequence;
+    bool batching;  // Inside beginBatch()/endBatch()
+    File batch_file;
+    LoDbIoCounters *io;
+
+    uint32_t slotOffset(uint32_t slot) const;
+    LoDbError create();
+    bool fill(File &file, size_t position);
+    void load(File &file);
+    LoDbError rebuild(uint32_t old_slot_count, uint32_t old_slot_size);
+    bool writeAt(uint32_t offset, const uint8_t *header, size_t header_size, const uint8_t *data, size_t length);
+};
@@ -0,0 +1,500 @@
+#include "LoDBSegmentLog.h"
+#include "LoDBBytes.h"
+#include "configuration.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Frame kinds - the 0xA0 marker lets replay detect a torn or garbage tail
+#define SEGMENT_FRAME_PUT 0xA1
+#define SEGMENT_FRAME_DELETE 0xA2
+#define SEGMENT_HEADER_SIZE 13
+
+// Parse "{8 hex digits}.seg" (optionally preceded by a path) into a segment id
+static bool parseSegmentName(const char *path, uint32_t *segment_out)
+{
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    if (strlen(name) != 12 || strcmp(name + 8, ".seg") != 0) {
+        return false;
+    }
+
+    char *end = nullptr;
+    unsigned long segment = strtoul(name, &end, 16);
+    if (end != name + 8 || segment == 0) {
+        return false;
+    }
+
+    *segment_out = (uint32_t)segment;
+    return true;
+}
+
+LoDbSegmentLog::LoDbSegmentLog(const char *dir_path, size_t segment_size)
+    : segment_size(segment_size), next_segment_id(1), live_bytes(0), total_bytes(0), roll_pending(false), compacting(false),
+      open_scans(0), batching(false), batch_segment(0), io(nullptr)
+{
+    strncpy(this->dir_path, dir_path, sizeof(this->dir_path) - 1);
+    this->dir_path[sizeof(this->dir_path) - 1] = '\0';
+}
+
+LoDbSegmentLog::~LoDbSegmentLog()
+{
+    // Segments are closed after every operation outside a batch
+    releaseBatchFile();
+}
+
+void LoDbSegmentLog::buildSegmentPath(uint32_t segment, char *path_out, size_t path_size) const
+{
+    snprintf(path_out, path_size, "%s/%08x.seg", dir_path, segment);
+}
+
+LoDbSegmentLog::SegmentInfo *LoDbSegmentLog::findSegment(uint32_t segment)
+{
+    auto it = std::lower_bound(segments.begin(), segments.end(), segment,
+                               [](const SegmentInfo &info, uint32_t id) { return info.id < id; });
+    if (it == segments.end() || it->id != segment) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+LoDbError LoDbSegmentLog::open()
+{
+    index.clear();
+    segments.clear();
+    next_segment_id = 1;
+    live_bytes = 0;
+    total_bytes = 0;
+    roll_pending = false;
+
+    File dir = lodb_open(dir_path, FILE_O_READ, io);
+    if (!dir) {
+        LOG_DEBUG("Segment directory not found: %s (empty log)", dir_path);
+        return LODB_OK;
+    }
+
+    if (!dir.isDirectory()) {
+        LOG_ERROR("Segment path is not a directory: %s", dir_path);
+        dir.close();
+        return LODB_ERR_IO;
+    }
+
+    // Collect segment ids, then replay them in append order
+    std::vector<uint32_t> ids;
+    while (true) {
+        File file = lodb_open_next(dir, io);
+        if (!file) {
+            break; // No more files
+        }
+
+        uint32_t segment;
+        bool is_segment = !file.isDirectory() && parseSegmentName(file.name(), &segment);
+        file.close();
+
+        if (is_segment) {
+            ids.push_back(segment);
+        }
+    }
+    dir.close();
+
+    std::sort(ids.begin(), ids.end());
+    for (uint32_t segment : ids) {
+        replaySegment(segment);
+    }
+
+    LOG_DEBUG("Opened segment log %s: %d segments, %d records", dir_path, segments.size(), index.size());
+    return LODB_OK;
+}
+
+void LoDbSegmentLog::replaySegment(uint32_t segment)
+{
+    char path[192];
+    buildSegmentPath(segment, path, sizeof(path));
+
+    File file = lodb_open(path, FILE_O_READ, io);
+    if (!file) {
+        LOG_WARN("Failed to open segment for replay: %s", path);
+        return;
+    }
+
+    uint32_t file_size = file.size();
+    segments.push_back({segment, file_size, 0});
+    next_segment_id = segment + 1;
+    total_bytes += file_size;
+
+    uint32_t position = 0;
+    uint8_t header[SEGMENT_HEADER_SIZE];
+    while (position + SEGMENT_HEADER_SIZE <= file_size) {
+        if (!file.seek(position) || lodb_read(file, header, SEGMENT_HEADER_SIZE, io) != SEGMENT_HEADER_SIZE) {
+            break;
+        }
+
+        uint8_t kind = header[0];
+        lodb_uuid_t uuid = lodb_get_le64(header + 1);
+        uint32_t length = lodb_get_le32(header + 9);
+        if ((kind != SEGMENT_FRAME_PUT && kind != SEGMENT_FRAME_DELETE) || length > file_size - position - SEGMENT_HEADER_SIZE) {
+            break;
+        }
+
+        unlinkRecord(uuid);
+        if (kind == SEGMENT_FRAME_PUT) {
+            uint32_t frame_size = SEGMENT_HEADER_SIZE + length;
+            index[uuid] = {segment, position + SEGMENT_HEADER_SIZE, length};
+            segments.back().live_bytes += frame_size;
+            live_bytes += frame_size;
+        }
+
+        position += SEGMENT_HEADER_SIZE + length;
+    }
+    file.close();
+
+    if (position != file_size) {
+        // Torn write from a power loss - never append after garbage
+        LOG_WARN("Ignoring %d trailing bytes in segment %s", file_size - position, path);
+        roll_pending = true;
+    }
+}
+
+void LoDbSegmentLog::unlinkRecord(lodb_uuid_t uuid)
+{
+    auto it = index.find(uuid);
+    if (it == index.end()) {
+        return;
+    }
+
+    uint32_t frame_size = SEGMENT_HEADER_SIZE + it->second.length;
+    SegmentInfo *info = findSegment(it->second.segment);
+    if (info) {
+        info->live_bytes -= frame_size;
+    }
+    live_bytes -= frame_size;
+    index.erase(it);
+}
+
+LoDbError LoDbSegmentLog::writeFrame(uint8_t kind, lodb_uuid_t uuid, const uint8_t *data, size_t length, uint32_t *offset_out)
+{
+    // Roll over to a new segment when the active one is full
+    if (segments.empty() || roll_pending || segments.back().size >= segment_size) {
+        segments.push_back({next_segment_id++, 0, 0});
+        roll_pending = false;
+    }
+
+    SegmentInfo &active = segments.back();
+    char path[192];
+    buildSegmentPath(active.id, path, sizeof(path));
+
+    uint8_t header[SEGMENT_HEADER_SIZE];
+    header[0] = kind;
+    lodb_put_le64(header + 1, uuid);
+    lodb_put_le32(header + 9, (uint32_t)length);
+
+    // Inside a batch the active segment stays open between frames
+    if (batch_segment != active.id) {
+        releaseBatchFile();
+        batch_file = lodb_open(path, LODB_FILE_O_APPEND, io);
+        if (!batch_file) {
+            LOG_ERROR("Failed to open segment for append: %s", path);
+            roll_pending = true;
+            return LODB_ERR_IO;
+        }
+        batch_segment = active.id;
+    }
+
+    size_t written = lodb_write(batch_file, header, SEGMENT_HEADER_SIZE, io);
+    if (written == SEGMENT_HEADER_SIZE && length > 0) {
+        written += lodb_write(batch_file, data, length, io);
+    }
+    if (!batching || written != SEGMENT_HEADER_SIZE + length) {
+        releaseBatchFile();
+    }
+
+    active.size += written;
+    total_bytes += written;
+
+    if (written != SEGMENT_HEADER_SIZE + length) {
+        LOG_ERROR("Failed to append to segment, wrote %d of %d bytes", written, SEGMENT_HEADER_SIZE + length);
+        roll_pending = true; // Partial frame ends this segment
+        return LODB_ERR_IO;
+    }
+
+    *offset_out = active.size - length;
+    return LODB_OK;
+}
+
+LoDbError LoDbSegmentLog::append(lodb_uuid_t uuid, const uint8_t *data, size_t length)
+{
+    uint32_t offset;
+    LoDbError err = writeFrame(SEGMENT_FRAME_PUT, uuid, data, length, &offset);
+    if (err != LODB_OK) {
+        return err;
+    }
+
+    unlinkRecord(uuid);
+    uint32_t frame_size = SEGMENT_HEADER_SIZE + length;
+    index[uuid] = {segments.back().id, offset, (uint32_t)length};
+    segments.back().live_bytes += frame_size;
+    live_bytes += frame_size;
+
+    maybeCompact();
+    return LODB_OK;
+}
+
+LoDbError LoDbSegmentLog::remove(lodb_uuid_t uuid)
+{
+    if (!contains(uuid)) {
+        return LODB_ERR_NOT_FOUND;
+    }
+
+    uint32_t offset;
+    LoDbError err = writeFrame(SEGMENT_FRAME_DELETE, uuid, nullptr, 0, &offset);
+    if (err != LODB_OK) {
+        return err;
+    }
+
+    unlinkRecord(uuid);
+    maybeCompact();
+    return LODB_OK;
+}
+
+void LoDbSegmentLog::keys(std::vector<lodb_uuid_t> &keys_out) const
+{
+    keys_out.clear();
+    keys_out.reserve(index.size());
+    for (const auto &entry : index) {
+        keys_out.push_back(entry.first);
+    }
+}
+
+LoDbError LoDbSegmentLog::openRecord(lodb_uuid_t uuid, File *file_out, size_t *length_out)
+{
+    auto it = index.find(uuid);
+    if (it == index.end()) {
+        return LODB_ERR_NOT_FOUND;
+    }
+
+    const Location &location = it->second;
+
+    char path[192];
+    buildSegmentPath(location.segment, path, sizeof(path));
+
+    // Make frames buffered by a batch visible to this read
+    if (location.segment == batch_segment) {
+        batch_file.flush();
+    }
+
+    auto file = lodb_open(path, FILE_O_READ, io);
+    if (!file) {
+        LOG_ERROR("Failed to open segment: %s", path);
+        return LODB_ERR_IO;
+    }
+
+    if (!file.seek(location.offset)) {
+        LOG_ERROR("Failed to seek to record " LODB_UUID_FMT " in %s", LODB_UUID_ARGS(uuid), path);
+        file.close();
+        return LODB_ERR_IO;
+    }
+
+    *file_out = std::move(file);
+    *length_out = location.length;
+    return LODB_OK;
+}
+
+LoDbError LoDbSegmentLog::clear()
+{
+    LoDbError result = LODB_OK;
+    char path[192];
+    releaseBatchFile();
+
+    // Remove oldest first so a partial clear never resurrects deleted records
+    while (!segments.empty()) {
+        buildSegmentPath(segments.front().id, path, sizeof(path));
+        if (!LoFS::remove(path) && LoFS::exists(path)) {
+            LOG_WARN("Failed to remove segment: %s", path);
+            result = LODB_ERR_IO;
+            break;
+        }
+        total_bytes -= segments.front().size;
+        segments.erase(segments.begin());
+    }
+
+    index.clear();
+    live_bytes = 0;
+    roll_pending = !segments.empty();
+    return result;
+}
+
+void LoDbSegmentLog::beginBatch()
+{
+    batching = true;
+}
+
+void LoDbSegmentLog::endBatch()
+{
+    batching = false;
+    releaseBatchFile();
+    maybeCompact();
+}
+
+void LoDbSegmentLog::releaseBatchFile()
+{
+    if (batch_segment != 0) {
+        batch_file.flush();
+        batch_file.close();
+        batch_segment = 0;
+    }
+}
+
+void LoDbSegmentLog::maybeCompact()
+{
+    if (batching || open_scans > 0) {
+        return; // Deferred to endBatch() or the last endScan()
+    }
+
+    // Compact once garbage outweighs live data by at least a full segment
+    size_t garbage = total_bytes - live_bytes;
+    if (!compacting && garbage >= segment_size && garbage > live_bytes) {
+        compact();
+    }
+}
+
+LoDbError LoDbSegmentLog::compact()
+{
+    if (segments.empty() || compacting) {
+        return LODB_OK;
+    }
+    if (open_scans > 0) {
+        LOG_WARN("Not compacting %s while %d scans are open", dir_path, open_scans);
+        return LODB_ERR_BUSY;
+    }
+
+    compacting = true;
+    releaseBatchFile();
+    size_t garbage_before = total_bytes - live_bytes;
+
+    // Copy live records forward into fresh segments
+    Scan scan;
+    beginScan(scan);
+    roll_pending = true;
+
+    LoDbError err = LODB_OK;
+    std::vector<uint8_t> payload;
+    lodb_uuid_t uuid;
+    uint32_t length;
+    while (nextScan(scan, &uuid, &length)) {
+        payload.resize(length);
+        if (length > 0 && lodb_read(scan.file, payload.data(), length, io) != length) {
+            LOG_ERROR("Short read during compaction of %s", dir_path);
+            err = LODB_ERR_IO;
+            break;
+        }
+
+        err = append(uuid, payload.data(), length);
+        if (err != LODB_OK) {
+            break;
+        }
+    }
+    endScan(scan);
+
+    // Remove the old segments, oldest first
+    char path[192];
+    while (err == LODB_OK && !segments.empty() && segments.front().id <= scan.last_segment) {
+        buildSegmentPath(segments.front().id, path, sizeof(path));
+        if (!LoFS::remove(path)) {
+            LOG_WARN("Failed to remove compacted segment: %s", path);
+            err = LODB_ERR_IO;
+            break;
+        }
+        total_bytes -= segments.front().size;
+        segments.erase(segments.begin());
+    }
+
+    compacting = false;
+    LOG_INFO("Compacted segment log %s: reclaimed %d bytes", dir_path, garbage_before - (total_bytes - live_bytes));
+    return err;
+}
+
+void LoDbSegmentLog::beginScan(Scan &scan)
+{
+    open_scans++;
+    scan.segment = 0;
+    scan.last_segment = segments.empty() ? 0 : segments.back().id;
+    scan.position = 0;
+    scan.size = 0;
+    scan.open = false;
+}
+
+bool LoDbSegmentLog::nextScan(Scan &scan, lodb_uuid_t *uuid_out, uint32_t *length_out)
+{
+    uint8_t header[SEGMENT_HEADER_SIZE];
+
+    while (true) {
+        if (!scan.open) {
+            // Advance to the next segment that still exists
+            auto it = std::upper_bound(segments.begin(), segments.end(), scan.segment,
+                                       [](uint32_t id, const SegmentInfo &info) { return id < info.id; });
+            if (it == segments.end() || it->id > scan.last_segment) {
+                return false;
+            }
+
+            scan.segment = it->id;
+            scan.size = it->size;
+            scan.position = 0;
+
+            char path[192];
+            buildSegmentPath(scan.segment, path, sizeof(path));
+            scan.file = lodb_open(path, FILE_O_READ, io);
+            if (!scan.file) {
+                LOG_WARN("Failed to open segment for scan: %s", path);
+                continue;
+            }
+            scan.open = true;
+        }
+
+        if (scan.position + SEGMENT_HEADER_SIZE > scan.size || !scan.file.seek(scan.position) ||
+            lodb_read(scan.file, header, SEGMENT_HEADER_SIZE, io) != SEGMENT_HEADER_SIZE) {
+            scan.file.close();
+            scan.open = false;
+            continue;
+        }
+
+        uint8_t kind = header[0];
+        lodb_uuid_t uuid = lodb_get_le64(header + 1);
+        uint32_t length = lodb_get_le32(header + 9);
+        if ((kind != SEGMENT_FRAME_PUT && kind != SEGMENT_FRAME_DELETE) ||
+            length > scan.size - scan.position - SEGMENT_HEADER_SIZE) {
+            scan.file.close();
+            scan.open = false;
+            continue;
+        }
+
+        uint32_t payload_offset = scan.position + SEGMENT_HEADER_SIZE;
+        scan.position = payload_offset + length;
+
+        // Only the frame the map points at is live
+        if (kind != SEGMENT_FRAME_PUT) {
+            continue;
+        }
+        auto it = index.find(uuid);
+        if (it == index.end() || it->second.segment != scan.segment || it->second.offset != payload_offset) {
+            continue;
+        }
+
+        *uuid_out = uuid;
+        *length_out = length;
+        return true;
+    }
+}
+
+void LoDbSegmentLog::endScan(Scan &scan)
+{
+    if (scan.open) {
+        scan.file.close();
+        scan.open = false;
+    }
+
+    // Run the compaction the scan held back
+    if (open_scans > 0 && --open_scans == 0) {
+        maybeCompact();
+    }
+}
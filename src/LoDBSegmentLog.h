@@ -0,0 +1,188 @@
+#pragma once
+
+#include "LoDB.h"
+#include "lofs/src/LoFS.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/**
+ * Sequential scan state, see LoDbSegmentLog::beginScan()/nextScan()/endScan()
+ */
+struct LoDbSegmentScan {
+    uint32_t segment = 0;      // Segment currently being read (0 before the first)
+    uint32_t last_segment = 0; // Last segment that existed when the scan began
+    uint32_t position = 0;     // Offset of the next frame in the current segment
+    uint32_t size = 0;         // Size of the current segment when it was opened
+    bool open = false;         // Whether file holds an open segment
+    File file;                 // Open segment, positioned at the payload after nextScan()
+};
+
+/**
+ * LoDB Segment Log Storage Engine
+ *
+ * Stores a table as append-only segment files: {table_path}/{segment_id}.seg
+ * Every insert, update and delete appends one length-prefixed frame to the active
+ * segment, which rolls over to a new file once it grows past segment_size.
+ * An in-memory map from UUID to (segment, offset, length) always points at the
+ * latest live copy of each record, so lookups never scan the log.
+ *
+ * Frame layout (little-endian):
+ *   [1 byte kind][8 bytes uuid][4 bytes payload length][payload]
+ *
+ * Deletes append a tombstone frame with an empty payload. Superseded frames and
+ * tombstones are garbage that compact() reclaims by copying live records forward
+ * into fresh segments and removing the old ones (oldest first, so a crash part way
+ * through can never resurrect a deleted record on replay).
+ */
+class LoDbSegmentLog
+{
+  public:
+    /**
+     * Location of a live record payload within the log
+     */
+    struct Location {
+        uint32_t segment; // Segment id
+        uint32_t offset;  // Offset of the payload within the segment file
+        uint32_t length;  // Payload length in bytes
+    };
+
+    typedef LoDbSegmentScan Scan;
+
+    /**
+     * @param dir_path Directory holding the segment files (the table path)
+     * @param segment_size Size at which the active segment rolls over
+     */
+    LoDbSegmentLog(const char *dir_path, size_t segment_size);
+
+    ~LoDbSegmentLog();
+
+    /**
+     * Replay all segments in the directory and rebuild the UUID map
+     * @return LODB_OK on success, error code otherwise
+     */
+    LoDbError open();
+
+    /**
+     * Check whether a live record exists for a UUID (memory only)
+     */
+    bool contains(lodb_uuid_t uuid) const { return index.find(uuid) != index.end(); }
+
+    /**
+     * Number of live records
+     */
+    size_t size() const { return index.size(); }
+
+    /**
+     * UUIDs of the live records in ascending order (memory only)
+     */
+    void keys(std::vector<lodb_uuid_t> &keys_out) const;
+
+    /**
+     * Append a record, superseding any previous copy with the same UUID
+     * @param uuid UUID of the record
+     * @param data Encoded record bytes
+     * @param length Number of encoded bytes
+     * @return LODB_OK on success, LODB_ERR_IO on write failure
+     */
+    LoDbError append(lodb_uuid_t uuid, const uint8_t *data, size_t length);
+
+    /**
+     * Append a tombstone for a UUID
+     * @return LODB_OK on success, LODB_ERR_NOT_FOUND if UUID doesn't exist, LODB_ERR_IO on write failure
+     */
+    LoDbError remove(lodb_uuid_t uuid);
+
+    /**
+     * Open the segment holding the latest payload of a record, positioned at the payload
+     * @param uuid UUID of the record
+     * @param file_out Receives the open segment (the caller closes it)
+     * @param length_out Receives the payload length
+     * @return LODB_OK on success, LODB_ERR_NOT_FOUND if UUID doesn't exist, LODB_ERR_IO otherwise
+     */
+    LoDbError openRecord(lodb_uuid_t uuid, File *file_out, size_t *length_out);
+
+    /**
+     * Remove every segment file and forget all records
+     * @return LODB_OK on success, LODB_ERR_IO if a segment could not be removed
+     */
+    LoDbError clear();
+
+    /**
+     * Copy live records into fresh segments and remove all older segments
+     * @return LODB_OK on success, LODB_ERR_BUSY while a scan is open, error code otherwise
+     *         (old segments are kept on failure)
+     */
+    LoDbError compact();
+
+    /**
+     * Start a sequential scan over live records in append order. Records appended
+     * after the scan begins are not visited. Compaction is deferred while any scan
+     * is open, since it would move the records the scan has yet to visit.
+     */
+    void beginScan(Scan &scan);
+
+    /**
+     * Advance to the next live record
+     * @param scan Scan state from beginScan()
+     * @param uuid_out UUID of the record
+     * @param length_out Payload length; scan.file is positioned at the payload
+     * @return true if a record was found, false at the end of the log
+     */
+    bool nextScan(Scan &scan, lodb_uuid_t *uuid_out, uint32_t *length_out);
+
+    /**
+     * Release resources held by a scan, then compact if due and no other scan is open
+     */
+    void endScan(Scan &scan);
+
+    /**
+     * Start a batch: appends keep the active segment open and skip the per-frame
+     * flush, and compaction is deferred until endBatch()
+     */
+    void beginBatch();
+
+    /**
+     * End a batch: flush and close the active segment, then compact if due
+     */
+    void endBatch();
+
+    /**
+     * Count the segment's storage traffic in these counters (NULL stops counting)
+     */
+    void setIoCounters(LoDbIoCounters *counters) { io = counters; }
+
+  private:
+    /**
+     * Per-segment bookkeeping
+     */
+    struct SegmentInfo {
+        uint32_t id;         // Segment id (file name)
+        uint32_t size;       // Bytes in the segment file
+        uint32_t live_bytes; // Bytes of frames still referenced by the map
+    };
+
+    char dir_path[160];
+    size_t segment_size;
+    std::map<lodb_uuid_t, Location> index;
+    std::vector<SegmentInfo> segments; // Sorted by id, last one is active
+    uint32_t next_segment_id;
+    size_t live_bytes;
+    size_t total_bytes;
+    bool roll_pending; // Start a new segment before the next append
+    bool compacting;
+    uint32_t open_scans;    // Scans between beginScan() and endScan()
+    bool batching;         // Inside beginBatch()/endBatch()
+    uint32_t batch_segment; // Segment held open by batch_file (0 if none)
+    File batch_file;
+    LoDbIoCounters *io;
+
+    void buildSegmentPath(uint32_t segment, char *path_out, size_t path_size) const;
+    SegmentInfo *findSegment(uint32_t segment);
+    void replaySegment(uint32_t segment);
+    void unlinkRecord(lodb_uuid_t uuid);
+    LoDbError writeFrame(uint8_t kind, lodb_uuid_t uuid, const uint8_t *data, size_t length, uint32_t *offset_out);
+    void maybeCompact();
+    void releaseBatchFile();
+};
@@ -0,0 +1,93 @@
+#include "LoDBStats.h"
+
+#if LODB_STATS
+
+void LoDbTableCounters::record(meshtastic_LoDBOperation operation, int error, uint32_t elapsed_us)
+{
+    LoDbOperationCounters &counters = operations[operation];
+    counters.count++;
+    counters.total_us += elapsed_us;
+    if (elapsed_us > counters.max_us) {
+        counters.max_us = elapsed_us;
+    }
+
+    // Bucket of the highest set bit: 0-1 us in bucket 0, 2-3 us in bucket 1, 4-7 us in bucket 2...
+    uint32_t bucket = 0;
+    while (bucket + 1 < LODB_STATS_LATENCY_BUCKETS && (elapsed_us >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    counters.latency_histogram[bucket]++;
+
+    if (error != 0) {
+        counters.errors++;
+        if (error > 0 && error < LODB_STATS_ERROR_CODES) {
+            errors_by_code[error]++;
+        }
+    }
+}
+
+void LoDbTableCounters::add(const LoDbTableCounters &other)
+{
+    for (int op = 0; op < _meshtastic_LoDBOperation_ARRAYSIZE; op++) {
+        LoDbOperationCounters &counters = operations[op];
+        const LoDbOperationCounters &added = other.operations[op];
+        counters.count += added.count;
+        counters.errors += added.errors;
+        counters.total_us += added.total_us;
+        if (added.max_us > counters.max_us) {
+            counters.max_us = added.max_us;
+        }
+        for (int bucket = 0; bucket < LODB_STATS_LATENCY_BUCKETS; bucket++) {
+            counters.latency_histogram[bucket] += added.latency_histogram[bucket];
+        }
+    }
+    for (int code = 0; code < LODB_STATS_ERROR_CODES; code++) {
+        errors_by_code[code] += other.errors_by_code[code];
+    }
+    addIo(other.io);
+}
+
+void LoDbTableCounters::addIo(const LoDbIoCounters &other)
+{
+    io.bytes_read += other.bytes_read;
+    io.bytes_written += other.bytes_written;
+    io.files_opened += other.files_opened;
+    io.records_decoded += other.records_decoded;
+    io.compression_input_bytes += other.compression_input_bytes;
+    io.compression_output_bytes += other.compression_output_bytes;
+}
+
+void LoDbTableCounters::fill(meshtastic_LoDBTableStats *stats_out) const
+{
+    stats_out->operations_count = 0;
+    for (int op = 0; op < _meshtastic_LoDBOperation_ARRAYSIZE; op++) {
+        const LoDbOperationCounters &counters = operations[op];
+        if (counters.count == 0) {
+            continue;
+        }
+        meshtastic_LoDBOperationStats &entry = stats_out->operations[stats_out->operations_count++];
+        entry.operation = (meshtastic_LoDBOperation)op;
+        entry.count = counters.count;
+        entry.errors = counters.errors;
+        entry.total_latency_us = counters.total_us;
+        entry.max_latency_us = counters.max_us;
+        entry.latency_histogram_count = LODB_STATS_LATENCY_BUCKETS;
+        for (int bucket = 0; bucket < LODB_STATS_LATENCY_BUCKETS; bucket++) {
+            entry.latency_histogram[bucket] = counters.latency_histogram[bucket];
+        }
+    }
+
+    stats_out->errors_by_code_count = LODB_STATS_ERROR_CODES;
+    for (int code = 0; code < LODB_STATS_ERROR_CODES; code++) {
+        stats_out->errors_by_code[code] = errors_by_code[code];
+    }
+
+    stats_out->bytes_read = io.bytes_read;
+    stats_out->bytes_written = io.bytes_written;
+    stats_out->files_opened = io.files_opened;
+    stats_out->records_decoded = io.records_decoded;
+    stats_out->compression_input_bytes = io.compression_input_bytes;
+    stats_out->compression_output_bytes = io.compression_output_bytes;
+}
+
+#endif
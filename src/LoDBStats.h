@@ -0,0 +1,129 @@
+#pragma once
+
+#include "lofs/src/LoFS.h"
+#include "stats.pb.h"
+#include <cstddef>
+#include <cstdint>
+
+// Per-table operation and I/O instrumentation; build with -DLODB_STATS=0 to compile it out
+#ifndef LODB_STATS
+#define LODB_STATS 1
+#endif
+
+// Log2 latency buckets per operation (the last one collects everything from ~8 s up)
+#define LODB_STATS_LATENCY_BUCKETS 24
+
+// Slots of the per-LoDbError failure counters
+#define LODB_STATS_ERROR_CODES 16
+
+/**
+ * Storage traffic caused by a table (or the write-ahead log)
+ */
+struct LoDbIoCounters {
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    uint32_t files_opened = 0; // Files and directories, including directory entries opened by scans
+    uint32_t records_decoded = 0;
+    uint64_t compression_input_bytes = 0;  // Encoded bytes handed to the table's codec
+    uint64_t compression_output_bytes = 0; // Bytes stored for them (ratio = input / output)
+};
+
+/**
+ * Calls of one operation
+ */
+struct LoDbOperationCounters {
+    uint32_t count = 0;
+    uint32_t errors = 0;
+    uint64_t total_us = 0;
+    uint32_t max_us = 0;
+    uint32_t latency_histogram[LODB_STATS_LATENCY_BUCKETS] = {};
+};
+
+/**
+ * Instrumentation of one table
+ */
+struct LoDbTableCounters {
+    LoDbOperationCounters operations[_meshtastic_LoDBOperation_ARRAYSIZE];
+    uint32_t errors_by_code[LODB_STATS_ERROR_CODES] = {};
+    LoDbIoCounters io;
+
+    /**
+     * Count one call
+     * @param error LoDbError the call returned (LODB_OK on success), or -1 for a failure without a code
+     */
+    void record(meshtastic_LoDBOperation operation, int error, uint32_t elapsed_us);
+
+    /**
+     * Add another table's counters to these (for database totals)
+     */
+    void add(const LoDbTableCounters &other);
+
+    /**
+     * Add I/O counters that don't belong to a table
+     */
+    void addIo(const LoDbIoCounters &other);
+
+    /**
+     * Copy into a stats message (name is left to the caller)
+     */
+    void fill(meshtastic_LoDBTableStats *stats_out) const;
+};
+
+#if LODB_STATS
+#define LODB_STATS_ADD(io, field, amount)                                                                                    \
+    do {                                                                                                                     \
+        if (io) {                                                                                                            \
+            (io)->field += (amount);                                                                                         \
+        }                                                                                                                    \
+    } while (0)
+#else
+#define LODB_STATS_ADD(io, field, amount) ((void)0)
+#endif
+
+/**
+ * LoFS::open() counted as a file open when it succeeds
+ */
+static inline File lodb_open(const char *path, const char *mode, LoDbIoCounters *io)
+{
+    File file = LoFS::open(path, mode);
+#if LODB_STATS
+    if (io && file) {
+        io->files_opened++;
+    }
+#endif
+    return file;
+}
+
+/**
+ * File::read() counted towards bytes_read
+ */
+static inline size_t lodb_read(File &file, uint8_t *buffer, size_t size, LoDbIoCounters *io)
+{
+    size_t got = file.read(buffer, size);
+    LODB_STATS_ADD(io, bytes_read, got);
+    return got;
+}
+
+/**
+ * File::write() counted towards bytes_written
+ */
+static inline size_t lodb_write(File &file, const uint8_t *buffer, size_t size, LoDbIoCounters *io)
+{
+    size_t written = file.write(buffer, size);
+    LODB_STATS_ADD(io, bytes_written, written);
+    return written;
+}
+
+/**
+ * File::openNextFile() counted as a file open when it returns an entry
+ */
+static inline File lodb_open_next(File &dir, LoDbIoCounters *io)
+{
+    File file = dir.openNextFile();
+#if LODB_STATS
+    if (io && file) {
+        io->files_opened++;
+    }
+#endif
+    return file;
+}
@@ -0,0 +1,461 @@
+#include "LoDBWal.h"
+#include "LoDBBytes.h"
+#include "configuration.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <cstring>
+
+// Frame kinds - the 0xC0 marker lets replay detect a torn or garbage tail
+#define WAL_FRAME_PUT 0xC1
+#define WAL_FRAME_DELETE 0xC2
+#define WAL_FRAME_DISCARD 0xC3
+
+// Largest frame header: kind, name length, name, uuid, payload length
+#define WAL_HEADER_MAX (2 + 255 + 12)
+#define WAL_CHECKSUM_SIZE 4
+
+// Bytes read per call when verifying payload checksums during replay
+#define WAL_REPLAY_CHUNK 64
+
+#ifdef LODB_HOST
+LoDbWal::LoDbWal(const char *dir_path, size_t group_commit_bytes, uint32_t group_commit_ms)
+    : group_commit_bytes(group_commit_bytes), group_commit_ms(group_commit_ms), log_open(false), log_bytes(0),
+      unsynced_bytes(0), unsynced_since(0), torn(false), io(nullptr), stopping(false)
+{
+    snprintf(log_path, sizeof(log_path), "%s/wal.log", dir_path);
+    snprintf(temp_path, sizeof(temp_path), "%s/wal.tmp", dir_path);
+    flusher = std::thread(&LoDbWal::flushLoop, this);
+}
+
+LoDbWal::~LoDbWal()
+{
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    flusher.join();
+    closeLog();
+}
+
+void LoDbWal::flushLoop()
+{
+    std::unique_lock<std::recursive_mutex> guard(lock);
+    while (!stopping) {
+        if (unsynced_bytes == 0) {
+            wake.wait(guard);
+            continue;
+        }
+        uint32_t elapsed = millis() - unsynced_since;
+        if (elapsed < group_commit_ms) {
+            wake.wait_for(guard, std::chrono::milliseconds(group_commit_ms - elapsed));
+            continue;
+        }
+        sync();
+    }
+}
+#else
+LoDbWal::LoDbWal(const char *dir_path, size_t group_commit_bytes, uint32_t group_commit_ms)
+    : concurrency::OSThread("LoDbWal"), group_commit_bytes(group_commit_bytes), group_commit_ms(group_commit_ms),
+      log_open(false), log_bytes(0), unsynced_bytes(0), unsynced_since(0), torn(false), io(nullptr)
+{
+    snprintf(log_path, sizeof(log_path), "%s/wal.log", dir_path);
+    snprintf(temp_path, sizeof(temp_path), "%s/wal.tmp", dir_path);
+}
+
+LoDbWal::~LoDbWal()
+{
+    closeLog();
+}
+
+int32_t LoDbWal::runOnce()
+{
+    sync();
+    if (unsynced_bytes == 0) {
+        return disable(); // The next append that starts a commit window enables the thread again
+    }
+    uint32_t elapsed = millis() - unsynced_since;
+    return elapsed >= group_commit_ms ? 0 : group_commit_ms - elapsed;
+}
+#endif
+
+void LoDbWal::closeLog()
+{
+#ifdef LODB_HOST
+    std::lock_guard<std::recursive_mutex> guard(lock);
+#endif
+    if (log_open) {
+        log_file.flush();
+        log_file.close();
+        log_open = false;
+    }
+    unsynced_bytes = 0;
+}
+
+LoDbError LoDbWal::open()
+{
+    closeLog();
+    pending.clear();
+    log_bytes = 0;
+    torn = false;
+
+    // Finish or discard a rewrite that was interrupted around the rename
+    if (LoFS::exists(temp_path)) {
+        if (LoFS::exists(log_path)) {
+            LoFS::remove(temp_path);
+        } else if (!LoFS::rename(temp_path, log_path)) {
+            LOG_ERROR("Failed to recover write-ahead log: %s", temp_path);
+            return LODB_ERR_IO;
+        }
+    }
+
+    auto file = lodb_open(log_path, FILE_O_READ, io);
+    if (!file) {
+        return LODB_OK; // No log, nothing pending
+    }
+
+    size_t valid_bytes = 0;
+    torn = !replay(file, &valid_bytes);
+    file.close();
+    log_bytes = valid_bytes;
+
+    size_t records = 0;
+    for (auto &table : pending) {
+        records += table.second.size();
+    }
+    LOG_INFO("Replayed write-ahead log %s: %d pending records in %d tables", log_path, records, pending.size());
+
+    // Drop the torn tail so new frames are reachable by the next replay
+    if (torn) {
+        LOG_WARN("Torn write-ahead log tail after %d bytes: %s", valid_bytes, log_path);
+        return reset(std::set<std::string>());
+    }
+    return LODB_OK;
+}
+
+bool LoDbWal::replay(File &file, size_t *valid_bytes_out)
+{
+    size_t file_size = file.size();
+    size_t position = 0;
+
+    while (position < file_size) {
+        uint8_t header[WAL_HEADER_MAX];
+        if (lodb_read(file, header, 2, io) != 2 || (header[0] != WAL_FRAME_PUT && header[0] != WAL_FRAME_DELETE &&
+                                          header[0] != WAL_FRAME_DISCARD)) {
+            break;
+        }
+
+        size_t name_length = header[1];
+        size_t header_size = 2 + name_length + 12;
+        if (lodb_read(file, header + 2, name_length + 12, io) != name_length + 12) {
+            break;
+        }
+
+        uint32_t length = lodb_get_le32(header + 2 + name_length + 8);
+        if (position + header_size + length + WAL_CHECKSUM_SIZE > file_size) {
+            break;
+        }
+
+        // Verify the payload without holding it in memory
+        uint32_t checksum = lodb_fnv1a(LODB_FNV_OFFSET_BASIS, header, header_size);
+        uint8_t chunk[WAL_REPLAY_CHUNK];
+        bool complete = true;
+        for (uint32_t done = 0; done < length && complete;) {
+            size_t count = std::min((size_t)WAL_REPLAY_CHUNK, (size_t)(length - done));
+            complete = lodb_read(file, chunk, count, io) == count;
+            checksum = lodb_fnv1a(checksum, chunk, count);
+            done += count;
+        }
+
+        uint8_t stored[WAL_CHECKSUM_SIZE];
+        if (!complete || lodb_read(file, stored, sizeof(stored), io) != sizeof(stored) || lodb_get_le32(stored) != checksum) {
+            break;
+        }
+
+        std::string table_name((const char *)header + 2, name_length);
+        lodb_uuid_t uuid = lodb_get_le64(header + 2 + name_length);
+        apply(header[0], table_name, uuid, (uint32_t)(position + header_size), length);
+        position += header_size + length + WAL_CHECKSUM_SIZE;
+    }
+
+    *valid_bytes_out = position;
+    return position == file_size;
+}
+
+void LoDbWal::apply(uint8_t kind, const std::string &table_name, lodb_uuid_t uuid, uint32_t offset, uint32_t length)
+{
+    if (kind == WAL_FRAME_DISCARD) {
+        pending.erase(table_name);
+        return;
+    }
+    pending[table_name][uuid] = {offset, length, kind == WAL_FRAME_DELETE};
+}
+
+bool LoDbWal::writeFrame(File &file, uint8_t kind, const std::string &table_name, lodb_uuid_t uuid, const uint8_t *data,
+                         size_t length, size_t *written_out)
+{
+    uint8_t header[WAL_HEADER_MAX];
+    size_t name_length = table_name.size();
+    header[0] = kind;
+    header[1] = (uint8_t)name_length;
+    memcpy(header + 2, table_name.data(), name_length);
+    lodb_put_le64(header + 2 + name_length, uuid);
+    lodb_put_le32(header + 2 + name_length + 8, (uint32_t)length);
+    size_t header_size = 2 + name_length + 12;
+
+    uint8_t trailer[WAL_CHECKSUM_SIZE];
+    lodb_put_le32(trailer, lodb_fnv1a(lodb_fnv1a(LODB_FNV_OFFSET_BASIS, header, header_size), data, length));
+
+    size_t written = lodb_write(file, header, header_size, io);
+    if (written == header_size && length > 0) {
+        written += lodb_write(file, data, length, io);
+    }
+    if (written == header_size + length) {
+        written += lodb_write(file, trailer, sizeof(trailer), io);
+    }
+
+    *written_out = written;
+    return written == header_size + length + WAL_CHECKSUM_SIZE;
+}
+
+LoDbError LoDbWal::append(uint8_t kind, const char *table_name, lodb_uuid_t uuid, const uint8_t *data, size_t length)
+{
+#ifdef LODB_HOST
+    std::lock_guard<std::recursive_mutex> guard(lock);
+#endif
+    size_t name_length = strlen(table_name);
+    if (name_length > 255) {
+        LOG_ERROR("Table name too long for the write-ahead log: %s", table_name);
+        return LODB_ERR_INVALID;
+    }
+
+    // A torn log can't be appended to safely, rewrite it without the tail first
+    if (torn) {
+        LoDbError err = reset(std::set<std::string>());
+        if (err != LODB_OK) {
+            return err;
+        }
+    }
+
+    if (!log_open) {
+        log_file = lodb_open(log_path, LODB_FILE_O_APPEND, io);
+        if (!log_file) {
+            LOG_ERROR("Failed to open write-ahead log: %s", log_path);
+            return LODB_ERR_IO;
+        }
+        log_open = true;
+    }
+
+    size_t written;
+    std::string name(table_name, name_length);
+    if (!writeFrame(log_file, kind, name, uuid, data, length, &written)) {
+        LOG_ERROR("Failed to append to write-ahead log, wrote %d bytes", written);
+        closeLog();
+        torn = true;
+        return LODB_ERR_IO;
+    }
+
+    apply(kind, name, uuid, (uint32_t)(log_bytes + 2 + name_length + 12), (uint32_t)length);
+    log_bytes += written;
+
+    bool window_opened = unsynced_bytes == 0;
+    if (window_opened) {
+        unsynced_since = millis();
+    }
+    unsynced_bytes += written;
+    sync();
+
+    // The timer flushes the window once group_commit_ms has passed, even if nothing else is written
+    if (window_opened && unsynced_bytes > 0) {
+#ifdef LODB_HOST
+        wake.notify_one();
+#else
+        enabled = true;
+        setIntervalFromNow(group_commit_ms);
+#endif
+    }
+    return LODB_OK;
+}
+
+LoDbError LoDbWal::put(const char *table_name, lodb_uuid_t uuid, const uint8_t *data, size_t length)
+{
+    return append(WAL_FRAME_PUT, table_name, uuid, data, length);
+}
+
+LoDbError LoDbWal::remove(const char *table_name, lodb_uuid_t uuid)
+{
+    return append(WAL_FRAME_DELETE, table_name, uuid, nullptr, 0);
+}
+
+LoDbError LoDbWal::discard(const char *table_name)
+{
+    if (pending.find(table_name) == pending.end()) {
+        return LODB_OK; // Nothing to discard
+    }
+
+    LoDbError err = append(WAL_FRAME_DISCARD, table_name, 0, nullptr, 0);
+    if (err == LODB_OK) {
+        sync(true);
+    }
+    return err;
+}
+
+void LoDbWal::sync(bool force)
+{
+#ifdef LODB_HOST
+    std::lock_guard<std::recursive_mutex> guard(lock);
+#endif
+    if (!log_open || unsynced_bytes == 0) {
+        return;
+    }
+
+    if (force || unsynced_bytes >= group_commit_bytes || millis() - unsynced_since >= group_commit_ms) {
+        log_file.flush();
+        LOG_DEBUG("Group commit of %d bytes to %s", unsynced_bytes, log_path);
+        unsynced_bytes = 0;
+    }
+}
+
+const LoDbWal::Entry *LoDbWal::find(const std::string &table_name, lodb_uuid_t uuid) const
+{
+    auto table = pending.find(table_name);
+    if (table == pending.end()) {
+        return nullptr;
+    }
+    auto it = table->second.find(uuid);
+    return it == table->second.end() ? nullptr : &it->second;
+}
+
+const LoDbWal::TableEntries *LoDbWal::entries(const std::string &table_name) const
+{
+    auto table = pending.find(table_name);
+    return table == pending.end() ? nullptr : &table->second;
+}
+
+std::set<std::string> LoDbWal::tableNames() const
+{
+    std::set<std::string> names;
+    for (auto &table : pending) {
+        names.insert(table.first);
+    }
+    return names;
+}
+
+LoDbError LoDbWal::read(const Entry &entry, uint8_t *buffer, size_t capacity)
+{
+    if (entry.length > capacity) {
+        LOG_ERROR("Logged record is %d bytes, exceeds buffer of %d", entry.length, capacity);
+        return LODB_ERR_IO;
+    }
+
+    File file;
+    LoDbError err = openRecord(entry, &file);
+    if (err != LODB_OK) {
+        return err;
+    }
+
+    size_t bytes_read = lodb_read(file, buffer, entry.length, io);
+    file.close();
+
+    if (bytes_read != entry.length) {
+        LOG_ERROR("Short read of %d bytes at %d from %s", entry.length, entry.offset, log_path);
+        return LODB_ERR_IO;
+    }
+    return LODB_OK;
+}
+
+LoDbError LoDbWal::openRecord(const Entry &entry, File *file_out)
+{
+    // Make appends waiting for a group commit visible to this read
+    sync(true);
+
+    auto file = lodb_open(log_path, FILE_O_READ, io);
+    if (!file) {
+        LOG_ERROR("Failed to open write-ahead log: %s", log_path);
+        return LODB_ERR_IO;
+    }
+    if (!file.seek(entry.offset)) {
+        LOG_ERROR("Failed to seek to %d in %s", entry.offset, log_path);
+        file.close();
+        return LODB_ERR_IO;
+    }
+
+    *file_out = std::move(file);
+    return LODB_OK;
+}
+
+LoDbError LoDbWal::reset(const std::set<std::string> &applied)
+{
+    closeLog();
+
+    std::map<std::string, TableEntries> remaining;
+    for (auto &table : pending) {
+        if (applied.find(table.first) == applied.end() && !table.second.empty()) {
+            remaining.insert(table);
+        }
+    }
+
+    if (remaining.empty()) {
+        if (LoFS::exists(log_path) && !LoFS::remove(log_path)) {
+            LOG_ERROR("Failed to remove write-ahead log: %s", log_path);
+            return LODB_ERR_IO;
+        }
+        pending.clear();
+        log_bytes = 0;
+        torn = false;
+        return LODB_OK;
+    }
+
+    // Copy the latest frame of each remaining record into a fresh log
+    LoFS::remove(temp_path);
+    auto out = lodb_open(temp_path, FILE_O_WRITE, io);
+    if (!out) {
+        LOG_ERROR("Failed to create write-ahead log: %s", temp_path);
+        return LODB_ERR_IO;
+    }
+
+    bool ok = true;
+    size_t position = 0;
+    for (auto &table : remaining) {
+        for (auto &record : table.second) {
+            Entry &entry = record.second;
+            uint8_t *payload = entry.length > 0 ? new uint8_t[entry.length] : nullptr;
+            ok = entry.length == 0 || read(entry, payload, entry.length) == LODB_OK;
+
+            size_t written = 0;
+            uint8_t kind = entry.deleted ? WAL_FRAME_DELETE : WAL_FRAME_PUT;
+            ok = ok && writeFrame(out, kind, table.first, record.first, payload, entry.length, &written);
+            delete[] payload;
+            if (!ok) {
+                break;
+            }
+
+            entry.offset = (uint32_t)(position + 2 + table.first.size() + 12);
+            position += written;
+        }
+        if (!ok) {
+            break;
+        }
+    }
+    out.flush();
+    out.close();
+
+    if (!ok) {
+        LOG_ERROR("Failed to rewrite write-ahead log: %s", temp_path);
+        LoFS::remove(temp_path);
+        return LODB_ERR_IO;
+    }
+
+    // open() finishes the rename if power is lost between these two steps
+    LoFS::remove(log_path);
+    if (!LoFS::rename(temp_path, log_path)) {
+        LOG_ERROR("Failed to rename write-ahead log: %s", temp_path);
+        return LODB_ERR_IO;
+    }
+
+    pending.swap(remaining);
+    log_bytes = position;
+    torn = false;
+    LOG_DEBUG("Rewrote write-ahead log %s: %d bytes", log_path, position);
+    return LODB_OK;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "LoDB.h"
+#include "lofs/src/LoFS.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+
+#ifdef LODB_HOST
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#else
+#include "concurrency/OSThread.h"
+#endif
+
+/**
+ * LoDB Write-Ahead Log
+ *
+ * One log per database: {db_path}/wal.log
+ * Inserts, updates and deletes of every table are appended here and acknowledged
+ * without touching table storage. Appends are buffered and flushed together (group
+ * commit) once enough bytes or time have accumulated, so writes from several modules
+ * share one flush. The time limit is kept by a timer the log owns (an OSThread in the
+ * firmware, a std::thread on host builds), so a write followed by silence is flushed
+ * too. LoDb::checkpoint() later applies the pending records to table storage in one
+ * batch and resets the log.
+ *
+ * Frame layout (little-endian):
+ *   [1 byte kind][1 byte table name length][table name][8 bytes uuid][4 bytes payload length][payload][4 bytes checksum]
+ *
+ * The checksum (FNV-1a over the rest of the frame) lets replay stop at a torn tail.
+ * Only the latest frame per UUID matters, so memory holds one location per pending
+ * record and payloads are read back from the log on demand.
+ */
+class LoDbWal
+#ifndef LODB_HOST
+    : private concurrency::OSThread
+#endif
+{
+  public:
+    /**
+     * Latest logged state of a record that has not been applied to table storage
+     */
+    struct Entry {
+        uint32_t offset; // Offset of the payload within the log
+        uint32_t length; // Payload length in bytes
+        bool deleted;    // Logged as deleted (no payload)
+    };
+
+    typedef std::map<lodb_uuid_t, Entry> TableEntries;
+
+    /**
+     * @param dir_path Directory holding the log (the database path)
+     * @param group_commit_bytes Flush once this many bytes are waiting
+     * @param group_commit_ms Flush once the oldest waiting write is this old
+     */
+    LoDbWal(const char *dir_path, size_t group_commit_bytes, uint32_t group_commit_ms);
+
+    ~LoDbWal();
+
+    /**
+     * Replay the log and rebuild the pending records of every table
+     * @return LODB_OK on success, LODB_ERR_IO if the log could not be recovered
+     */
+    LoDbError open();
+
+    /**
+     * Log a new version of a record
+     * @return LODB_OK on success, LODB_ERR_INVALID if the table name is too long, LODB_ERR_IO on write failure
+     */
+    LoDbError put(const char *table_name, lodb_uuid_t uuid, const uint8_t *data, size_t length);
+
+    /**
+     * Log the deletion of a record
+     * @return LODB_OK on success, LODB_ERR_INVALID if the table name is too long, LODB_ERR_IO on write failure
+     */
+    LoDbError remove(const char *table_name, lodb_uuid_t uuid);
+
+    /**
+     * Log that every pending record of a table was discarded (the log is flushed before returning)
+     * @return LODB_OK on success, LODB_ERR_INVALID if the table name is too long, LODB_ERR_IO on write failure
+     */
+    LoDbError discard(const char *table_name);
+
+    /**
+     * Flush waiting appends if the group commit window has passed
+     * @param force Flush regardless of the window
+     */
+    void sync(bool force = false);
+
+    /**
+     * Latest pending state of a record
+     * @return Pointer to the entry, NULL if the record has nothing pending
+     */
+    const Entry *find(const std::string &table_name, lodb_uuid_t uuid) const;
+
+    /**
+     * Pending records of a table in UUID order
+     * @return Pointer to the records, NULL if the table has nothing pending
+     */
+    const TableEntries *entries(const std::string &table_name) const;
+
+    /**
+     * Names of all tables with pending records
+     */
+    std::set<std::string> tableNames() const;
+
+    /**
+     * Read the payload of a pending record
+     * @return LODB_OK on success, LODB_ERR_IO if the payload doesn't fit or could not be read
+     */
+    LoDbError read(const Entry &entry, uint8_t *buffer, size_t capacity);
+
+    /**
+     * Open the log positioned at the payload of a pending record
+     * @param file_out Receives the open log (the caller closes it)
+     * @return LODB_OK on success, LODB_ERR_IO otherwise
+     */
+    LoDbError openRecord(const Entry &entry, File *file_out);
+
+    /**
+     * Forget the pending records of tables that were applied to storage and rewrite
+     * the log with whatever remains (or remove it when nothing does)
+     * @param applied Tables whose pending records are now in table storage
+     * @return LODB_OK on success, LODB_ERR_IO on failure (the old log is kept)
+     */
+    LoDbError reset(const std::set<std::string> &applied);
+
+    /**
+     * Bytes in the log
+     */
+    size_t size() const { return log_bytes; }
+
+    /**
+     * Count the log's storage traffic in these counters (NULL stops counting)
+     */
+    void setIoCounters(LoDbIoCounters *counters) { io = counters; }
+
+  private:
+    char log_path[160];
+    char temp_path[160];
+    size_t group_commit_bytes;
+    uint32_t group_commit_ms;
+    std::map<std::string, TableEntries> pending;
+    File log_file;           // Held open for appends between group commits
+    bool log_open;
+    size_t log_bytes;        // Valid bytes in the log
+    size_t unsynced_bytes;   // Bytes appended since the last flush
+    uint32_t unsynced_since; // millis() of the oldest unflushed append
+    bool torn;               // A write failed part way, rewrite the log before appending again
+    LoDbIoCounters *io;
+
+#ifdef LODB_HOST
+    std::recursive_mutex lock;         // Guards the log file against the flusher thread
+    std::condition_variable_any wake;  // Signalled when an append starts a commit window or the flusher must stop
+    bool stopping;
+    std::thread flusher;
+
+    void flushLoop();
+#else
+    virtual int32_t runOnce() override;
+#endif
+
+    LoDbError append(uint8_t kind, const char *table_name, lodb_uuid_t uuid, const uint8_t *data, size_t length);
+    bool writeFrame(File &file, uint8_t kind, const std::string &table_name, lodb_uuid_t uuid, const uint8_t *data,
+                    size_t length, size_t *written_out);
+    bool replay(File &file, size_t *valid_bytes_out);
+    void apply(uint8_t kind, const std::string &table_name, lodb_uuid_t uuid, uint32_t offset, uint32_t length);
+    void closeLog();
+};
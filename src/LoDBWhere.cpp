@@ -0,0 +1,287 @@
+#include "LoDB.h"
+#include "configuration.h"
+#include <algorithm>
+#include <cstring>
+#include <pb_common.h>
+#include <pb_decode.h>
+
+// Bytes compared per read when matching string and bytes fields
+#define WHERE_TEXT_CHUNK 32
+
+static bool compareOrdered(LoDbOperator op, int order)
+{
+    switch (op) {
+    case LODB_OP_EQ:
+        return order == 0;
+    case LODB_OP_NE:
+        return order != 0;
+    case LODB_OP_LT:
+        return order < 0;
+    case LODB_OP_LE:
+        return order <= 0;
+    case LODB_OP_GT:
+        return order > 0;
+    case LODB_OP_GE:
+        return order >= 0;
+    }
+    return false;
+}
+
+static bool isTextType(pb_type_t type)
+{
+    return PB_LTYPE(type) == PB_LTYPE_STRING || PB_LTYPE(type) == PB_LTYPE_BYTES;
+}
+
+// Wire type a field of this nanopb type is encoded with
+static pb_wire_type_t wireTypeOf(pb_type_t type)
+{
+    switch (PB_LTYPE(type)) {
+    case PB_LTYPE_FIXED32:
+        return PB_WT_32BIT;
+    case PB_LTYPE_FIXED64:
+        return PB_WT_64BIT;
+    case PB_LTYPE_STRING:
+    case PB_LTYPE_BYTES:
+        return PB_WT_STRING;
+    default:
+        return PB_WT_VARINT;
+    }
+}
+
+LoDbWhere &LoDbWhere::add(pb_size_t field_tag, LoDbOperator op, int64_t value)
+{
+    Condition condition = {};
+    condition.tag = field_tag;
+    condition.op = op;
+    condition.is_text = false;
+    condition.value = value;
+    conditions.push_back(condition);
+    bound = false;
+    return *this;
+}
+
+LoDbWhere &LoDbWhere::add(pb_size_t field_tag, LoDbOperator op, const std::string &value)
+{
+    Condition condition = {};
+    condition.tag = field_tag;
+    condition.op = op;
+    condition.is_text = true;
+    condition.text = value;
+    conditions.push_back(condition);
+    bound = false;
+    return *this;
+}
+
+bool LoDbWhere::bind(const pb_msgdesc_t *descriptor, size_t record_size, const std::vector<LoDbFixedField> &fixed_fields)
+{
+    std::stable_sort(conditions.begin(), conditions.end(), [](const Condition &a, const Condition &b) { return a.tag < b.tag; });
+
+    // Field iteration needs a message to point into, although nothing is read from it
+    uint8_t *probe = new uint8_t[record_size];
+    bool ok = true;
+
+    // nanopb encodes a whole oneof at the position of its lowest member, so messages with
+    // one don't arrive in tag order
+    in_tag_order = true;
+    pb_field_iter_t field;
+    if (pb_field_iter_begin(&field, descriptor, probe)) {
+        do {
+            if (PB_HTYPE(field.type) == PB_HTYPE_ONEOF) {
+                in_tag_order = false;
+                break;
+            }
+        } while (pb_field_iter_next(&field));
+    }
+
+    for (Condition &condition : conditions) {
+        pb_field_iter_t iter;
+        if (!pb_field_iter_begin(&iter, descriptor, probe) || !pb_field_iter_find(&iter, condition.tag)) {
+            LOG_ERROR("Where condition on unknown field %d", condition.tag);
+            ok = false;
+            break;
+        }
+
+        // A oneof member's absence can't be told from its default, so its conditions are rejected
+        if (PB_HTYPE(iter.type) == PB_HTYPE_REPEATED || PB_HTYPE(iter.type) == PB_HTYPE_ONEOF ||
+            PB_ATYPE(iter.type) == PB_ATYPE_CALLBACK || PB_LTYPE(iter.type) == PB_LTYPE_SUBMESSAGE) {
+            LOG_ERROR("Where condition on unsupported field %d", condition.tag);
+            ok = false;
+            break;
+        }
+
+        // Fixed-width fields may be float or double, whose bits don't compare as integers, unless declared
+        condition.is_signed = false;
+        if (PB_LTYPE(iter.type) == PB_LTYPE_FIXED32 || PB_LTYPE(iter.type) == PB_LTYPE_FIXED64) {
+            auto declared = std::find_if(fixed_fields.begin(), fixed_fields.end(),
+                                         [&condition](const LoDbFixedField &field) { return field.tag == condition.tag; });
+            if (declared == fixed_fields.end() || declared->type == LODB_FIXED_FLOAT) {
+                LOG_ERROR("Where condition on float, double or undeclared fixed-width field %d", condition.tag);
+                ok = false;
+                break;
+            }
+            condition.is_signed = declared->type == LODB_FIXED_SIGNED;
+        }
+
+        if (condition.is_text != isTextType(iter.type)) {
+            LOG_ERROR("Where condition value does not match the type of field %d", condition.tag);
+            ok = false;
+            break;
+        }
+
+        condition.type = iter.type;
+    }
+    delete[] probe;
+
+    bound = ok;
+    return ok;
+}
+
+bool LoDbWhere::matches(const uint8_t *buffer, size_t size)
+{
+    if (!bound) {
+        return false;
+    }
+
+    // Start from the default value, used when a field is absent from the encoding
+    for (Condition &condition : conditions) {
+        int order;
+        if (condition.is_text) {
+            order = condition.text.empty() ? 0 : -1;
+        } else {
+            order = condition.value > 0 ? -1 : (condition.value < 0 ? 1 : 0);
+        }
+        condition.outcome = compareOrdered(condition.op, order);
+    }
+
+    pb_istream_t stream = pb_istream_from_buffer(buffer, size);
+    size_t settled = 0; // Conditions on fields before the current tag have their final outcome
+
+    while (stream.bytes_left > 0) {
+        pb_wire_type_t wire_type;
+        uint32_t tag;
+        bool eof;
+        if (!pb_decode_tag(&stream, &wire_type, &tag, &eof)) {
+            if (eof) {
+                break;
+            }
+            return false; // Corrupt encoding
+        }
+
+        // pb_encode writes fields in tag order, so earlier fields can no longer change
+        if (in_tag_order) {
+            while (settled < conditions.size() && conditions[settled].tag < tag) {
+                if (!conditions[settled].outcome) {
+                    return false;
+                }
+                settled++;
+            }
+            if (settled == conditions.size()) {
+                return true;
+            }
+        }
+
+        // Conditions on this field, if any, start at the first unsettled one. Without tag
+        // order every condition stays open to the end, and the last occurrence of a field wins.
+        size_t first = settled;
+        if (!in_tag_order) {
+            first = std::lower_bound(conditions.begin(), conditions.end(), tag,
+                                     [](const Condition &condition, uint32_t value) { return condition.tag < value; }) -
+                    conditions.begin();
+        }
+        if (first == conditions.size() || conditions[first].tag != tag || wire_type != wireTypeOf(conditions[first].type)) {
+            if (!pb_skip_field(&stream, wire_type)) {
+                return false;
+            }
+            continue;
+        }
+
+        if (conditions[first].is_text) {
+            // Compare the field bytes against every text condition on this tag in one pass
+            uint32_t length;
+            if (!pb_decode_varint32(&stream, &length) || length > stream.bytes_left) {
+                return false;
+            }
+
+            uint8_t chunk[WHERE_TEXT_CHUNK];
+            size_t last = first;
+            while (last < conditions.size() && conditions[last].tag == tag) {
+                conditions[last++].order = 0;
+            }
+
+            for (uint32_t offset = 0; offset < length;) {
+                size_t count = std::min((size_t)WHERE_TEXT_CHUNK, (size_t)(length - offset));
+                if (!pb_read(&stream, chunk, count)) {
+                    return false;
+                }
+                for (size_t i = first; i < last; i++) {
+                    int &order = conditions[i].order;
+                    const std::string &text = conditions[i].text;
+                    for (size_t j = 0; order == 0 && j < count; j++) {
+                        if (offset + j >= text.size()) {
+                            order = 1; // Field is longer than the value
+                        } else if (chunk[j] != (uint8_t)text[offset + j]) {
+                            order = chunk[j] < (uint8_t)text[offset + j] ? -1 : 1;
+                        }
+                    }
+                }
+                offset += count;
+            }
+
+            for (size_t i = first; i < last; i++) {
+                int order = conditions[i].order;
+                if (order == 0 && length < conditions[i].text.size()) {
+                    order = -1; // Field is a prefix of the value
+                }
+                conditions[i].outcome = compareOrdered(conditions[i].op, order);
+            }
+            continue;
+        }
+
+        // Scalar field: decode just this value
+        int64_t value;
+        switch (PB_LTYPE(conditions[first].type)) {
+        case PB_LTYPE_SVARINT: {
+            if (!pb_decode_svarint(&stream, &value)) {
+                return false;
+            }
+            break;
+        }
+        case PB_LTYPE_FIXED32: {
+            uint32_t raw;
+            if (!pb_decode_fixed32(&stream, &raw)) {
+                return false;
+            }
+            value = conditions[first].is_signed ? (int64_t)(int32_t)raw : (int64_t)raw;
+            break;
+        }
+        case PB_LTYPE_FIXED64: {
+            uint64_t raw;
+            if (!pb_decode_fixed64(&stream, &raw)) {
+                return false;
+            }
+            value = (int64_t)raw;
+            break;
+        }
+        default: {
+            uint64_t raw;
+            if (!pb_decode_varint(&stream, &raw)) {
+                return false;
+            }
+            value = (int64_t)raw; // Negative int32/int64 values are sign-extended to 64 bits on the wire
+            break;
+        }
+        }
+
+        for (size_t i = first; i < conditions.size() && conditions[i].tag == tag; i++) {
+            int order = value < conditions[i].value ? -1 : (value > conditions[i].value ? 1 : 0);
+            conditions[i].outcome = compareOrdered(conditions[i].op, order);
+        }
+    }
+
+    for (size_t i = settled; i < conditions.size(); i++) {
+        if (!conditions[i].outcome) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -1,10 +1,14 @@
 #include "LoDB.h"
+#include "LoDBAsync.h"
+#include "LoDBWal.h"
 #include "lofs/src/LoFS.h"
 #include "DebugConfiguration.h"
 #include "gps/RTC.h"
 #include "diagnostics.pb.h"
+#include <Arduino.h>
 #include <algorithm>
 #include <cstring>
+#include <set>
 #include <string>
 
 void lodb_diagnostics()
@@ -18,10 +22,14 @@ void lodb_diagnostics()
         "/sd/lodb/test_db_2",
         "/sd/lodb/test_db_3",
         "/sd/lodb/test_db_4",
+        "/sd/lodb/test_db_wal",
+        "/sd/lodb/test_db_cache",
         "/internal/lodb/test_db_1",
         "/internal/lodb/test_db_2",
         "/internal/lodb/test_db_3",
         "/internal/lodb/test_db_4",
+        "/internal/lodb/test_db_wal",
+        "/internal/lodb/test_db_cache",
     };
     size_t numCleanupDirs = sizeof(cleanupDirs) / sizeof(cleanupDirs[0]);
     for (size_t i = 0; i < numCleanupDirs; i++) {
@@ -139,18 +147,23 @@ void lodb_diagnostics()
     LOG_INFO("db2->insert(\"items\", auto-uuid): %s (UUID: " LODB_UUID_FMT ")", err == LODB_OK ? "SUCCESS" : "FAILED", LODB_UUID_ARGS(uuid));
     lodb_uuid_t uuid4 = uuid;
 
-    // Insert multiple records for select/count tests
+    // Insert multiple records for select/count tests in one batch
+    meshtastic_LoDBDiagnosticsTest bulk_records[5] = {};
+    const void *bulk_pointers[5];
+    lodb_uuid_t bulk_uuids[5];
+    LoDbError bulk_statuses[5];
     for (int i = 0; i < 5; i++) {
-        record.id = 20 + i;
-        char value[32];
-        snprintf(value, sizeof(value), "bulk_test_%d", i);
-        strncpy(record.value, value, sizeof(record.value) - 1);
-        record.timestamp = getTime() + i;
-        record.active = (i % 2 == 0);
-        uuid = lodb_new_uuid(nullptr, i);
-        err = db1->insert("users", uuid, &record);
-        if (err != LODB_OK) {
-            LOG_INFO("db1->insert(\"users\", bulk-%d): FAILED", i);
+        bulk_records[i].id = 20 + i;
+        snprintf(bulk_records[i].value, sizeof(bulk_records[i].value), "bulk_test_%d", i);
+        bulk_records[i].timestamp = getTime() + i;
+        bulk_records[i].active = (i % 2 == 0);
+        bulk_pointers[i] = &bulk_records[i];
+        bulk_uuids[i] = lodb_new_uuid(nullptr, i);
+    }
+    err = db1->insertMany("users", bulk_uuids, bulk_pointers, 5, bulk_statuses);
+    for (int i = 0; i < 5; i++) {
+        if (bulk_statuses[i] != LODB_OK) {
+            LOG_INFO("db1->insertMany(\"users\", bulk-%d): FAILED", i);
         }
     }
     LOG_INFO("Inserted 5 additional records for bulk operations");
@@ -441,8 +454,739 @@ void lodb_diagnostics()
     LOG_INFO("db1->count(\"users\") unchanged: %d records", db1->count("users"));
     LOG_INFO("");
 
-    // Test 14: Cleanup
-    LOG_INFO("--- Test 14: Cleanup ---");
+    // Test 13: Segment Log Storage
+    LOG_INFO("--- Test 13: Segment Log Storage ---");
+
+    LoDbTableOptions segmentOptions;
+    segmentOptions.storage = LODB_STORAGE_SEGMENT_LOG;
+    segmentOptions.segment_size = 1024; // Small segments to exercise roll-over
+    err = db1->registerTable("journal", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), segmentOptions);
+    LOG_INFO("db1->registerTable(\"journal\", segment-log): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+
+    lodb_uuid_t journalUuids[20];
+    for (int i = 0; i < 20; i++) {
+        record.id = 300 + i;
+        snprintf(record.value, sizeof(record.value), "journal_%d", i);
+        record.timestamp = getTime() + i;
+        record.active = (i % 2 == 0);
+        journalUuids[i] = lodb_new_uuid(nullptr, 3000 + i);
+        if (db1->insert("journal", journalUuids[i], &record) != LODB_OK) {
+            LOG_INFO("db1->insert(\"journal\", %d): FAILED", i);
+        }
+    }
+    LOG_INFO("db1->count(\"journal\"): %d records (should be 20)", db1->count("journal"));
+
+    err = db1->insert("journal", journalUuids[0], &record);
+    LOG_INFO("db1->insert(\"journal\", duplicate-uuid): %s (should be FAILED)", err == LODB_OK ? "SUCCESS" : "FAILED");
+
+    record.id = 777;
+    strncpy(record.value, "journal_updated", sizeof(record.value) - 1);
+    err = db1->update("journal", journalUuids[5], &record);
+    LOG_INFO("db1->update(\"journal\", uuid5): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+    err = db1->get("journal", journalUuids[5], &retrieved);
+    LOG_INFO("  Update verification: %s (id=%u)", err == LODB_OK && retrieved.id == 777 ? "MATCH" : "MISMATCH", retrieved.id);
+
+    err = db1->deleteRecord("journal", journalUuids[6]);
+    LOG_INFO("db1->deleteRecord(\"journal\", uuid6): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+    err = db1->get("journal", journalUuids[6], &retrieved);
+    LOG_INFO("  Verification: get after delete: %s (should be NOT_FOUND)", err == LODB_ERR_NOT_FOUND ? "NOT_FOUND (expected)" : "FOUND (unexpected)");
+
+    auto journalActive = db1->select("journal", filterActive, comparatorId, 0);
+    LOG_INFO("db1->select(\"journal\", filter-active+sorted): %d records (should be 9)", journalActive.size());
+    LoDb::freeRecords(journalActive);
+
+    err = db1->compact("journal");
+    LOG_INFO("db1->compact(\"journal\"): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+
+    // Re-registering replays the segments from disk
+    db1->registerTable("journal", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), segmentOptions);
+    LOG_INFO("db1->count(\"journal\") after compact and replay: %d records (should be 19)", db1->count("journal"));
+    err = db1->get("journal", journalUuids[5], &retrieved);
+    LOG_INFO("  Replay verification: %s (id=%u)", err == LODB_OK && retrieved.id == 777 ? "MATCH" : "MISMATCH", retrieved.id);
+
+    // Deleting inside a scan builds up enough garbage to compact, which waits for the cursor
+    for (int i = 0; i < 20; i++) {
+        record.id = 320 + i;
+        snprintf(record.value, sizeof(record.value), "journal_%d", 20 + i);
+        db1->insert("journal", lodb_new_uuid(nullptr, 3020 + i), &record);
+    }
+    int journalTotal = db1->count("journal");
+    int journalVisited = 0;
+    lodb_uuid_t journalUuid;
+    LoDbCursor journalCursor = db1->scan("journal");
+    while (journalCursor.next(&retrieved, &journalUuid)) {
+        journalVisited++;
+        db1->deleteRecord("journal", journalUuid);
+    }
+    journalCursor.close();
+    LOG_INFO("db1->scan(\"journal\") deleting each record: visited %d of %d records (should match)", journalVisited, journalTotal);
+    LOG_INFO("db1->count(\"journal\") after deleting during scan: %d records (should be 0)", db1->count("journal"));
+
+    err = db1->drop("journal");
+    LOG_INFO("db1->drop(\"journal\"): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+    LOG_INFO("");
+
+    // Test 14: Key Directory
+    LOG_INFO("--- Test 14: Key Directory ---");
+
+    LoDbTableOptions keyOptions;
+    keyOptions.key_directory = true;
+    err = db1->registerTable("users", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), keyOptions);
+    LOG_INFO("db1->registerTable(\"users\", key-directory): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+
+    err = db1->insert("users", uuid1, &record);
+    LOG_INFO("db1->insert(\"users\", duplicate-uuid): %s (should be FAILED)", err == LODB_OK ? "SUCCESS" : "FAILED");
+
+    err = db1->get("users", fakeUuid, &retrieved);
+    LOG_INFO("db1->get(\"users\", nonexistent-uuid): %s (should be NOT_FOUND)", err == LODB_ERR_NOT_FOUND ? "NOT_FOUND (expected)" : "FOUND (unexpected)");
+
+    record.id = 400;
+    strncpy(record.value, "key_directory", sizeof(record.value) - 1);
+    uuid = lodb_new_uuid(nullptr, 4000);
+    err = db1->insert("users", uuid, &record);
+    LOG_INFO("db1->insert(\"users\", new-uuid): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+    err = db1->update("users", uuid, &record);
+    LOG_INFO("db1->update(\"users\", new-uuid): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+    err = db1->deleteRecord("users", uuid);
+    LOG_INFO("db1->deleteRecord(\"users\", new-uuid): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+    err = db1->update("users", uuid, &record);
+    LOG_INFO("db1->update(\"users\", deleted-uuid): %s (should be NOT_FOUND)", err == LODB_ERR_NOT_FOUND ? "NOT_FOUND (expected)" : "SUCCESS (unexpected)");
+    LOG_INFO("");
+
+    // Test 15: Streaming Cursor
+    LOG_INFO("--- Test 15: Streaming Cursor ---");
+
+    // Scan all records into a single reused buffer
+    int scanned = 0;
+    LoDbCursor cursor = db1->scan("users");
+    while (cursor.next(&retrieved)) {
+        scanned++;
+    }
+    LOG_INFO("db1->scan(\"users\"): %d records (should match count: %d)", scanned, db1->count("users"));
+
+    // Scan with filter and stop after the first match
+    lodb_uuid_t firstActiveUuid = 0;
+    cursor = db1->scan("users", filterActive);
+    bool foundActive = cursor.next(&retrieved, &firstActiveUuid);
+    cursor.close();
+    LOG_INFO("db1->scan(\"users\", filter-active) first match: %s (UUID: " LODB_UUID_FMT ", active=%s)", foundActive ? "FOUND" : "NONE",
+             LODB_UUID_ARGS(firstActiveUuid), retrieved.active ? "true" : "false");
+
+    // Scan of a non-existent table is already exhausted
+    cursor = db1->scan("nonexistent");
+    LOG_INFO("db1->scan(\"nonexistent\"): %s (should be EMPTY)", cursor.next(&retrieved) ? "NOT EMPTY (unexpected)" : "EMPTY (expected)");
+    LOG_INFO("");
+
+    // Test 16: Pagination
+    LOG_INFO("--- Test 16: Pagination ---");
+
+    // Sorted pages: the second page starts where the first one ended
+    int userCount = db1->count("users");
+    auto page1 = db1->select("users", LoDbFilter(), comparatorId, 2, 0);
+    auto page2 = db1->select("users", LoDbFilter(), comparatorId, 2, 2);
+    bool pagesOrdered = page1.size() == 2 && page2.size() == 2 &&
+                        ((meshtastic_LoDBDiagnosticsTest *)page1[1])->id > ((meshtastic_LoDBDiagnosticsTest *)page2[0])->id;
+    LOG_INFO("db1->select(\"users\", sorted, limit=2, offset=0/2): %d + %d records, %s", page1.size(), page2.size(),
+             pagesOrdered ? "ORDERED" : "NOT ORDERED");
+    LoDb::freeRecords(page1);
+    LoDb::freeRecords(page2);
+
+    // Unsorted pages stop scanning early and skip rows without decoding them
+    auto lastPage = db1->select("users", LoDbFilter(), LoDbComparator(), 3, userCount - 1);
+    LOG_INFO("db1->select(\"users\", limit=3, offset=%d): %d records (should be 1)", userCount - 1, lastPage.size());
+    LoDb::freeRecords(lastPage);
+    auto pastEnd = db1->select("users", LoDbFilter(), LoDbComparator(), 3, userCount);
+    LOG_INFO("db1->select(\"users\", limit=3, offset=%d): %d records (should be 0)", userCount, pastEnd.size());
+    LoDb::freeRecords(pastEnd);
+    LOG_INFO("");
+
+    // Test 17: Arena Result Set
+    LOG_INFO("--- Test 17: Arena Result Set ---");
+
+    // Same query as Test 7's sorted+limited select, but stored in one arena
+    LoDbResultSet arenaResults;
+    err = db1->select("users", arenaResults, filterActive, comparatorId, 2);
+    bool arenaSorted = arenaResults.size() < 2 ||
+                       arenaResults.at<meshtastic_LoDBDiagnosticsTest>(0)->id > arenaResults.at<meshtastic_LoDBDiagnosticsTest>(1)->id;
+    LOG_INFO("db1->select(\"users\", arena, filter-active+sorted+limit=2): %s, %d records, %s", err == LODB_OK ? "SUCCESS" : "FAILED",
+             arenaResults.size(), arenaSorted ? "ORDERED" : "NOT ORDERED");
+    arenaResults.clear();
+    err = db1->select("nonexistent", arenaResults);
+    LOG_INFO("db1->select(\"nonexistent\", arena): %s (should be INVALID)", err == LODB_ERR_INVALID ? "INVALID (expected)" : "UNEXPECTED");
+    LOG_INFO("");
+
+    // Test 18: Secondary Index
+    LOG_INFO("--- Test 18: Secondary Index ---");
+
+    err = db1->createIndex("users", meshtastic_LoDBDiagnosticsTest_id_tag);
+    LOG_INFO("db1->createIndex(\"users\", id): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+    err = db1->createIndex("users", meshtastic_LoDBDiagnosticsTest_value_tag);
+    LOG_INFO("db1->createIndex(\"users\", value): %s (should be INVALID)", err == LODB_ERR_INVALID ? "INVALID (expected)" : "UNEXPECTED");
+
+    std::vector<lodb_uuid_t> indexedUuids;
+    db1->findRange("users", meshtastic_LoDBDiagnosticsTest_id_tag, 0, UINT32_MAX, indexedUuids);
+    LOG_INFO("db1->findRange(\"users\", id, all): %d UUIDs (should match count: %d)", indexedUuids.size(), db1->count("users"));
+
+    // Insert, re-key and delete a record, checking the index follows each change
+    record.id = 4242;
+    uuid = lodb_new_uuid(nullptr, 4242);
+    db1->insert("users", uuid, &record);
+    db1->findEq("users", meshtastic_LoDBDiagnosticsTest_id_tag, 4242, indexedUuids);
+    LOG_INFO("db1->findEq(\"users\", id=4242) after insert: %d (should be 1)", indexedUuids.size());
+    record.id = 4343;
+    db1->update("users", uuid, &record);
+    db1->findEq("users", meshtastic_LoDBDiagnosticsTest_id_tag, 4242, indexedUuids);
+    int oldKeyMatches = indexedUuids.size();
+    auto byIndex = db1->selectByIndex("users", meshtastic_LoDBDiagnosticsTest_id_tag, 4343, 4343);
+    LOG_INFO("db1->selectByIndex(\"users\", id=4343) after update: %d (should be 1, old key: %d)", byIndex.size(), oldKeyMatches);
+    LoDb::freeRecords(byIndex);
+    db1->deleteRecord("users", uuid);
+    db1->findEq("users", meshtastic_LoDBDiagnosticsTest_id_tag, 4343, indexedUuids);
+    LOG_INFO("db1->findEq(\"users\", id=4343) after delete: %d (should be 0)", indexedUuids.size());
+
+    // Re-registering reopens the index, which keeps following writes without another createIndex()
+    db1->registerTable("users", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), keyOptions);
+    record.id = 4444;
+    uuid = lodb_new_uuid(nullptr, 4444);
+    db1->insert("users", uuid, &record);
+    db1->findEq("users", meshtastic_LoDBDiagnosticsTest_id_tag, 4444, indexedUuids);
+    LOG_INFO("db1->findEq(\"users\", id=4444) after re-register and insert: %d (should be 1)", indexedUuids.size());
+    db1->deleteRecord("users", uuid);
+
+    err = db1->dropIndex("users", meshtastic_LoDBDiagnosticsTest_id_tag);
+    LOG_INFO("db1->dropIndex(\"users\", id): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+    LOG_INFO("");
+
+    // Test 19: Where Clause
+    LOG_INFO("--- Test 19: Where Clause ---");
+
+    // Same predicate as filterActive, but rejected rows are never decoded
+    LoDbWhere whereActive = LoDbWhere().eq(meshtastic_LoDBDiagnosticsTest_active_tag, 1);
+    auto whereResults = db1->select("users", whereActive);
+    LOG_INFO("db1->select(\"users\", where active=1): %d records (should match count with filter-active: %d)", whereResults.size(),
+             db1->count("users", filterActive));
+    LoDb::freeRecords(whereResults);
+
+    LoDbWhere whereId = LoDbWhere().gt(meshtastic_LoDBDiagnosticsTest_id_tag, 20);
+    LOG_INFO("db1->count(\"users\", where id>20): %d (should match count with filter-id>20: %d)", db1->count("users", whereId),
+             db1->count("users", filterId));
+
+    LoDbWhere whereValue = LoDbWhere().ne(meshtastic_LoDBDiagnosticsTest_value_tag, std::string("key_directory"));
+    LOG_INFO("db1->count(\"users\", where value!=\"key_directory\"): %d", db1->count("users", whereValue));
+
+    LoDbWhere whereBadType = LoDbWhere().eq(meshtastic_LoDBDiagnosticsTest_value_tag, 1);
+    LOG_INFO("db1->count(\"users\", where value=1): %d (should be -1)", db1->count("users", whereBadType));
+
+    // The oneof is encoded at tag 2's position, so timestamp (3) arrives before text (5)
+    err = db1->registerTable("oneofs", &meshtastic_LoDBDiagnosticsOneof_msg, sizeof(meshtastic_LoDBDiagnosticsOneof));
+    LOG_INFO("db1->registerTable(\"oneofs\"): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+    meshtastic_LoDBDiagnosticsOneof oneofRecord = meshtastic_LoDBDiagnosticsOneof_init_zero;
+    oneofRecord.id = 1;
+    oneofRecord.which_payload = meshtastic_LoDBDiagnosticsOneof_text_tag;
+    strncpy(oneofRecord.payload.text, "oneof", sizeof(oneofRecord.payload.text) - 1);
+    oneofRecord.timestamp = 100;
+    db1->insert("oneofs", lodb_new_uuid(nullptr, 9001), &oneofRecord);
+    oneofRecord = meshtastic_LoDBDiagnosticsOneof_init_zero;
+    oneofRecord.id = 2;
+    oneofRecord.which_payload = meshtastic_LoDBDiagnosticsOneof_number_tag;
+    oneofRecord.payload.number = 7;
+    oneofRecord.timestamp = 200;
+    db1->insert("oneofs", lodb_new_uuid(nullptr, 9002), &oneofRecord);
+
+    LoDbWhere whereOneof = LoDbWhere().eq(meshtastic_LoDBDiagnosticsOneof_timestamp_tag, 100);
+    LOG_INFO("db1->count(\"oneofs\", where timestamp=100): %d (should be 1)", db1->count("oneofs", whereOneof));
+    LoDbWhere whereOneofId = LoDbWhere().eq(meshtastic_LoDBDiagnosticsOneof_id_tag, 2).ge(meshtastic_LoDBDiagnosticsOneof_timestamp_tag, 200);
+    LOG_INFO("db1->count(\"oneofs\", where id=2 and timestamp>=200): %d (should be 1)", db1->count("oneofs", whereOneofId));
+    LoDbWhere whereOneofMember = LoDbWhere().eq(meshtastic_LoDBDiagnosticsOneof_text_tag, std::string("oneof"));
+    LOG_INFO("db1->count(\"oneofs\", where text=\"oneof\"): %d (should be -1)", db1->count("oneofs", whereOneofMember));
+    db1->drop("oneofs");
+    LOG_INFO("");
+
+    // Test 20: Write-Ahead Log
+    LOG_INFO("--- Test 20: Write-Ahead Log ---");
+
+    LoDbOptions walOptions;
+    walOptions.write_ahead_log = true;
+    LoDb *walDb = new LoDb("test_db_wal", LoFS::FSType::AUTO, walOptions);
+    err = walDb->registerTable("events", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest));
+    LOG_INFO("walDb->registerTable(\"events\"): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+
+    lodb_uuid_t walUuids[10];
+    for (int i = 0; i < 10; i++) {
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 4000 + i;
+        snprintf(record.value, sizeof(record.value), "event_%d", i);
+        walUuids[i] = lodb_new_uuid(nullptr, 4000 + i);
+        if (walDb->insert("events", walUuids[i], &record) != LODB_OK) {
+            LOG_INFO("walDb->insert(\"events\", %d): FAILED", i);
+        }
+    }
+
+    // Served from the log before any checkpoint
+    err = walDb->get("events", walUuids[3], &record);
+    LOG_INFO("walDb->get(\"events\", logged): %s (id=%d, should be 4003)", err == LODB_OK ? "SUCCESS" : "FAILED", record.id);
+
+    err = walDb->deleteRecord("events", walUuids[9]);
+    LOG_INFO("walDb->deleteRecord(\"events\", logged): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+
+    err = walDb->checkpoint();
+    LOG_INFO("walDb->checkpoint(): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+    LOG_INFO("walDb->count(\"events\"): %d (should be 9)", walDb->count("events"));
+
+    // Logged writes survive closing and reopening the database
+    record.id = 4010;
+    walDb->insert("events", lodb_new_uuid(nullptr, 4010), &record);
+    delete walDb;
+    walDb = new LoDb("test_db_wal", LoFS::FSType::AUTO, walOptions);
+    walDb->registerTable("events", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest));
+    LOG_INFO("walDb->count(\"events\") after reopen: %d (should be 10)", walDb->count("events"));
+
+    // A write followed by silence is flushed by the log's timer, without sync() or another write.
+    // In the firmware the timer is an OSThread of the main loop, which this test blocks.
+    record.id = 4011;
+    walDb->insert("events", lodb_new_uuid(nullptr, 4011), &record);
+    char walPath[64];
+    snprintf(walPath, sizeof(walPath), "%s/lodb/test_db_wal/wal.log", sdAvailable ? "/sd" : "/internal");
+    File walFile;
+#ifdef LODB_HOST
+    walFile = LoFS::open(walPath, FILE_O_READ);
+    size_t walSizeBefore = walFile ? walFile.size() : 0;
+    if (walFile) {
+        walFile.close();
+    }
+    delay(LODB_WAL_GROUP_COMMIT_MS_DEFAULT * 4);
+    walFile = LoFS::open(walPath, FILE_O_READ);
+    size_t walSizeAfter = walFile ? walFile.size() : 0;
+    if (walFile) {
+        walFile.close();
+    }
+    LOG_INFO("wal.log after a quiet commit window: %d bytes (was %d, should have grown)", walSizeAfter, walSizeBefore);
+#endif
+
+    delete walDb; // Checkpoints and removes the log
+
+    // A frame torn by power loss is dropped on replay, the frames before it survive.
+    // The log is driven directly, since closing a LoDb checkpoints it.
+    char walDir[64];
+    snprintf(walDir, sizeof(walDir), "%s/lodb/test_db_wal", sdAvailable ? "/sd" : "/internal");
+    const uint8_t walPayload[] = {0x08, 0x2a};
+    LoDbWal *tornWal = new LoDbWal(walDir, LODB_WAL_GROUP_COMMIT_BYTES_DEFAULT, LODB_WAL_GROUP_COMMIT_MS_DEFAULT);
+    tornWal->open();
+    tornWal->put("events", lodb_new_uuid(nullptr, 4020), walPayload, sizeof(walPayload));
+    tornWal->put("events", lodb_new_uuid(nullptr, 4021), walPayload, sizeof(walPayload));
+    size_t walValidBytes = tornWal->size();
+    delete tornWal;
+
+    walFile = LoFS::open(walPath, LODB_FILE_O_APPEND);
+    if (walFile) {
+        const uint8_t tornFrame[] = {0xC1, 6, 'e', 'v', 'e', 'n', 't', 's', 0x01, 0x02}; // Header cut off in the UUID
+        walFile.write(tornFrame, sizeof(tornFrame));
+        walFile.close();
+    }
+    tornWal = new LoDbWal(walDir, LODB_WAL_GROUP_COMMIT_BYTES_DEFAULT, LODB_WAL_GROUP_COMMIT_MS_DEFAULT);
+    err = tornWal->open();
+    const LoDbWal::TableEntries *replayed = tornWal->entries("events");
+    LOG_INFO("LoDbWal::open() with a torn tail: %s, %d records replayed (should be 2)", err == LODB_OK ? "SUCCESS" : "FAILED",
+             replayed ? replayed->size() : 0);
+    LOG_INFO("Torn tail dropped from the log: %s", tornWal->size() == walValidBytes ? "YES" : "NO");
+    tornWal->reset(std::set<std::string>{"events"}); // Forgets the test records and removes the log
+    delete tornWal;
+    LOG_INFO("");
+
+    // Test 21: Atomic Update
+    LOG_INFO("--- Test 21: Atomic Update ---");
+
+    LoDbTableOptions renameOptions;
+    renameOptions.update_mode = LODB_UPDATE_RENAME;
+    err = db2->registerTable("nodes", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), renameOptions);
+    LOG_INFO("db2->registerTable(\"nodes\", rename-update): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+
+    record = meshtastic_LoDBDiagnosticsTest_init_zero;
+    record.id = 5000;
+    strncpy(record.value, "last_seen", sizeof(record.value) - 1);
+    lodb_uuid_t nodeUuid = lodb_new_uuid("node", 5000);
+    db2->insert("nodes", nodeUuid, &record);
+
+    // Hot-record updates swap the new version in with a rename, the record is never missing
+    for (int i = 1; i <= 3; i++) {
+        record.timestamp = getTime() + i;
+        err = db2->update("nodes", nodeUuid, &record);
+        if (err != LODB_OK) {
+            LOG_INFO("db2->update(\"nodes\", %d): FAILED", i);
+        }
+    }
+    meshtastic_LoDBDiagnosticsTest nodeRecord = meshtastic_LoDBDiagnosticsTest_init_zero;
+    err = db2->get("nodes", nodeUuid, &nodeRecord);
+    LOG_INFO("db2->get(\"nodes\") after 3 updates: %s (timestamp matches: %s)", err == LODB_OK ? "SUCCESS" : "FAILED",
+             nodeRecord.timestamp == record.timestamp ? "YES" : "NO");
+    LOG_INFO("db2->count(\"nodes\"): %d (should be 1)", db2->count("nodes"));
+
+    // A reboot between the remove and the rename of a non-atomic replacement leaves only {uuid}.tmp
+    char nodeHex[17];
+    lodb_uuid_to_hex(nodeUuid, nodeHex);
+    char nodePath[192];
+    char nodeTempPath[192];
+    snprintf(nodePath, sizeof(nodePath), "/internal/lodb/test_db_2/nodes/%s.pr", nodeHex);
+    snprintf(nodeTempPath, sizeof(nodeTempPath), "/internal/lodb/test_db_2/nodes/%s.tmp", nodeHex);
+    LoFS::rename(nodePath, nodeTempPath);
+    db2->registerTable("nodes", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), renameOptions);
+    nodeRecord = meshtastic_LoDBDiagnosticsTest_init_zero;
+    err = db2->get("nodes", nodeUuid, &nodeRecord);
+    LOG_INFO("db2->get(\"nodes\") after promoting an orphaned temp file: %s (timestamp matches: %s)",
+             err == LODB_OK ? "SUCCESS" : "FAILED", nodeRecord.timestamp == record.timestamp ? "YES" : "NO");
+    LOG_INFO("Orphaned temp file left behind: %s (should be NO)", LoFS::exists(nodeTempPath) ? "YES" : "NO");
+    db2->truncate("nodes");
+    LOG_INFO("");
+
+    // Test 22: Row Count
+    LOG_INFO("--- Test 22: Row Count ---");
+
+    err = db2->registerTable("counted", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest));
+    lodb_uuid_t countedUuids[4];
+    for (int i = 0; i < 4; i++) {
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 6000 + i;
+        countedUuids[i] = lodb_new_uuid(nullptr, 6000 + i);
+        db2->insert("counted", countedUuids[i], &record);
+    }
+    db2->deleteRecord("counted", countedUuids[0]);
+    LOG_INFO("db2->count(\"counted\"): %d (should be 3, from the row counter)", db2->count("counted"));
+
+    // Re-registering saves the counter to _meta and loads it back without walking the directory
+    db2->registerTable("counted", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest));
+    LOG_INFO("db2->count(\"counted\") after re-register: %d (should be 3)", db2->count("counted"));
+    db2->drop("counted");
+    LOG_INFO("");
+
+    // Test 23: Bloom Filter
+    LOG_INFO("--- Test 23: Bloom Filter ---");
+
+    LoDbTableOptions bloomOptions;
+    bloomOptions.bloom_capacity = 64;
+    bloomOptions.bloom_false_positive_rate = 0.01f;
+    err = db2->registerTable("seen", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), bloomOptions);
+    LOG_INFO("db2->registerTable(\"seen\", bloom): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+
+    lodb_uuid_t seenUuids[8];
+    for (int i = 0; i < 8; i++) {
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 7000 + i;
+        seenUuids[i] = lodb_new_uuid("seen", 7000 + i);
+        db2->insert("seen", seenUuids[i], &record);
+    }
+
+    // Absent UUIDs are ruled out from RAM, present ones are confirmed against storage
+    int seenAbsent = 0;
+    for (int i = 0; i < 100; i++) {
+        seenAbsent += db2->exists("seen", lodb_new_uuid("unseen", i)) ? 0 : 1;
+    }
+    LOG_INFO("db2->exists(\"seen\") for 8 stored UUIDs: %s", db2->exists("seen", seenUuids[0]) && db2->exists("seen", seenUuids[7]) ? "SUCCESS" : "FAILED");
+    LOG_INFO("db2->exists(\"seen\") for 100 absent UUIDs: %d absent (should be 100)", seenAbsent);
+
+    // Re-registering saves the filter to _bloom and loads it back without walking the directory
+    db2->registerTable("seen", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), bloomOptions);
+    err = db2->get("seen", seenUuids[3], &record);
+    LOG_INFO("db2->get(\"seen\") after re-register: %s", err == LODB_OK && record.id == 7003 ? "SUCCESS" : "FAILED");
+    db2->drop("seen");
+    LOG_INFO("");
+
+    // Test 24: Record Cache
+    LOG_INFO("--- Test 24: Record Cache ---");
+
+    LoDbOptions cacheOptions;
+    cacheOptions.record_cache_bytes = 2048;
+    LoDb *cacheDb = new LoDb("test_db_cache", LoFS::FSType::AUTO, cacheOptions);
+    cacheDb->registerTable("sessions", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest));
+
+    record = meshtastic_LoDBDiagnosticsTest_init_zero;
+    record.id = 8000;
+    strncpy(record.value, "session", sizeof(record.value) - 1);
+    lodb_uuid_t sessionUuid = lodb_new_uuid("session", 8000);
+    cacheDb->insert("sessions", sessionUuid, &record);
+
+    // The first get reads flash, the rest are copies out of the cache
+    meshtastic_LoDBDiagnosticsTest sessionRecord = meshtastic_LoDBDiagnosticsTest_init_zero;
+    for (int i = 0; i < 5; i++) {
+        cacheDb->get("sessions", sessionUuid, &sessionRecord);
+    }
+    LoDbCacheStats cacheStats = cacheDb->getCacheStats();
+    LOG_INFO("cacheDb->getCacheStats() after 5 gets: %u hits, %u misses (should be 4 and 1)", cacheStats.hits, cacheStats.misses);
+
+    // Updates and deletes invalidate; the get after an update decodes what was stored
+    record.timestamp = 12345;
+    memset(record.value + strlen(record.value) + 1, 'x', 4); // Not part of the encoding
+    cacheDb->update("sessions", sessionUuid, &record);
+    err = cacheDb->get("sessions", sessionUuid, &sessionRecord);
+    LOG_INFO("cacheDb->get(\"sessions\") after update: %s (timestamp=%u, should be 12345)", err == LODB_OK ? "SUCCESS" : "FAILED",
+             sessionRecord.timestamp);
+    LOG_INFO("  Stored bytes only: %s", sessionRecord.value[strlen(sessionRecord.value) + 1] == 0 ? "MATCH" : "MISMATCH");
+    LOG_INFO("cacheDb->getCacheStats() after update: %u misses (should be 2)", cacheDb->getCacheStats().misses);
+    cacheDb->deleteRecord("sessions", sessionUuid);
+    err = cacheDb->get("sessions", sessionUuid, &sessionRecord);
+    LOG_INFO("cacheDb->get(\"sessions\") after delete: %s", err == LODB_ERR_NOT_FOUND ? "NOT_FOUND (correct)" : "FAILED");
+    delete cacheDb;
+    LOG_INFO("");
+
+    // Test 25: Sharded Layout
+    LOG_INFO("--- Test 25: Sharded Layout ---");
+
+    err = db2->registerTable("fanout", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest));
+    lodb_uuid_t fanoutUuids[20];
+    for (int i = 0; i < 20; i++) {
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 9000 + i;
+        fanoutUuids[i] = lodb_new_uuid("fanout", 9000 + i);
+        db2->insert("fanout", fanoutUuids[i], &record);
+    }
+
+    // Re-registering with a sharded layout moves the flat record files into {table}/{xx}/
+    LoDbTableOptions shardOptions;
+    shardOptions.layout = LODB_LAYOUT_SHARD_256;
+    err = db2->registerTable("fanout", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), shardOptions);
+    LOG_INFO("db2->registerTable(\"fanout\", sharded): %s", err == LODB_OK ? "SUCCESS" : "FAILED");
+
+    char uuidHex[17];
+    lodb_uuid_to_hex(fanoutUuids[0], uuidHex);
+    char shardedPath[192];
+    snprintf(shardedPath, sizeof(shardedPath), "/internal/lodb/test_db_2/fanout/%.2s/%s.pr", uuidHex, uuidHex);
+    LOG_INFO("Record file moved into its shard: %s", LoFS::exists(shardedPath) ? "YES" : "NO");
+
+    err = db2->get("fanout", fanoutUuids[7], &record);
+    LOG_INFO("db2->get(\"fanout\") after migration: %s (id=%d, should be 9007)", err == LODB_OK ? "SUCCESS" : "FAILED", record.id);
+    std::vector<void *> fanoutRecords = db2->select("fanout");
+    LOG_INFO("db2->select(\"fanout\"): %d records (should be 20)", fanoutRecords.size());
+    db2->freeRecords(fanoutRecords);
+    db2->drop("fanout");
+    LOG_INFO("");
+
+    // Test 26: Async Operations
+    LOG_INFO("--- Test 26: Async Operations ---");
+
+    db2->registerTable("inbox", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest));
+    LoDbAsync *inbox = new LoDbAsync(db2, 4);
+    inbox->pause(); // Keep the worker from starting requests while the queue state is checked
+    int asyncInserted = 0;
+    for (int i = 0; i < 3; i++) {
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 10000 + i;
+        inbox->insertAsync("inbox", lodb_new_uuid("inbox", 10000 + i), &record, [&asyncInserted](LoDbError result) {
+            if (result == LODB_OK) {
+                asyncInserted++;
+            }
+        });
+    }
+
+    // Back-to-back updates of one record are merged into a single write
+    lodb_uuid_t inboxUuid = lodb_new_uuid("inbox", 10000);
+    record = meshtastic_LoDBDiagnosticsTest_init_zero;
+    record.id = 10000;
+    record.timestamp = 1;
+    inbox->updateAsync("inbox", inboxUuid, &record);
+    record.timestamp = 2;
+    inbox->updateAsync("inbox", inboxUuid, &record);
+    LOG_INFO("inbox->pending(): %d (should be 4), coalesced: %u (should be 1)", inbox->pending(), inbox->coalescedCount());
+
+    // The queue holds 4 requests, so the next one is rejected until the worker catches up
+    err = inbox->countAsync("inbox", [](int count) {});
+    LOG_INFO("inbox->countAsync() on a full queue: %s", err == LODB_ERR_BUSY ? "BUSY (correct)" : "FAILED");
+
+    int asyncCount = -1;
+    inbox->resume();
+    inbox->flush();
+    inbox->countAsync("inbox", [&asyncCount](int count) { asyncCount = count; });
+    inbox->flush();
+    LOG_INFO("Async inserts completed: %d, countAsync: %d (should be 3 and 3)", asyncInserted, asyncCount);
+    err = db2->get("inbox", inboxUuid, &record);
+    LOG_INFO("db2->get(\"inbox\") after merged updates: timestamp=%u (should be 2)", record.timestamp);
+    delete inbox;
+    db2->drop("inbox");
+    LOG_INFO("");
+
+    // Test 27: Operation Stats
+    LOG_INFO("--- Test 27: Operation Stats ---");
+
+    db2->registerTable("stats", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest));
+    for (int i = 0; i < 3; i++) {
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 11000 + i;
+        db2->insert("stats", lodb_new_uuid("stats", 11000 + i), &record);
+    }
+    db2->get("stats", lodb_new_uuid("stats", 11000), &record);
+    db2->get("stats", lodb_new_uuid("stats", 11999), &record); // Not found
+    db2->count("stats");
+    std::vector<void *> badSelect = db2->select("stats", LoDbWhere().eq(meshtastic_LoDBDiagnosticsTest_value_tag, 1)); // Invalid
+    LoDb::freeRecords(badSelect);
+
+    // Several KB with the histograms, so keep it off the stack
+    meshtastic_LoDBTableStats *tableStats = new meshtastic_LoDBTableStats();
+    err = db2->getTableStats("stats", tableStats);
+    LOG_INFO("db2->getTableStats(\"stats\"): %s, %d operations recorded (should be 4)", err == LODB_OK ? "OK" : "FAILED",
+             tableStats->operations_count);
+    for (pb_size_t i = 0; i < tableStats->operations_count; i++) {
+        const meshtastic_LoDBOperationStats &op = tableStats->operations[i];
+        LOG_INFO("  operation %d: count=%u errors=%u max=%u us", op.operation, op.count, op.errors, op.max_latency_us);
+    }
+    LOG_INFO("  NOT_FOUND errors: %u (should be 1), bytes written: %u, records decoded: %u (should be 1)",
+             tableStats->errors_by_code[LODB_ERR_NOT_FOUND], (uint32_t)tableStats->bytes_written, tableStats->records_decoded);
+    LOG_INFO("  INVALID errors: %u (should be 1, the select with a mistyped where clause)",
+             tableStats->errors_by_code[LODB_ERR_INVALID]);
+
+    db2->resetStats();
+    db2->getTableStats("stats", tableStats);
+    LOG_INFO("After resetStats(): %d operations recorded (should be 0)", tableStats->operations_count);
+    delete tableStats;
+    db2->drop("stats");
+    LOG_INFO("");
+
+    // Test 28: Compression
+    LOG_INFO("--- Test 28: Compression ---");
+
+    db2->registerTable("packed", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest));
+    for (int i = 0; i < 10; i++) {
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 12000 + i;
+        snprintf(record.value, sizeof(record.value), "telemetry battery=%d voltage=3.%d channel_util=%d", 50 + i, i, i * 3);
+        record.timestamp = 1700000000 + i;
+        db2->insert("packed", lodb_new_uuid("packed", 12000 + i), &record);
+    }
+
+    // Train on the plain records, then compress everything written from now on
+    uint8_t *dictionary = new uint8_t[1024];
+    size_t dictionarySize = 0;
+    err = db2->trainDictionary("packed", dictionary, 1024, &dictionarySize);
+    LOG_INFO("db2->trainDictionary(\"packed\"): %s, %d bytes", err == LODB_OK ? "OK" : "FAILED", dictionarySize);
+
+    LoDbTableOptions packedOptions;
+    packedOptions.compression = LODB_COMPRESSION_LZ;
+    packedOptions.compression_dictionary = dictionary;
+    packedOptions.compression_dictionary_size = dictionarySize;
+    db2->registerTable("packed", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), packedOptions);
+    delete[] dictionary;
+    db2->resetStats();
+
+    for (int i = 10; i < 20; i++) {
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 12000 + i;
+        snprintf(record.value, sizeof(record.value), "telemetry battery=%d voltage=3.%d channel_util=%d", 50 + i, i % 10, i * 3);
+        record.timestamp = 1700000000 + i;
+        db2->insert("packed", lodb_new_uuid("packed", 12000 + i), &record);
+    }
+
+    // Plain and compressed records read back alike
+    meshtastic_LoDBDiagnosticsTest packed = meshtastic_LoDBDiagnosticsTest_init_zero;
+    err = db2->get("packed", lodb_new_uuid("packed", 12003), &packed);
+    LOG_INFO("db2->get(plain record): %s, value=\"%s\"", err == LODB_OK ? "OK" : "FAILED", packed.value);
+    err = db2->get("packed", lodb_new_uuid("packed", 12015), &packed);
+    LOG_INFO("db2->get(compressed record): %s, value=\"%s\"", err == LODB_OK && packed.id == 12015 ? "OK" : "FAILED",
+             packed.value);
+
+    LoDbWhere packedWhere = LoDbWhere().eq(meshtastic_LoDBDiagnosticsTest_id_tag, 12017);
+    LOG_INFO("db2->count(\"packed\", id == 12017): %d (should be 1)", db2->count("packed", packedWhere));
+
+    tableStats = new meshtastic_LoDBTableStats();
+    if (db2->getTableStats("packed", tableStats) == LODB_OK && tableStats->compression_output_bytes > 0) {
+        LOG_INFO("Compressed %u bytes into %u (ratio %u.%02u)", (uint32_t)tableStats->compression_input_bytes,
+                 (uint32_t)tableStats->compression_output_bytes,
+                 (uint32_t)(tableStats->compression_input_bytes / tableStats->compression_output_bytes),
+                 (uint32_t)(tableStats->compression_input_bytes * 100 / tableStats->compression_output_bytes % 100));
+    }
+    delete tableStats;
+    db2->drop("packed");
+    LOG_INFO("");
+
+    // Test 29: Ring Table
+    LOG_INFO("--- Test 29: Ring Table ---");
+
+    LoDbTableOptions ringOptions;
+    ringOptions.storage = LODB_STORAGE_RING;
+    ringOptions.ring_capacity = 8;
+    ringOptions.ring_slot_size = meshtastic_LoDBDiagnosticsTest_size;
+    db2->registerTable("recent", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), ringOptions);
+    for (int i = 0; i < 20; i++) {
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 13000 + i;
+        snprintf(record.value, sizeof(record.value), "reading %d", i);
+        record.timestamp = 1700000000 + i;
+        db2->insert("recent", lodb_new_uuid("recent", 13000 + i), &record);
+    }
+    LOG_INFO("db2->count(\"recent\") after 20 inserts: %d (should be 8)", db2->count("recent"));
+
+    // The oldest records were overwritten in place
+    meshtastic_LoDBDiagnosticsTest recent = meshtastic_LoDBDiagnosticsTest_init_zero;
+    err = db2->get("recent", lodb_new_uuid("recent", 13005), &recent);
+    LOG_INFO("db2->get(evicted record): %s", err == LODB_ERR_NOT_FOUND ? "NOT_FOUND (OK)" : "FAILED");
+
+    auto latest = db2->selectLatest("recent", 3);
+    LOG_INFO("db2->selectLatest(\"recent\", 3): %d records, newest id=%d (should be 13019)", latest.size(),
+             latest.empty() ? 0 : ((meshtastic_LoDBDiagnosticsTest *)latest[0])->id);
+    LoDb::freeRecords(latest);
+    db2->drop("recent");
+    LOG_INFO("");
+
+    // Test 30: Record Expiry
+    LOG_INFO("--- Test 30: Record Expiry ---");
+
+    LoDbTableOptions ttlOptions;
+    ttlOptions.ttl_field = meshtastic_LoDBDiagnosticsTest_timestamp_tag;
+    ttlOptions.ttl_seconds = 3600;
+    db2->registerTable("sessions", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest), ttlOptions);
+    uint32_t now = getTime();
+    for (int i = 0; i < 10; i++) {
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 14000 + i;
+        snprintf(record.value, sizeof(record.value), "session %d", i);
+        // The first four sessions were last seen two hours ago
+        record.timestamp = i < 4 ? now - 7200 : now;
+        db2->insert("sessions", lodb_new_uuid("sessions", 14000 + i), &record);
+    }
+    LOG_INFO("db2->count(\"sessions\"): %d (should be 6)", db2->count("sessions"));
+
+    // Expired records read as deleted before the sweeper gets to them
+    meshtastic_LoDBDiagnosticsTest session = meshtastic_LoDBDiagnosticsTest_init_zero;
+    err = db2->get("sessions", lodb_new_uuid("sessions", 14001), &session);
+    LOG_INFO("db2->get(expired record): %s", err == LODB_ERR_NOT_FOUND ? "NOT_FOUND (OK)" : "FAILED");
+
+    size_t swept = 0;
+    err = db2->sweepExpired("sessions", LODB_SWEEP_BUDGET_MS_DEFAULT, &swept);
+    LOG_INFO("db2->sweepExpired(\"sessions\"): %s, swept %d (should be 4)", err == LODB_OK ? "OK" : "FAILED", swept);
+    LOG_INFO("db2->count(\"sessions\", all) after sweep: %d (should be 6)",
+             db2->count("sessions", [](const void *) { return true; }));
+    db2->drop("sessions");
+    LOG_INFO("");
+
+    // Test 31: Sortable UUIDs
+    LOG_INFO("--- Test 31: Sortable UUIDs ---");
+
+    db2->registerTable("events", &meshtastic_LoDBDiagnosticsTest_msg, sizeof(meshtastic_LoDBDiagnosticsTest));
+    lodb_uuid_t eventUuids[10];
+    bool ascending = true;
+    for (int i = 0; i < 10; i++) {
+        eventUuids[i] = lodb_new_sortable_uuid(0x1234);
+        ascending = ascending && (i == 0 || eventUuids[i] > eventUuids[i - 1]);
+        record = meshtastic_LoDBDiagnosticsTest_init_zero;
+        record.id = 15000 + i;
+        snprintf(record.value, sizeof(record.value), "event %d", i);
+        record.timestamp = LODB_SORTABLE_UUID_TIME(eventUuids[i]);
+        db2->insert("events", eventUuids[i], &record);
+    }
+    LOG_INFO("lodb_new_sortable_uuid() x10: %s", ascending ? "ascending (OK)" : "FAILED");
+
+    // Newest first without a sort: UUID order is creation order
+    auto newest = db2->selectLatest("events", 2);
+    LOG_INFO("db2->selectLatest(\"events\", 2): %d records, newest id=%d (should be 15009)", newest.size(),
+             newest.empty() ? 0 : ((meshtastic_LoDBDiagnosticsTest *)newest[0])->id);
+    LoDb::freeRecords(newest);
+
+    size_t deletedEvents = 0;
+    err = db2->deleteBefore("events", eventUuids[4], &deletedEvents);
+    LOG_INFO("db2->deleteBefore(\"events\", 5th UUID): %s, deleted %d (should be 4)", err == LODB_OK ? "OK" : "FAILED",
+             deletedEvents);
+    LOG_INFO("db2->count(\"events\"): %d (should be 6)", db2->count("events"));
+    db2->drop("events");
+    LOG_INFO("");
+
+    // Test 32: Cleanup
+    LOG_INFO("--- Test 32: Cleanup ---");
 
     // Truncate test tables to clean up
     db1->truncate("users");